@@ -5,7 +5,7 @@ rem Compile all shaders
 echo Compiling shaders
 cd data\shaders
 setlocal EnableDelayedExpansion
-for %%f in (*.vert, *.frag) do (
+for %%f in (*.vert, *.frag, *.comp) do (
     set x=%%~xf
     set name=%%~nf_!x:~1!.spv
     %VULKAN_SDK%\Bin\glslangValidator.exe -V %%f -o !name!
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compile shaders in data/shaders to SPIR-V, named the same way as compile_shaders.bat does (basic.vert => basic_vert.spv)
+# Usage: compile_shaders.sh [shader...] : compile the given shaders, or all of them if none are given
+# Changing an included .glsl file recompiles every shader, as any of them might include it
+
+if [ -n "$VULKAN_SDK" ]; then
+    GLSLANG="$VULKAN_SDK/bin/glslangValidator"
+elif command -v glslangValidator > /dev/null; then
+    GLSLANG=glslangValidator
+else
+    echo "glslangValidator was not found."
+    echo "Please install it or set the VULKAN_SDK environment variable to point to your vulkan sdk folder!"
+    exit 3
+fi
+
+cd "$(dirname "$0")/data/shaders" || exit 1
+
+shaders=""
+for shader in "$@"; do
+    case "$shader" in
+        *.glsl) shaders=""; break ;;
+        *) shaders="$shaders $(basename "$shader")" ;;
+    esac
+done
+if [ -z "$shaders" ]; then
+    shaders=$(ls *.vert *.frag *.comp 2> /dev/null)
+fi
+
+status=0
+for shader in $shaders; do
+    extension="${shader##*.}"
+    name="${shader%.*}_$extension.spv"
+    # Compile next to the old binary and swap it in whole, so a running engine never loads half a file
+    if output=$("$GLSLANG" -V "$shader" -o "$name.tmp"); then
+        mv "$name.tmp" "$name"
+        echo "$shader => $name"
+    else
+        rm -f "$name.tmp"
+        echo "$output"
+        status=1
+    fi
+done
+exit $status
@@ -1,44 +1,103 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
+#extension GL_GOOGLE_include_directive : enable
 
-layout(binding = 1) uniform UniformBufferObject {
-    vec3 lightColor;
-    vec3 ambientColor;
+layout(binding = 1) uniform LightingUniforms {
+    vec4 lightPosition;
+    vec4 lightColor;
+    vec4 ambientColor;
+    vec4 viewPosition;
+    mat4 view;
+    // x and y scale of the projection, near and far plane
+    vec4 projection;
+    vec2 viewportSize;
+    // Scale and bias turning the log of a view depth into a depth slice
+    vec2 clusterDepth;
 } ubo;
 layout(binding = 2) uniform sampler2D diffuseSampler;
 layout(binding = 3) uniform sampler2D normalSampler;
 
+#include "clusters.glsl"
+
+layout(std430, binding = 4) readonly buffer LightBuffer {
+    uint lightCount;
+    Light lights[];
+};
+layout(std430, binding = 5) readonly buffer ClusterBuffer {
+    uint clusterLights[];
+};
+
 layout(location = 0) in FragmentShaderInput {
     vec3 fragPos;
     vec2 texCoords;
 
-    vec3 tangentLightPos;
-    vec3 tangentViewPos;
-    vec3 tangentFragPos;
+    vec3 normal;
+    // Handedness of the bitangent in w
+    vec4 tangent;
 } fsi;
 
 layout(location = 0) out vec4 outColor;
 
-const float SPECULAR_POWER = 64.0;
-const float SPECULAR_MODIFIER = 0.4;
+// Material features, specialized per pipeline so untaken branches are compiled out
+layout(constant_id = 0) const bool NORMAL_MAPPING = true;
+// 0 - none, 1 - Phong, 2 - Blinn-Phong
+layout(constant_id = 1) const uint SPECULAR_MODEL = 2;
+layout(constant_id = 2) const float SPECULAR_POWER = 64.0;
+layout(constant_id = 3) const float SPECULAR_MODIFIER = 0.4;
+layout(constant_id = 4) const bool ALPHA_TEST = false;
+layout(constant_id = 5) const float ALPHA_CUTOFF = 0.5;
+
+const uint SPECULAR_NONE = 0;
+const uint SPECULAR_PHONG = 1;
+
+// Diffuse and specular intensity of a single light
+float lightIntensity(vec3 lightDir, vec3 normal, vec3 viewDir) {
+    float diff = max(dot(lightDir, normal), 0.0);
+
+    float spec = 0.0;
+    if (SPECULAR_MODEL != SPECULAR_NONE) {
+        float cosine;
+        if (SPECULAR_MODEL == SPECULAR_PHONG)
+            cosine = dot(viewDir, reflect(-lightDir, normal));
+        else
+            cosine = dot(normal, normalize(lightDir + viewDir));
+        spec = pow(max(cosine, 0.0), SPECULAR_POWER) * SPECULAR_MODIFIER;
+    }
+
+    return diff + spec;
+}
 
 void main() {
-    // Get [0; 1] normals
-    vec3 normal = texture(normalSampler, fsi.texCoords).rgb;
-    // Translate to [-1; 1] normals
-    normal = normalize(normal * 2.0 - 1.0);
+    vec4 color = texture(diffuseSampler, fsi.texCoords);
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF)
+        discard;
 
-    vec3 color = texture(diffuseSampler, fsi.texCoords).rgb;
+    vec3 normal = normalize(fsi.normal);
+    if (NORMAL_MAPPING) {
+        // Get [0; 1] normals
+        vec3 tangentNormal = texture(normalSampler, fsi.texCoords).rgb;
+        // Translate to [-1; 1] normals
+        tangentNormal = tangentNormal * 2.0 - 1.0;
 
-    vec3 lightDir = normalize(fsi.tangentLightPos - fsi.tangentFragPos);
-    float diff = max(dot(lightDir, normal), 0.0);
+        // Interpolation skews the tangent, make it perpendicular to the normal again
+        vec3 tangent = normalize(fsi.tangent.xyz - normal * dot(normal, fsi.tangent.xyz));
+        vec3 bitangent = cross(normal, tangent) * fsi.tangent.w;
+        normal = normalize(mat3(tangent, bitangent, normal) * tangentNormal);
+    }
 
-    vec3 viewDir = normalize(fsi.tangentViewPos - fsi.tangentFragPos);
-    vec3 reflectDir = reflect(-lightDir, normal);
-    vec3 halfwayDir = normalize(lightDir + viewDir);  
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), SPECULAR_POWER) * SPECULAR_MODIFIER;
+    vec3 viewDir = normalize(ubo.viewPosition.xyz - fsi.fragPos);
+    vec3 light = ubo.ambientColor.rgb + lightIntensity(normalize(ubo.lightPosition.xyz - fsi.fragPos), normal, viewDir) * ubo.lightColor.rgb;
 
-    vec3 light = ubo.ambientColor + (diff + spec) * ubo.lightColor;
+    // Only the lights binned into this fragment's cluster can reach it
+    uint cluster = clusterIndex(gl_FragCoord.xy, viewDepth(gl_FragCoord.z)) * CLUSTER_STRIDE;
+    uint count = clusterLights[cluster];
+    for (uint i = 0; i < count; ++i) {
+        Light nearby = lights[clusterLights[cluster + 1 + i]];
+        vec3 toLight = nearby.position.xyz - fsi.fragPos;
+        float attenuation = lightAttenuation(nearby, toLight);
+        if (attenuation > 0.0)
+            light += lightIntensity(normalize(toLight), normal, viewDir) * attenuation * nearby.color.rgb;
+    }
 
-    outColor = vec4(light * color, 1);
+    outColor = vec4(light * color.rgb, 1);
 }
\ No newline at end of file
@@ -3,58 +3,48 @@
 #extension GL_ARB_separate_shader_objects : enable
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 modelViewProjection;
-    mat4 model;
-    mat4 view;
-    mat4 normal;
-
-    vec4 lightPos;
-    vec4 viewPos;
+    mat4 projectionView;
 } ubo;
 
+// Per-draw transforms, pushed with every draw call
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+    mat3 normal;
+} draw;
+
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
-layout(location = 3) in vec3 inTangent;
-layout(location = 4) in vec3 inBitangent;
+// Bitangent handedness in w
+layout(location = 3) in vec4 inTangent;
 
+// World space, so any number of lights can be shaded without transforming each one per vertex
 layout(location = 0) out VertexShaderOutput {
     vec3 fragPosition;
     vec2 texCoords;
 
-    vec3 tangentLightPos;
-    vec3 tangentViewPos;
-    vec3 tangentFragPos;
-
-    vec3 test;
+    vec3 normal;
+    // Handedness in w, the fragment shader rebuilds the bitangent
+    vec4 tangent;
 } vso;
-/*
-layout(location = 0) out vec2 fragTexCoord;
-layout(location = 1) out vec3 fragNormal;
-layout(location = 2) out vec3 fragLightDir;
-*/
 
 
 out gl_PerVertex {
     vec4 gl_Position;
 };
+// Computed the same way as in depth.vert, so depth equals the pre-pass depth exactly
+invariant gl_Position;
 
 void main() {
-    gl_Position = ubo.modelViewProjection * vec4(inPosition, 1);
+    vec4 worldPosition = draw.model * vec4(inPosition, 1);
+    gl_Position = ubo.projectionView * worldPosition;
     gl_Position.y = -gl_Position.y;
 
-    mat3 normalMat = mat3(ubo.normal);
-
-    vec3 tangent = normalize(normalMat * inTangent);
-    vec3 bitangent = normalize(normalMat * inBitangent);
-    vec3 normal = normalize(normalMat * inNormal);
-
-    mat3 TBN = transpose(mat3(tangent, bitangent, normal));
+    mat3 normalMat = draw.normal;
 
-    vso.fragPosition = vec3(ubo.model * vec4(inPosition, 1));
+    vso.fragPosition = worldPosition.xyz;
     vso.texCoords = inTexCoord;
 
-    vso.tangentLightPos = TBN * ubo.lightPos.xyz;
-    vso.tangentViewPos = TBN * ubo.viewPos.xyz;
-    vso.tangentFragPos = TBN * vso.fragPosition;
+    vso.normal = normalize(normalMat * inNormal);
+    vso.tangent = vec4(normalize(normalMat * inTangent.xyz), inTangent.w);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+// Clustered light lists shared by the light culling and the shading shaders
+// Expects ubo.projection, ubo.viewportSize and ubo.clusterDepth to be declared before the include
+// The grid has to match the cluster constants in Context.h
+
+const uint CLUSTER_GRID_X = 16;
+const uint CLUSTER_GRID_Y = 9;
+const uint CLUSTER_GRID_Z = 24;
+// Every cluster is its light count followed by room for this many light indices
+const uint MAX_LIGHTS_PER_CLUSTER = 128;
+const uint CLUSTER_STRIDE = MAX_LIGHTS_PER_CLUSTER + 1;
+
+struct Light {
+    // World-space position, range in w
+    vec4 position;
+    // Spot cone scale in w
+    vec4 color;
+    // Spot direction, spot cone offset in w
+    vec4 direction;
+};
+
+// Distance along the view direction of a depth buffer value
+float viewDepth(float depth) {
+    float near = ubo.projection.z;
+    float far = ubo.projection.w;
+    return near * far / (far - depth * (far - near));
+}
+
+// Depth slices are spaced exponentially, so clusters stay about as deep as they are wide
+uint clusterIndex(vec2 fragCoord, float depth) {
+    uvec2 tile = min(uvec2(fragCoord / ubo.viewportSize * vec2(CLUSTER_GRID_X, CLUSTER_GRID_Y)), uvec2(CLUSTER_GRID_X - 1, CLUSTER_GRID_Y - 1));
+    uint slice = uint(clamp(log(depth) * ubo.clusterDepth.x + ubo.clusterDepth.y, 0.0, float(CLUSTER_GRID_Z - 1)));
+    return (slice * CLUSTER_GRID_Y + tile.y) * CLUSTER_GRID_X + tile.x;
+}
+
+// Inverse square falloff, windowed to reach zero at the light's range, times the spot cone
+float lightAttenuation(Light light, vec3 toLight) {
+    float distanceSquared = dot(toLight, toLight);
+    float ratio = distanceSquared / (light.position.w * light.position.w);
+    float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+
+    // Point lights have a cone scale of 0 and an offset of 1
+    vec3 lightDir = toLight * inversesqrt(max(distanceSquared, 1e-8));
+    float cone = clamp(dot(-lightDir, light.direction.xyz) * light.color.w + light.direction.w, 0.0, 1.0);
+
+    return window * window / (distanceSquared + 1.0) * cone * cone;
+}
\ No newline at end of file
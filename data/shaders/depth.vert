@@ -0,0 +1,27 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Depth pre-pass, reads positions only and runs without a fragment shader
+// Positions have to be transformed exactly like in basic.vert, the main pass tests depth for equality
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 projectionView;
+} ubo;
+
+// Only the start of the draw constants basic.vert reads
+layout(push_constant) uniform DrawConstants {
+    mat4 model;
+} draw;
+
+layout(location = 0) in vec3 inPosition;
+
+out gl_PerVertex {
+    vec4 gl_Position;
+};
+invariant gl_Position;
+
+void main() {
+    vec4 worldPosition = draw.model * vec4(inPosition, 1);
+    gl_Position = ubo.projectionView * worldPosition;
+    gl_Position.y = -gl_Position.y;
+}
@@ -0,0 +1,47 @@
+// Depth pyramid test shared by the culling shaders
+// Expects ubo.viewportSize, ubo.levelCount and depthPyramid to be declared before the include
+
+bool isVisible(vec4 sphere, mat4 projectionView) {
+    vec2 minUV = vec2(1.0);
+    vec2 maxUV = vec2(0.0);
+    float nearestDepth = 1.0;
+
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = sphere.xyz + sphere.w * vec3(
+            (i & 1) != 0 ? 1.0 : -1.0,
+            (i & 2) != 0 ? 1.0 : -1.0,
+            (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = projectionView * vec4(corner, 1.0);
+
+        // Bounds crossing the near plane can't be projected, keep them
+        if (clip.w <= 1e-4)
+            return true;
+
+        vec3 ndc = clip.xyz / clip.w;
+        // The vertex shader flips y
+        vec2 uv = vec2(ndc.x, -ndc.y) * 0.5 + 0.5;
+        minUV = min(minUV, uv);
+        maxUV = max(maxUV, uv);
+        nearestDepth = min(nearestDepth, ndc.z);
+    }
+
+    ivec2 maxPixel = ivec2(ubo.viewportSize) - 1;
+    ivec2 first = clamp(ivec2(floor(minUV * ubo.viewportSize)), ivec2(0), maxPixel);
+    ivec2 last = clamp(ivec2(floor(maxUV * ubo.viewportSize)), ivec2(0), maxPixel);
+
+    // Level 0 is half resolution, pick the first level where the rectangle covers at most 2x2 texels
+    int level = 0;
+    while (level < ubo.levelCount - 1 && any(greaterThan((last >> (level + 1)) - (first >> (level + 1)), ivec2(1))))
+        ++level;
+    // Deeper levels round their size down, so the last row and column also cover the leftover texels
+    // With dynamic resolution only part of the pyramid is built, sized from the viewport rather than the image
+    ivec2 levelLast = max(((ivec2(ubo.viewportSize) + 1) / 2) >> level, ivec2(1)) - 1;
+    first = min(first >> (level + 1), levelLast);
+    last = min(last >> (level + 1), levelLast);
+
+    float farthest = max(
+        max(texelFetch(depthPyramid, first, level).r, texelFetch(depthPyramid, ivec2(last.x, first.y), level).r),
+        max(texelFetch(depthPyramid, ivec2(first.x, last.y), level).r, texelFetch(depthPyramid, last, level).r));
+
+    return nearestDepth <= farthest;
+}
@@ -0,0 +1,21 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+// Stretches the rendered part of the scene image over the whole swapchain image with bilinear filtering
+
+layout(binding = 0) uniform sampler2D scene;
+
+layout(push_constant) uniform UpscaleConstants {
+    vec2 uvScale;
+    vec2 uvMax;
+} upscale;
+
+layout(location = 0) in vec2 fragTexCoord;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Clamped half a texel inside, so the edges never blend in texels that weren't rendered this frame
+    vec2 uv = min(fragTexCoord * upscale.uvScale, upscale.uvMax);
+    outColor = vec4(texture(scene, uv).rgb, 1.0);
+}
\ No newline at end of file
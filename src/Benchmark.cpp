@@ -0,0 +1,81 @@
+#include "Benchmark.h"
+
+#include "graphics/BVH.h"
+#include "graphics/Camera.h"
+#include "graphics/TransformStore.h"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+	// Repetitions of every query, the average is reported
+	const int QUERY_REPETITIONS = 16;
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	float millisecondsSince(const Clock::time_point &start) {
+		return std::chrono::duration<float, std::chrono::milliseconds::period>(Clock::now() - start).count();
+	}
+}
+
+void Benchmark::culling(size_t objectCount) {
+	using namespace Graphics;
+
+	// Keep the density constant, so the camera sees a similar share of objects at every count
+	float halfSize = 2.0f * std::cbrt(static_cast<float>(objectCount));
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-halfSize, halfSize);
+	std::uniform_real_distribution<float> radius(0.25f, 1.0f);
+
+	TransformStore transforms;
+	std::vector<BVH::Item> items(objectCount);
+	for (size_t i = 0; i < objectCount; ++i) {
+		BoundingSphere sphere;
+		sphere.radius = radius(random);
+
+		TransformStore::Handle handle = transforms.create();
+		transforms.setPosition(handle, glm::vec3(position(random), position(random), position(random)));
+		transforms.setBounds(handle, sphere);
+		items[i].id = handle;
+	}
+	transforms.update();
+
+	for (auto &item : items)
+		item.bounds = AABB::fromSphere(transforms.getWorldBounds(item.id));
+
+	auto start = Clock::now();
+	BVH bvh;
+	bvh.build(items);
+	float buildTime = millisecondsSince(start);
+
+	Camera camera(glm::vec3(0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 60.0f);
+	camera.setAspectRatio(16.0f / 9.0f);
+	Frustum frustum = Frustum::fromMatrix(camera.getProjectionViewMatrix());
+
+	std::vector<uint32_t> visible;
+	start = Clock::now();
+	for (int i = 0; i < QUERY_REPETITIONS; ++i) {
+		visible.clear();
+		bvh.cull(frustum, visible);
+	}
+	float bvhTime = millisecondsSince(start) / QUERY_REPETITIONS;
+
+	size_t linearVisible = 0;
+	start = Clock::now();
+	for (int i = 0; i < QUERY_REPETITIONS; ++i) {
+		transforms.cull(frustum);
+
+		linearVisible = 0;
+		for (auto &item : items)
+			linearVisible += transforms.isVisible(item.id) ? 1 : 0;
+	}
+	float linearTime = millisecondsSince(start) / QUERY_REPETITIONS;
+
+	std::cout << "Objects: " << objectCount << std::endl;
+	std::cout << "  BVH build: " << buildTime << " ms" << std::endl;
+	std::cout << "  BVH cull: " << bvhTime << " ms, " << visible.size() << " visible" << std::endl;
+	std::cout << "  Linear cull: " << linearTime << " ms, " << linearVisible << " visible" << std::endl;
+}
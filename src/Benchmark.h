@@ -0,0 +1,13 @@
+#pragma once
+
+/*
+	Standalone measurements of engine subsystems, run from the console.
+*/
+
+#include <cstddef>
+
+namespace Benchmark {
+
+	/// Cull randomly placed objects with a BVH and with a linear SIMD scan, printing the timings
+	void culling(size_t objectCount);
+}
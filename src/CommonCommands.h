@@ -13,6 +13,21 @@ namespace Commands {
 	extern void vulkan(String &);
 	extern void speed(String &);
 	extern void load(String &);
+	extern void commandCache(String &);
+	extern void stats(String &);
+	extern void benchmark(String &);
+	extern void occlusion(String &);
+	extern void occluder(String &);
+	extern void hiZ(String &);
+	extern void meshlets(String &);
+	extern void material(String &);
+	extern void hotReload(String &);
+	extern void prePass(String &);
+	extern void lights(String &);
+	extern void resolution(String &);
+	extern void latency(String &);
+	extern void pick(String &);
+	extern void query(String &);
 
 	void commonList(String &);
 	void commonHelp(String &);
@@ -43,6 +58,92 @@ namespace Commands {
 		"attempt to load a resource",
 		"Usage: load <resource. : try to load a given <resource>"
 	};
+	const CommandData COMMON_DATA_CMDCACHE = {
+		"toggle reuse of recorded command buffers",
+		"Usage: cmdcache <on|off> : reuse command buffers while the drawn scene doesn't change, or re-record them every frame"
+	};
+
+	const CommandData COMMON_DATA_STATS = {
+		"print rendering statistics",
+		"Usage: stats : print statistics of the last drawn frame"
+	};
+
+	const CommandData COMMON_DATA_BENCHMARK = {
+		"measure BVH culling against a linear scan",
+		"Usage: benchmark [count] : cull <count> random objects, or 10k, 100k and 1M objects if no count is given"
+	};
+
+	const CommandData COMMON_DATA_OCCLUSION = {
+		"toggle CPU occlusion culling",
+		"Usage: occlusion <on|off> : skip objects hidden behind occluders, or draw everything inside the view"
+	};
+
+	const CommandData COMMON_DATA_OCCLUDER = {
+		"mark the default object as an occluder",
+		"Usage: occluder <on|off> : rasterize the default object on the CPU so objects behind it are culled, off by default"
+	};
+
+	const CommandData COMMON_DATA_HIZ = {
+		"toggle GPU occlusion culling against a depth pyramid",
+		"Usage: hiz <on|off> : test objects against last frame's depth on the GPU and draw them in two phases"
+	};
+
+	const CommandData COMMON_DATA_MESHLETS = {
+		"toggle GPU meshlet culling",
+		"Usage: meshlets <on|off> : cull clusters of triangles by frustum, facing and (with hiz on) depth, and draw only the visible ones"
+	};
+
+	const CommandData COMMON_DATA_MATERIAL = {
+		"change the material of the default object",
+		"Usage: material normalmap <on|off> : sample the normal map or use the surface normal\n"
+		"       material specular <none|phong|blinn> : pick the specular highlight model\n"
+		"       material alphatest <on|off> : discard fragments with a diffuse alpha below 0.5\n"
+		"Note: every new combination compiles a pipeline the first time it's drawn"
+	};
+
+	const CommandData COMMON_DATA_HOTRELOAD = {
+		"toggle shader hot reload",
+		"Usage: hotreload <on|off> : recompile shaders edited in data/shaders with compile_shaders.sh and swap in the rebuilt pipelines\n"
+		"Note: file changes are only noticed on Linux, set GENGINE_SHADER_COMPILER to use another compile command"
+	};
+
+	const CommandData COMMON_DATA_PREPASS = {
+		"toggle the depth pre-pass",
+		"Usage: prepass <on|off> : draw depth alone first and shade only the visible fragments, or shade every fragment that passes the depth test"
+	};
+
+	const CommandData COMMON_DATA_LIGHTS = {
+		"spawn local lights",
+		"Usage: lights <count> : replace the local lights with <count> random point and spot lights around the object\n"
+		"Note: lights are binned into clusters of the view, so each pixel only shades the few that reach it"
+	};
+
+	const CommandData COMMON_DATA_RESOLUTION = {
+		"control dynamic resolution",
+		"Usage: resolution <on|off> : render the scene at a lower scale of the window while the GPU runs over the target frame time, then upscale it\n"
+		"       resolution bounds <min> <max> : keep the scale along each axis between <min> and <max>, 0.5 and 1 by default\n"
+		"       resolution target <ms> : aim for a GPU frame time of <ms> milliseconds, 16.7 by default\n"
+		"Note: needs GPU timestamps, the \"stats\" command prints the measured frame time and scale"
+	};
+
+	const CommandData COMMON_DATA_LATENCY = {
+		"trade throughput for input latency",
+		"Usage: latency frames <1-3> : let the CPU record up to this many frames ahead of the GPU, 2 by default\n"
+		"       latency present <auto|fifo|mailbox|immediate> : pick how frames reach the display, auto prefers mailbox, then immediate\n"
+		"       latency limit <fps|off> : start frames no faster than <fps>, off by default\n"
+		"       latency lateinput <on|off> : read input after waiting for the GPU and the limiter, right before the frame is recorded\n"
+		"Note: data/config.txt can hold these (or any other commands), it is run at startup"
+	};
+
+	const CommandData COMMON_DATA_PICK = {
+		"print the object under a point on the screen",
+		"Usage: pick [x y] : pick at normalized device coordinates from -1 to 1, Y pointing down, the screen center if none are given"
+	};
+
+	const CommandData COMMON_DATA_QUERY = {
+		"print the objects near a point",
+		"Usage: query <x> <y> <z> <radius> : list the objects whose bounds intersect the sphere"
+	};
 
 	const Command COMMON_LIST[] = {
 		{ "exit", exit, COMMON_DATA_EXIT },
@@ -50,7 +151,22 @@ namespace Commands {
 		{ "help", commonHelp, COMMON_DATA_HELP},
 		{ "vulkan", vulkan, COMMON_DATA_VULKAN },
 		{ "speed", speed, COMMON_DATA_SPEED },
-		{ "load", load, COMMON_DATA_LOAD }
+		{ "load", load, COMMON_DATA_LOAD },
+		{ "cmdcache", commandCache, COMMON_DATA_CMDCACHE },
+		{ "stats", stats, COMMON_DATA_STATS },
+		{ "benchmark", benchmark, COMMON_DATA_BENCHMARK },
+		{ "occlusion", occlusion, COMMON_DATA_OCCLUSION },
+		{ "occluder", occluder, COMMON_DATA_OCCLUDER },
+		{ "hiz", hiZ, COMMON_DATA_HIZ },
+		{ "meshlets", meshlets, COMMON_DATA_MESHLETS },
+		{ "material", material, COMMON_DATA_MATERIAL },
+		{ "hotreload", hotReload, COMMON_DATA_HOTRELOAD },
+		{ "prepass", prePass, COMMON_DATA_PREPASS },
+		{ "lights", lights, COMMON_DATA_LIGHTS },
+		{ "resolution", resolution, COMMON_DATA_RESOLUTION },
+		{ "latency", latency, COMMON_DATA_LATENCY },
+		{ "pick", pick, COMMON_DATA_PICK },
+		{ "query", query, COMMON_DATA_QUERY }
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,50 @@
+#include "FileWatcher.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+FileWatcher::FileWatcher(const String &directory) {
+#ifdef __linux__
+	descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (descriptor < 0)
+		throw std::runtime_error("Failed to initialize inotify!");
+
+	// Editors and compilers either rewrite files in place or move finished ones over them
+	if (inotify_add_watch(descriptor, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		close(descriptor);
+		throw std::runtime_error("Failed to watch directory " + directory + "!");
+	}
+#endif
+}
+
+FileWatcher::~FileWatcher() {
+#ifdef __linux__
+	if (descriptor >= 0)
+		close(descriptor);
+#endif
+}
+
+std::vector<String> FileWatcher::poll() {
+	std::vector<String> names;
+#ifdef __linux__
+	alignas(inotify_event) char buffer[4096];
+	ssize_t length;
+	while ((length = read(descriptor, buffer, sizeof(buffer))) > 0) {
+		for (ssize_t offset = 0; offset < length;) {
+			const inotify_event *event = reinterpret_cast<const inotify_event *>(buffer + offset);
+			if (event->len > 0) {
+				String name(event->name);
+				if (std::find(names.begin(), names.end(), name) == names.end())
+					names.push_back(name);
+			}
+			offset += sizeof(inotify_event) + event->len;
+		}
+	}
+#endif
+	return names;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/*
+	Watches a directory for files that were written to.
+
+	Uses inotify on Linux, other platforms never report any changes for now.
+*/
+
+#include "String.h"
+
+#include <vector>
+
+class FileWatcher {
+public:
+	/// <throws> runtime_error if the directory can't be watched </throws>
+	FileWatcher(const String &directory);
+	~FileWatcher();
+
+	/// Names (without the directory) of the files finished writing or moved in since the last poll
+	/// Never blocks, each name is listed once even if the file changed several times
+	std::vector<String> poll();
+
+private:
+	int descriptor = -1;
+};
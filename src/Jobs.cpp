@@ -0,0 +1,120 @@
+#include "Jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+	std::vector<std::thread>			workers;
+	std::deque<std::function<void()>>	queue;
+	std::mutex							queueMutex;
+	std::condition_variable				queueCondition;
+	bool								running = false;
+
+	// State of a single parallelFor, shared with helpers that may start after all work is taken
+	struct ParallelForState {
+		std::atomic<size_t> nextBatch{ 0 };
+		std::atomic<size_t> finishedBatches{ 0 };
+		size_t batchCount;
+		size_t batchSize;
+		size_t count;
+	};
+
+	void workerLoop() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [] { return !running || !queue.empty(); });
+				if (queue.empty())
+					return;
+				job = std::move(queue.front());
+				queue.pop_front();
+			}
+			job();
+		}
+	}
+
+	void processBatches(ParallelForState &state, const Jobs::RangeFunction *function) {
+		for (size_t batch = state.nextBatch++; batch < state.batchCount; batch = state.nextBatch++) {
+			size_t begin = batch * state.batchSize;
+			(*function)(begin, std::min(begin + state.batchSize, state.count));
+			++state.finishedBatches;
+		}
+	}
+}
+
+void Jobs::initialize(unsigned int workerCount) {
+	if (running) return;
+
+	if (workerCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+
+	running = true;
+	for (unsigned int i = 0; i < workerCount; ++i)
+		workers.emplace_back(workerLoop);
+}
+
+void Jobs::terminate() {
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		running = false;
+	}
+	queueCondition.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+	workers.clear();
+}
+
+unsigned int Jobs::getThreadCount() {
+	return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void Jobs::submit(std::function<void()> &&job) {
+	if (workers.empty()) {
+		job();
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(queueMutex);
+		queue.push_back(std::move(job));
+	}
+	queueCondition.notify_one();
+}
+
+void Jobs::parallelFor(size_t count, size_t batchSize, const RangeFunction &function) {
+	if (count == 0) return;
+
+	batchSize = std::max<size_t>(batchSize, 1);
+	size_t batchCount = (count + batchSize - 1) / batchSize;
+
+	if (batchCount == 1 || workers.empty()) {
+		function(0, count);
+		return;
+	}
+
+	auto state = std::make_shared<ParallelForState>();
+	state->batchCount = batchCount;
+	state->batchSize = batchSize;
+	state->count = count;
+
+	// NOTE: helpers only touch the function while holding a batch, and we don't return before every batch is done
+	const RangeFunction *functionPointer = &function;
+	size_t helperCount = std::min<size_t>(workers.size(), batchCount - 1);
+	for (size_t i = 0; i < helperCount; ++i)
+		submit([state, functionPointer]() { processBatches(*state, functionPointer); });
+
+	processBatches(*state, functionPointer);
+
+	while (state->finishedBatches < batchCount)
+		std::this_thread::yield();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+/*
+	A small pool of worker threads.
+
+	Used to spread data-parallel work (like transform updates) across all cores.
+*/
+
+#include <cstddef>
+#include <functional>
+
+namespace Jobs {
+
+	typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+	/// Start the worker threads, 0 picks one less than the number of hardware threads
+	void initialize(unsigned int workerCount = 0);
+	/// Finish queued jobs and stop the worker threads
+	void terminate();
+
+	/// Number of threads that take part in parallelFor, including the calling thread
+	unsigned int getThreadCount();
+
+	/// Queue a job to be run on a worker thread at some point
+	/// Runs the job immediately if there are no workers
+	void submit(std::function<void()> &&job);
+
+	/// Split [0; count) into batches of batchSize and process them on all threads
+	/// The calling thread takes part and the function returns once every batch has been processed
+	void parallelFor(size_t count, size_t batchSize, const RangeFunction &function);
+}
@@ -2,7 +2,9 @@
 	Initialization vector for the executable.
 */
 
+#include "Benchmark.h"
 #include "CommonCommands.h"
+#include "Jobs.h"
 #include "Window.h"
 
 #define STB_IMAGE_IMPLEMENTATION
@@ -12,9 +14,15 @@
 #include <tiny_obj_loader.h>
 
 #include "graphics/Context.h"
+#include "graphics/MeshOptimizer.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <thread>
+#include <fstream>
 #include <iostream>
+#include <random>
 
 
 const int PHYSICAL_DEVICE_NAME_LENGTH = 20;
@@ -30,16 +38,27 @@ Graphics::Texture *normalMap = nullptr;
 Graphics::Scene *scene = nullptr;
 Graphics::Camera *camera = nullptr;
 
+// Kept here so the config file can set them before Vulkan is initialized
+uint32_t framesInFlight = 2;
+Graphics::Context::PresentMode presentMode = Graphics::Context::PRESENT_AUTO;
+float frameLimit = 0.0f;
+// Read by the main loop, written by console commands
+std::atomic<bool> lateInputSampling = { false };
+
 void initialize();
 void cleanup();
 void console();
 void loadDefaults();
+void loadConfig();
+void applyLatencySettings();
 void processInput(float deltaT);
+size_t objectIndex(const Graphics::Object *);
 
 
 const char * const MESH_FILE = "data/models/cube.obj";
 const char * const DIFFUSE_TEXTURE_FILE = "data/textures/bricks.jpg";
 const char * const NORMAL_MAP_FILE = "data/textures/bricks_norm.jpg";
+const char * const CONFIG_FILE = "data/config.txt";
 
 
 // Program starts here.
@@ -48,20 +67,31 @@ int main() {
 
 	window = new Window("GEngine");
 
+	loadConfig();
+
 	// Because of reasons (Windows and Mac IO message passing) we want the window to run on main thread.
 	// So I'll create a helper thread.
 	std::thread thread(console);
 
+	auto lastTime = std::chrono::high_resolution_clock::now();
+
 	while (!window->shouldClose() && alive) {
 		window->pollEvents();
-		
-		auto lastTime = std::chrono::high_resolution_clock::now();
 
 		if (graphics != nullptr && window->isVisible()) {
-			auto currentTime = std::chrono::high_resolution_clock::now();
+			// Waiting for the GPU before reading input keeps the input fresh when the frame is submitted
+			if (lateInputSampling) {
+				graphics->waitForFrame();
+				window->pollEvents();
+			}
+		}
 
-			float deltaT = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastTime).count();
+		// Seconds between the input reads of consecutive iterations, including the waits for the GPU and the limiter
+		auto currentTime = std::chrono::high_resolution_clock::now();
+		float deltaT = std::chrono::duration<float>(currentTime - lastTime).count();
+		lastTime = currentTime;
 
+		if (graphics != nullptr && window->isVisible()) {
 			processInput(deltaT);
 
 			graphics->draw(*scene);
@@ -84,19 +114,21 @@ void initialize() {
 		Commands::commonDict.addCommand(cmd.command, cmd.function, cmd.data);
 	}
 	Window::initialize();
+	Jobs::initialize();
 	std::cout << "Welcome to GEngine by Griffone." << std::endl;
 	std::cout << "Use \"list\" to list supported commands." << std::endl;
 }
 
 void cleanup() {
-	if (camera)
-		delete camera;
+	// Objects remove themselves from the scene, so they go first
+	if (object)
+		delete object;
 
 	if (scene)
 		delete scene;
 
-	if (object)
-		delete object;
+	if (camera)
+		delete camera;
 
 	if (mesh)
 		delete mesh;
@@ -115,6 +147,7 @@ void cleanup() {
 
 	Graphics::Context::terminate();
 	Window::terminate();
+	Jobs::terminate();
 }
 
 void console() {
@@ -128,6 +161,27 @@ void console() {
 	}
 }
 
+void loadConfig() {
+	std::ifstream file(CONFIG_FILE);
+	String line;
+	// Every line is a console command, lines starting with '#' are comments
+	while (std::getline(file, line)) {
+		StrUtil::trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+
+		String command = line;
+		if (!Commands::processCommand(command, Commands::commonDict))
+			std::cout << "Unknown command \"" << line << "\" in " << CONFIG_FILE << "!" << std::endl;
+	}
+}
+
+void applyLatencySettings() {
+	graphics->setFramesInFlight(framesInFlight);
+	graphics->setPresentMode(presentMode);
+	graphics->setFrameLimit(frameLimit);
+}
+
 void loadMesh() {
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
@@ -188,10 +242,34 @@ void loadMesh() {
 		glm::vec3 tangent = glm::normalize((deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y)*r);
 		glm::vec3 bitangent = glm::normalize((deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x)*r);
 
-		v2.tangent = v1.tangent = v0.tangent = tangent;
-		v2.bitangent = v1.bitangent = v0.bitangent = bitangent;
+		// Only the handedness of the bitangent is kept, mirrored UVs flip it
+		float handedness = glm::dot(glm::cross(v0.normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+		v2.tangent = v1.tangent = v0.tangent = glm::vec4(tangent, handedness);
 	}
 
+	// Triangles come in the order of the file, reorder them for the post-transform cache and overdraw
+	std::vector<glm::vec3> positions;
+	positions.reserve(vertices.size());
+	for (const auto &vertex : vertices)
+		positions.push_back(vertex.pos);
+
+	auto before = Graphics::MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+
+	std::vector<uint32_t> clusters;
+	Graphics::MeshOptimizer::optimizeVertexCache(indices, vertices.size(), clusters);
+	Graphics::MeshOptimizer::optimizeOverdraw(indices, positions, clusters);
+
+	// Lay the vertices out in the order they are first drawn
+	std::vector<uint32_t> order = Graphics::MeshOptimizer::optimizeVertexFetch(indices, vertices.size());
+	std::vector<Graphics::Vertex> ordered;
+	ordered.reserve(order.size());
+	for (auto index : order)
+		ordered.push_back(vertices[index]);
+	vertices.swap(ordered);
+
+	auto after = Graphics::MeshOptimizer::analyzeVertexCache(indices, vertices.size());
+	std::cout << "Mesh optimized: ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+
 	mesh = new Graphics::Mesh(*graphics, vertices, indices);
 }
 
@@ -213,12 +291,12 @@ void loadDefaults() {
 	normalMap = new Graphics::Texture(*graphics, width, height, pixels);
 
 
-	object = new Graphics::Object(*mesh, *texture, *normalMap);
-
 	camera = new Graphics::Camera({ 0.0f, 2.0f, -5.0f }, glm::vec3(0.0f), 45.0f);
 
-	scene = new Graphics::Scene(*camera, *object);
+	scene = new Graphics::Scene(*camera);
 	scene->lightPosition = { 1.1f, 1.1f, -1.1f };
+
+	object = new Graphics::Object(*scene, *mesh, *texture, *normalMap);
 }
 
 void processInput(float deltaT) {
@@ -258,6 +336,11 @@ void processInput(float deltaT) {
 		scene->lightPosition = camera->getPosition();
 }
 
+size_t objectIndex(const Graphics::Object *o) {
+	// Objects are only created by console commands, so the list doesn't change under us
+	return std::find(scene->objects.begin(), scene->objects.end(), o) - scene->objects.begin();
+}
+
 void Commands::exit(String &) {
 	alive = false;
 }
@@ -267,6 +350,7 @@ void Commands::vulkan(String &string) {
 		std::cout << "Initializing vulkan." << std::endl;
 		Graphics::Context::initialize();
 		graphics = new Graphics::Context(*window);
+		applyLatencySettings();
 		loadDefaults();
 	}
 
@@ -284,4 +368,302 @@ void Commands::speed(String &string) {
 
 void Commands::load(String &) {
 	std::cout << "Command is under development!" << std::endl;
-}
\ No newline at end of file
+}
+
+void Commands::commandCache(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setCommandBufferReuse(enabled);
+}
+
+void Commands::stats(String &) {
+	if (graphics == nullptr) {
+		std::cout << "Vulkan is not initialized!" << std::endl;
+		return;
+	}
+
+	auto statistics = graphics->getStatistics();
+	std::cout << "Visible objects: " << statistics.visibleObjects << std::endl;
+	std::cout << "Culled objects: " << statistics.culledObjects << std::endl;
+	std::cout << "Occluded objects: " << statistics.occludedObjects << std::endl;
+	std::cout << "Triangles: " << statistics.triangles << std::endl;
+	std::cout << "Pipeline binds: " << statistics.pipelineBinds << std::endl;
+	std::cout << "Fallback draws: " << statistics.fallbackDraws << std::endl;
+	std::cout << "Depth pre-pass draws: " << statistics.depthPrePassDraws << std::endl;
+	std::cout << "Mesh binds: " << statistics.meshBinds << std::endl;
+	std::cout << "Material binds: " << statistics.materialBinds << std::endl;
+	std::cout << "Lights: " << statistics.lights << std::endl;
+	std::cout << "GPU frame time: " << statistics.gpuFrameTime << " ms" << std::endl;
+	std::cout << "Resolution scale: " << statistics.resolutionScale << std::endl;
+	std::cout << "Frame passes: " << statistics.framePasses << " (" << statistics.culledFramePasses << " culled)" << std::endl;
+	std::cout << "Transient memory: " << statistics.transientMemory / 1024 << " KiB" << std::endl;
+}
+
+void Commands::benchmark(String &string) {
+	float count;
+	if (StrUtil::parseFloat(string, &count)) {
+		if (count < 1.0f) {
+			std::cout << "Please enter a positive object count!" << std::endl;
+			return;
+		}
+		Benchmark::culling(static_cast<size_t>(count));
+	} else {
+		for (size_t objectCount : { 10000, 100000, 1000000 })
+			Benchmark::culling(objectCount);
+	}
+}
+
+void Commands::occlusion(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setOcclusionCulling(enabled);
+}
+
+void Commands::occluder(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	object->setOccluder(enabled);
+}
+
+void Commands::hiZ(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setHiZCulling(enabled);
+}
+
+void Commands::meshlets(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setMeshletCulling(enabled);
+}
+
+void Commands::material(String &string) {
+	String feature = StrUtil::firstWord(string);
+	StrUtil::lower(feature);
+	StrUtil::trim(string);
+	StrUtil::lower(string);
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	Graphics::Material material = object->getMaterial();
+	bool enabled;
+	if (feature == "normalmap" && StrUtil::parseBool(string, &enabled))
+		material.normalMapping = enabled;
+	else if (feature == "alphatest" && StrUtil::parseBool(string, &enabled))
+		material.alphaTest = enabled;
+	else if (feature == "specular" && string == "none")
+		material.specularModel = Graphics::Material::SPECULAR_NONE;
+	else if (feature == "specular" && string == "phong")
+		material.specularModel = Graphics::Material::SPECULAR_PHONG;
+	else if (feature == "specular" && string == "blinn")
+		material.specularModel = Graphics::Material::SPECULAR_BLINN_PHONG;
+	else {
+		std::cout << "Please enter a feature and its value, see \"help material\"!" << std::endl;
+		return;
+	}
+
+	object->setMaterial(material);
+}
+
+void Commands::hotReload(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setShaderHotReload(enabled);
+}
+
+void Commands::prePass(String &string) {
+	bool enabled;
+	if (!StrUtil::parseBool(string, &enabled)) {
+		std::cout << "Please enter \"on\" or \"off\"!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	graphics->setDepthPrePass(enabled);
+}
+
+void Commands::lights(String &string) {
+	float count;
+	if (!StrUtil::parseFloat(string, &count) || count < 0.0f) {
+		std::cout << "Please enter a non-negative light count!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	// Same seed every time, so a light count always looks the same
+	std::mt19937 random(1);
+	std::uniform_real_distribution<float> position(-4.0f, 4.0f);
+	std::uniform_real_distribution<float> height(-1.0f, 3.0f);
+	std::uniform_real_distribution<float> color(0.2f, 1.0f);
+	std::uniform_real_distribution<float> range(0.5f, 2.5f);
+
+	std::vector<Graphics::Light> lights(static_cast<size_t>(count));
+	for (size_t i = 0; i < lights.size(); ++i) {
+		Graphics::Light &light = lights[i];
+		// Every fourth light is a spot light pointing down
+		light.type = i % 4 == 3 ? Graphics::Light::SPOT : Graphics::Light::POINT;
+		light.position = glm::vec3(position(random), height(random), position(random));
+		light.color = glm::vec3(color(random), color(random), color(random));
+		light.range = range(random);
+	}
+	// The render thread reads the lights, so they are swapped in at the start of its next frame
+	scene->setLights(std::move(lights));
+}
+
+void Commands::resolution(String &string) {
+	String first = StrUtil::firstWord(string);
+	StrUtil::lower(first);
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	bool enabled;
+	float minScale, maxScale, target;
+	if (StrUtil::parseBool(first, &enabled)) {
+		graphics->setDynamicResolution(enabled);
+	} else if (first == "bounds" && StrUtil::parseFloat(string, &minScale)) {
+		StrUtil::firstWord(string);
+		if (!StrUtil::parseFloat(string, &maxScale) || minScale <= 0.0f || maxScale < minScale) {
+			std::cout << "Please enter a minimum and a maximum scale, like \"bounds 0.5 1\"!" << std::endl;
+			return;
+		}
+		graphics->setDynamicResolutionBounds(minScale, maxScale);
+	} else if (first == "target" && StrUtil::parseFloat(string, &target) && target > 0.0f) {
+		graphics->setTargetFrameTime(target);
+	} else {
+		std::cout << "Please enter \"on\", \"off\", bounds or a target, see \"help resolution\"!" << std::endl;
+	}
+}
+
+void Commands::latency(String &string) {
+	String setting = StrUtil::firstWord(string);
+	StrUtil::lower(setting);
+	StrUtil::trim(string);
+	StrUtil::lower(string);
+
+	bool enabled;
+	float value;
+	if (setting == "frames" && StrUtil::parseFloat(string, &value) && value == std::floor(value)
+		&& value >= 1.0f && value <= Graphics::Context::MAX_FRAMES_IN_FLIGHT)
+		framesInFlight = static_cast<uint32_t>(value);
+	else if (setting == "present" && string == "auto")
+		presentMode = Graphics::Context::PRESENT_AUTO;
+	else if (setting == "present" && string == "fifo")
+		presentMode = Graphics::Context::PRESENT_FIFO;
+	else if (setting == "present" && string == "mailbox")
+		presentMode = Graphics::Context::PRESENT_MAILBOX;
+	else if (setting == "present" && string == "immediate")
+		presentMode = Graphics::Context::PRESENT_IMMEDIATE;
+	else if (setting == "limit" && StrUtil::parseBool(string, &enabled) && !enabled)
+		frameLimit = 0.0f;
+	else if (setting == "limit" && StrUtil::parseFloat(string, &value) && value > 0.0f)
+		frameLimit = value;
+	else if (setting == "lateinput" && StrUtil::parseBool(string, &enabled))
+		lateInputSampling = enabled;
+	else {
+		std::cout << "Please enter a setting and its value, see \"help latency\"!" << std::endl;
+		return;
+	}
+
+	// Unlike the other commands this doesn't initialize Vulkan, so the config file can set it up front
+	if (graphics != nullptr)
+		applyLatencySettings();
+}
+
+void Commands::pick(String &string) {
+	glm::vec2 point(0.0f);
+	StrUtil::trim(string);
+	if (!string.empty()) {
+		if (!StrUtil::parseFloat(string, &point.x)) {
+			std::cout << "Please enter a point, like \"pick 0.5 -0.5\"!" << std::endl;
+			return;
+		}
+		StrUtil::firstWord(string);
+		if (!StrUtil::parseFloat(string, &point.y)) {
+			std::cout << "Please enter a point, like \"pick 0.5 -0.5\"!" << std::endl;
+			return;
+		}
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	Graphics::Object *picked = scene->pick(point);
+	if (picked == nullptr)
+		std::cout << "Nothing under the point." << std::endl;
+	else
+		std::cout << "Picked object #" << objectIndex(picked) << std::endl;
+}
+
+void Commands::query(String &string) {
+	Graphics::BoundingSphere sphere;
+	float *values[] = { &sphere.center.x, &sphere.center.y, &sphere.center.z, &sphere.radius };
+	for (float *value : values) {
+		if (!StrUtil::parseFloat(string, value)) {
+			std::cout << "Please enter a point and a radius, like \"query 0 0 0 2\"!" << std::endl;
+			return;
+		}
+		StrUtil::firstWord(string);
+	}
+	if (sphere.radius < 0.0f) {
+		std::cout << "Please enter a non-negative radius!" << std::endl;
+		return;
+	}
+
+	if (graphics == nullptr)
+		vulkan(string);
+
+	std::vector<Graphics::Object *> found;
+	scene->query(sphere, found);
+	std::cout << "Found " << found.size() << " objects";
+	for (size_t i = 0; i < found.size(); ++i)
+		std::cout << (i == 0 ? ": #" : ", #") << objectIndex(found[i]);
+	std::cout << std::endl;
+}
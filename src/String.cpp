@@ -18,6 +18,24 @@ bool StrUtil::parseFloat(const String &string, float *outFloat) {
 	}
 }
 
+bool StrUtil::parseBool(const String &string, bool *outBool) {
+	String copy(string);
+	String word = firstWord(copy);
+	lower(word);
+
+	bool b;
+	if (word == "on" || word == "true" || word == "1")
+		b = true;
+	else if (word == "off" || word == "false" || word == "0")
+		b = false;
+	else
+		return false;
+
+	if (outBool != nullptr)
+		*outBool = b;
+	return true;
+}
+
 String & StrUtil::ltrim(String &string) {
 	string.erase(0, string.find_first_not_of(STRING_WHITESPACE));
 	return string;
@@ -26,6 +26,10 @@ namespace StrUtil {
 	/// Returns false if the function failed for any reason
 	bool parseFloat(const String &string, float *outFloat);
 
+	/// Attempt to parse a boolean ("on"/"off", "true"/"false", "1"/"0") from the beginning of a given string
+	/// Returns true if succesful as well as modifying the pointed to bool
+	bool parseBool(const String &string, bool *outBool);
+
 	/// Remove preceding or trailing whitespaces from a string
 	/// Note: modifies the provided string
 	String &ltrim(String &);
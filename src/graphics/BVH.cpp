@@ -0,0 +1,451 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Graphics;
+
+namespace {
+	// Smallest direction component that is inverted as is
+	constexpr float RAY_EPSILON = 1e-20f;
+
+	// Entry distance of the ray into the box, or a negative value if it misses within maxDistance
+	float intersectRay(const AABB &box, const glm::vec3 &origin, const glm::vec3 &inverseDirection, float maxDistance) {
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tMin = glm::min(t0, t1), tMax = glm::max(t0, t1);
+
+		float entry = std::max(std::max(tMin.x, tMin.y), std::max(tMin.z, 0.0f));
+		float exit = std::min(std::min(tMax.x, tMax.y), std::min(tMax.z, maxDistance));
+		return entry <= exit ? entry : -1.0f;
+	}
+}
+
+bool BVH::Node::isLeaf() const {
+	return left == INVALID_NODE;
+}
+
+BVH::BVH() {}
+
+void BVH::build(const std::vector<Item> &items, std::vector<NodeId> *outLeaves) {
+	clear();
+
+	std::vector<NodeId> leaves(items.size());
+	for (size_t i = 0; i < items.size(); ++i) {
+		NodeId leaf = allocateNode();
+		nodes[leaf].bounds = items[i].bounds;
+		nodes[leaf].item = items[i].id;
+		leaves[i] = leaf;
+	}
+	leafCount = items.size();
+
+	if (outLeaves != nullptr)
+		*outLeaves = leaves;
+
+	buildFromLeaves(leaves);
+}
+
+void BVH::rebuild() {
+	std::vector<NodeId> leaves;
+	leaves.reserve(leafCount);
+
+	std::vector<NodeId> stack;
+	if (root != INVALID_NODE)
+		stack.push_back(root);
+	while (!stack.empty()) {
+		NodeId node = stack.back();
+		stack.pop_back();
+
+		if (nodes[node].isLeaf()) {
+			leaves.push_back(node);
+		} else {
+			stack.push_back(nodes[node].left);
+			stack.push_back(nodes[node].right);
+			freeNode(node);
+		}
+	}
+
+	buildFromLeaves(leaves);
+}
+
+void BVH::clear() {
+	nodes.clear();
+	freeNodes.clear();
+	root = INVALID_NODE;
+	leafCount = 0;
+}
+
+BVH::NodeId BVH::insert(uint32_t id, const AABB &bounds) {
+	NodeId leaf = allocateNode();
+	nodes[leaf].bounds = bounds;
+	nodes[leaf].item = id;
+	++leafCount;
+
+	if (root == INVALID_NODE) {
+		root = leaf;
+		return leaf;
+	}
+
+	// Walk down while pairing with a child is cheaper than pairing with the node itself
+	NodeId sibling = root;
+	while (!nodes[sibling].isLeaf()) {
+		const Node &node = nodes[sibling];
+		float area = node.bounds.getHalfArea();
+		float combinedArea = AABB::merge(node.bounds, bounds).getHalfArea();
+
+		// A new parent here costs the combined area, and every ancestor grows as well
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - area);
+
+		auto childCost = [&](NodeId child) {
+			const AABB &childBounds = nodes[child].bounds;
+			float mergedArea = AABB::merge(childBounds, bounds).getHalfArea();
+			if (nodes[child].isLeaf())
+				return mergedArea + inheritedCost;
+			return mergedArea - childBounds.getHalfArea() + inheritedCost;
+		};
+		float leftCost = childCost(node.left);
+		float rightCost = childCost(node.right);
+
+		if (cost < leftCost && cost < rightCost)
+			break;
+		sibling = leftCost < rightCost ? node.left : node.right;
+	}
+
+	NodeId oldParent = nodes[sibling].parent;
+	NodeId newParent = allocateNode();
+	nodes[newParent].parent = oldParent;
+	nodes[newParent].bounds = AABB::merge(nodes[sibling].bounds, bounds);
+	nodes[newParent].left = sibling;
+	nodes[newParent].right = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+
+	if (oldParent == INVALID_NODE) {
+		root = newParent;
+	} else {
+		if (nodes[oldParent].left == sibling)
+			nodes[oldParent].left = newParent;
+		else
+			nodes[oldParent].right = newParent;
+		refit(oldParent);
+	}
+
+	return leaf;
+}
+
+void BVH::remove(NodeId leaf) {
+	--leafCount;
+
+	NodeId parent = nodes[leaf].parent;
+	freeNode(leaf);
+
+	if (parent == INVALID_NODE) {
+		root = INVALID_NODE;
+		return;
+	}
+
+	// The sibling takes the place of the parent
+	NodeId grandParent = nodes[parent].parent;
+	NodeId sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+	nodes[sibling].parent = grandParent;
+	freeNode(parent);
+
+	if (grandParent == INVALID_NODE) {
+		root = sibling;
+	} else {
+		if (nodes[grandParent].left == parent)
+			nodes[grandParent].left = sibling;
+		else
+			nodes[grandParent].right = sibling;
+		refit(grandParent);
+	}
+}
+
+void BVH::update(NodeId leaf, const AABB &bounds) {
+	nodes[leaf].bounds = bounds;
+	if (nodes[leaf].parent != INVALID_NODE)
+		refit(nodes[leaf].parent);
+}
+
+uint32_t BVH::getItem(NodeId leaf) const {
+	return nodes[leaf].item;
+}
+
+size_t BVH::size() const {
+	return leafCount;
+}
+
+void BVH::cull(const Frustum &frustum, std::vector<uint32_t> &outItems) const {
+	if (root == INVALID_NODE)
+		return;
+
+	std::vector<NodeId> stack;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		NodeId id = stack.back();
+		stack.pop_back();
+		const Node &node = nodes[id];
+
+		Frustum::Containment containment = frustum.classify(node.bounds);
+		if (containment == Frustum::OUTSIDE)
+			continue;
+
+		if (containment == Frustum::INSIDE) {
+			collectItems(id, outItems);
+		} else if (node.isLeaf()) {
+			outItems.push_back(node.item);
+		} else {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+	}
+}
+
+void BVH::query(const AABB &bounds, std::vector<uint32_t> &outItems) const {
+	if (root == INVALID_NODE)
+		return;
+
+	std::vector<NodeId> stack;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!node.bounds.intersects(bounds))
+			continue;
+
+		if (node.isLeaf()) {
+			outItems.push_back(node.item);
+		} else {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+	}
+}
+
+void BVH::query(const BoundingSphere &sphere, std::vector<uint32_t> &outItems) const {
+	if (root == INVALID_NODE)
+		return;
+
+	std::vector<NodeId> stack;
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!sphere.intersects(node.bounds))
+			continue;
+
+		if (node.isLeaf()) {
+			outItems.push_back(node.item);
+		} else {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+	}
+}
+
+bool BVH::raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, uint32_t &outItem, float &outDistance) const {
+	if (root == INVALID_NODE)
+		return false;
+
+	// Axis-parallel rays would give infinities, and 0 * inf is NaN for boxes touching the origin's plane
+	glm::vec3 inverseDirection;
+	for (int i = 0; i < 3; ++i)
+		inverseDirection[i] = 1.0f / (std::abs(direction[i]) > RAY_EPSILON ? direction[i] : std::copysign(RAY_EPSILON, direction[i]));
+	float closest = maxDistance;
+	bool hit = false;
+
+	std::vector<std::pair<NodeId, float>> stack;
+	float rootDistance = intersectRay(nodes[root].bounds, origin, inverseDirection, closest);
+	if (rootDistance >= 0.0f)
+		stack.push_back({ root, rootDistance });
+
+	while (!stack.empty()) {
+		auto entry = stack.back();
+		stack.pop_back();
+
+		// Something closer was found after this node was queued
+		if (entry.second > closest)
+			continue;
+
+		const Node &node = nodes[entry.first];
+		if (node.isLeaf()) {
+			closest = entry.second;
+			outItem = node.item;
+			hit = true;
+			continue;
+		}
+
+		float leftDistance = intersectRay(nodes[node.left].bounds, origin, inverseDirection, closest);
+		float rightDistance = intersectRay(nodes[node.right].bounds, origin, inverseDirection, closest);
+
+		// The nearer child goes on top, so it is visited first
+		std::pair<NodeId, float> nearer = { node.left, leftDistance }, farther = { node.right, rightDistance };
+		if (rightDistance >= 0.0f && (leftDistance < 0.0f || rightDistance < leftDistance))
+			std::swap(nearer, farther);
+
+		if (farther.second >= 0.0f)
+			stack.push_back(farther);
+		if (nearer.second >= 0.0f)
+			stack.push_back(nearer);
+	}
+
+	if (hit)
+		outDistance = closest;
+	return hit;
+}
+
+BVH::NodeId BVH::allocateNode() {
+	if (!freeNodes.empty()) {
+		NodeId id = freeNodes.back();
+		freeNodes.pop_back();
+		nodes[id] = Node();
+		return id;
+	}
+
+	nodes.push_back(Node());
+	return static_cast<NodeId>(nodes.size() - 1);
+}
+
+void BVH::freeNode(NodeId id) {
+	freeNodes.push_back(id);
+}
+
+void BVH::buildFromLeaves(std::vector<NodeId> &leaves) {
+	root = INVALID_NODE;
+	if (leaves.empty())
+		return;
+
+	struct Task {
+		size_t begin, end;
+		NodeId parent;
+		bool isLeft;
+	};
+
+	// Parents are created before their children, so bounds can be computed in reverse afterwards
+	std::vector<NodeId> internalNodes;
+	internalNodes.reserve(leaves.size());
+
+	std::vector<Task> tasks;
+	tasks.push_back({ 0, leaves.size(), INVALID_NODE, false });
+	while (!tasks.empty()) {
+		Task task = tasks.back();
+		tasks.pop_back();
+
+		NodeId id;
+		if (task.end - task.begin == 1) {
+			id = leaves[task.begin];
+		} else {
+			AABB centroidBounds;
+			centroidBounds.min = centroidBounds.max = nodes[leaves[task.begin]].bounds.getCenter();
+			for (size_t i = task.begin + 1; i < task.end; ++i) {
+				glm::vec3 centroid = nodes[leaves[i]].bounds.getCenter();
+				centroidBounds.min = glm::min(centroidBounds.min, centroid);
+				centroidBounds.max = glm::max(centroidBounds.max, centroid);
+			}
+
+			glm::vec3 size = centroidBounds.max - centroidBounds.min;
+			int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+
+			size_t middle = task.begin;
+			if (size[axis] > 0.0f) {
+				float binScale = SAH_BINS / size[axis];
+				auto binOf = [&](NodeId leaf) {
+					float offset = nodes[leaf].bounds.getCenter()[axis] - centroidBounds.min[axis];
+					return std::min(static_cast<size_t>(offset * binScale), SAH_BINS - 1);
+				};
+
+				size_t binCounts[SAH_BINS] = {};
+				AABB binBounds[SAH_BINS];
+				for (size_t i = task.begin; i < task.end; ++i) {
+					size_t bin = binOf(leaves[i]);
+					binBounds[bin] = binCounts[bin] == 0 ? nodes[leaves[i]].bounds : AABB::merge(binBounds[bin], nodes[leaves[i]].bounds);
+					++binCounts[bin];
+				}
+
+				// Cost of everything right of a split, swept from the right end
+				float rightCosts[SAH_BINS] = {};
+				AABB accumulated;
+				size_t accumulatedCount = 0;
+				for (size_t bin = SAH_BINS - 1; bin > 0; --bin) {
+					if (binCounts[bin] > 0) {
+						accumulated = accumulatedCount == 0 ? binBounds[bin] : AABB::merge(accumulated, binBounds[bin]);
+						accumulatedCount += binCounts[bin];
+					}
+					rightCosts[bin] = accumulatedCount * (accumulatedCount > 0 ? accumulated.getHalfArea() : 0.0f);
+				}
+
+				size_t bestSplit = 1;
+				float bestCost = std::numeric_limits<float>::max();
+				accumulatedCount = 0;
+				for (size_t split = 1; split < SAH_BINS; ++split) {
+					size_t bin = split - 1;
+					if (binCounts[bin] > 0) {
+						accumulated = accumulatedCount == 0 ? binBounds[bin] : AABB::merge(accumulated, binBounds[bin]);
+						accumulatedCount += binCounts[bin];
+					}
+					float cost = accumulatedCount * (accumulatedCount > 0 ? accumulated.getHalfArea() : 0.0f) + rightCosts[split];
+					if (cost < bestCost) {
+						bestCost = cost;
+						bestSplit = split;
+					}
+				}
+
+				middle = std::partition(leaves.begin() + task.begin, leaves.begin() + task.end, [&](NodeId leaf) {
+					return binOf(leaf) < bestSplit;
+				}) - leaves.begin();
+			}
+
+			// All centroids landed on one side, any split is as good as another
+			if (middle == task.begin || middle == task.end)
+				middle = (task.begin + task.end) / 2;
+
+			id = allocateNode();
+			internalNodes.push_back(id);
+
+			tasks.push_back({ middle, task.end, id, false });
+			tasks.push_back({ task.begin, middle, id, true });
+		}
+
+		nodes[id].parent = task.parent;
+		if (task.parent == INVALID_NODE)
+			root = id;
+		else if (task.isLeft)
+			nodes[task.parent].left = id;
+		else
+			nodes[task.parent].right = id;
+	}
+
+	for (auto it = internalNodes.rbegin(); it != internalNodes.rend(); ++it)
+		nodes[*it].bounds = AABB::merge(nodes[nodes[*it].left].bounds, nodes[nodes[*it].right].bounds);
+}
+
+void BVH::refit(NodeId id) {
+	while (id != INVALID_NODE) {
+		AABB bounds = AABB::merge(nodes[nodes[id].left].bounds, nodes[nodes[id].right].bounds);
+		if (bounds == nodes[id].bounds)
+			break;
+
+		nodes[id].bounds = bounds;
+		id = nodes[id].parent;
+	}
+}
+
+void BVH::collectItems(NodeId id, std::vector<uint32_t> &outItems) const {
+	std::vector<NodeId> stack;
+	stack.push_back(id);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (node.isLeaf()) {
+			outItems.push_back(node.item);
+		} else {
+			stack.push_back(node.right);
+			stack.push_back(node.left);
+		}
+	}
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "Bounds.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		Dynamic bounding volume hierarchy over axis-aligned boxes.
+
+		Every leaf holds a single item id. The tree can be built at once with a binned SAH split,
+		or grown and shrunk one item at a time, while moving items only refit their ancestors.
+	*/
+	class BVH {
+	public:
+		typedef uint32_t NodeId;
+		static constexpr NodeId INVALID_NODE = UINT32_MAX;
+
+		struct Item {
+			uint32_t id;
+			AABB bounds;
+		};
+
+		BVH();
+
+		/// Replace the contents with a top-down SAH build over the items
+		/// outLeaves, if given, receives the leaf of every item in the same order
+		void build(const std::vector<Item> &items, std::vector<NodeId> *outLeaves = nullptr);
+		/// Rebuild the current contents with SAH, restoring the quality lost to refits
+		/// Leaf ids stay valid
+		void rebuild();
+		void clear();
+
+		/// Add an item next to the sibling that increases the tree's surface area the least
+		NodeId insert(uint32_t id, const AABB &);
+		void remove(NodeId leaf);
+		/// Change the bounds of a leaf and refit its ancestors
+		void update(NodeId leaf, const AABB &);
+
+		uint32_t getItem(NodeId leaf) const;
+		size_t size() const;
+
+		/// Items whose bounds intersect the frustum, subtrees fully inside are taken without further tests
+		void cull(const Frustum &, std::vector<uint32_t> &outItems) const;
+		/// Items whose bounds intersect the box
+		void query(const AABB &, std::vector<uint32_t> &outItems) const;
+		/// Items whose bounds intersect the sphere
+		void query(const BoundingSphere &, std::vector<uint32_t> &outItems) const;
+		/// Closest item whose bounds the ray hits within maxDistance
+		/// Returns false if nothing was hit
+		bool raycast(const glm::vec3 &origin, const glm::vec3 &direction, float maxDistance, uint32_t &outItem, float &outDistance) const;
+
+	private:
+		// Centroid bins evaluated per split
+		static constexpr size_t SAH_BINS = 16;
+
+		struct Node {
+			AABB bounds;
+			NodeId parent = INVALID_NODE;
+			NodeId left = INVALID_NODE, right = INVALID_NODE;
+			uint32_t item = 0;
+
+			bool isLeaf() const;
+		};
+
+		std::vector<Node> nodes;
+		std::vector<NodeId> freeNodes;
+		NodeId root = INVALID_NODE;
+		size_t leafCount = 0;
+
+		NodeId allocateNode();
+		void freeNode(NodeId);
+
+		/// Build over existing leaves, which are kept and only get new parents
+		void buildFromLeaves(std::vector<NodeId> &leaves);
+		/// Recompute bounds from the node up to the root, stopping once nothing changes
+		void refit(NodeId);
+		void collectItems(NodeId, std::vector<uint32_t> &outItems) const;
+	};
+}
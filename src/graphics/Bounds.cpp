@@ -0,0 +1,152 @@
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+using namespace Graphics;
+
+glm::vec3 AABB::getCenter() const {
+	return (min + max) * 0.5f;
+}
+
+glm::vec3 AABB::getExtent() const {
+	return (max - min) * 0.5f;
+}
+
+float AABB::getHalfArea() const {
+	glm::vec3 size = max - min;
+	return size.x * size.y + size.y * size.z + size.z * size.x;
+}
+
+bool AABB::intersects(const AABB &other) const {
+	return min.x <= other.max.x && max.x >= other.min.x
+		&& min.y <= other.max.y && max.y >= other.min.y
+		&& min.z <= other.max.z && max.z >= other.min.z;
+}
+
+bool AABB::operator==(const AABB &other) const {
+	return min == other.min && max == other.max;
+}
+
+AABB AABB::merge(const AABB &a, const AABB &b) {
+	AABB result;
+	result.min = glm::min(a.min, b.min);
+	result.max = glm::max(a.max, b.max);
+	return result;
+}
+
+AABB AABB::fromSphere(const BoundingSphere &sphere) {
+	AABB result;
+	result.min = sphere.center - glm::vec3(sphere.radius);
+	result.max = sphere.center + glm::vec3(sphere.radius);
+	return result;
+}
+
+bool BoundingSphere::intersects(const AABB &box) const {
+	glm::vec3 offset = glm::clamp(center, box.min, box.max) - center;
+	return glm::dot(offset, offset) <= radius * radius;
+}
+
+Frustum Frustum::fromMatrix(const glm::mat4 &m) {
+	// Gribb-Hartmann, with the rows of the column-major matrix
+	glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	Frustum frustum;
+	frustum.planes[PLANE_LEFT] = row3 + row0;
+	frustum.planes[PLANE_RIGHT] = row3 - row0;
+	frustum.planes[PLANE_BOTTOM] = row3 + row1;
+	frustum.planes[PLANE_TOP] = row3 - row1;
+	// Clip depth is [0, 1], so near is just the third row
+	frustum.planes[PLANE_NEAR] = row2;
+	frustum.planes[PLANE_FAR] = row3 - row2;
+
+	for (auto &plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+
+	return frustum;
+}
+
+bool Frustum::intersects(const BoundingSphere &sphere) const {
+	for (const auto &plane : planes)
+		if (glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius)
+			return false;
+	return true;
+}
+
+Frustum::Containment Frustum::classify(const AABB &box) const {
+	glm::vec3 center = box.getCenter(), extent = box.getExtent();
+
+	Containment result = INSIDE;
+	for (const auto &plane : planes) {
+		glm::vec3 normal(plane);
+		float distance = glm::dot(normal, center) + plane.w;
+		// Distance from the center to the corner furthest along the normal
+		float reach = glm::dot(glm::abs(normal), extent);
+
+		if (distance < -reach)
+			return OUTSIDE;
+		if (distance < reach)
+			result = INTERSECTING;
+	}
+	return result;
+}
+
+void Frustum::intersects(const float *x, const float *y, const float *z, const float *radius, size_t count, uint8_t *visible) const {
+	__m128 planeX[PLANE_COUNT], planeY[PLANE_COUNT], planeZ[PLANE_COUNT], planeW[PLANE_COUNT];
+	for (size_t i = 0; i < PLANE_COUNT; ++i) {
+		planeX[i] = _mm_set1_ps(planes[i].x);
+		planeY[i] = _mm_set1_ps(planes[i].y);
+		planeZ[i] = _mm_set1_ps(planes[i].z);
+		planeW[i] = _mm_set1_ps(planes[i].w);
+	}
+
+	for (size_t first = 0; first < count; first += 4) {
+		__m128 sx = _mm_loadu_ps(x + first);
+		__m128 sy = _mm_loadu_ps(y + first);
+		__m128 sz = _mm_loadu_ps(z + first);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + first));
+
+		// A sphere is outside if it is fully behind any of the planes
+		__m128 outside = _mm_setzero_ps();
+		for (size_t i = 0; i < PLANE_COUNT; ++i) {
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(sx, planeX[i]), _mm_mul_ps(sy, planeY[i])),
+				_mm_add_ps(_mm_mul_ps(sz, planeZ[i]), planeW[i]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(outside);
+		for (size_t i = 0; i < 4; ++i)
+			visible[first + i] = (mask & (1 << i)) ? 0 : 1;
+	}
+}
+
+void Graphics::computeBounds(const glm::vec3 *points, size_t count, size_t stride, AABB &outBox, BoundingSphere &outSphere) {
+	auto point = [points, stride](size_t i) -> const glm::vec3 & {
+		return *reinterpret_cast<const glm::vec3 *>(reinterpret_cast<const char *>(points) + i * stride);
+	};
+
+	outBox = AABB();
+	outSphere = BoundingSphere();
+	if (count == 0)
+		return;
+
+	outBox.min = outBox.max = point(0);
+	for (size_t i = 1; i < count; ++i) {
+		outBox.min = glm::min(outBox.min, point(i));
+		outBox.max = glm::max(outBox.max, point(i));
+	}
+
+	outSphere.center = outBox.getCenter();
+	float radiusSquared = 0.0f;
+	for (size_t i = 0; i < count; ++i) {
+		glm::vec3 offset = point(i) - outSphere.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	outSphere.radius = std::sqrt(radiusSquared);
+}
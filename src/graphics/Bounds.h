@@ -0,0 +1,56 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+	struct BoundingSphere;
+
+	struct AABB {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+
+		glm::vec3 getCenter() const;
+		glm::vec3 getExtent() const;
+		/// Half of the surface area, enough to compare SAH costs
+		float getHalfArea() const;
+
+		bool intersects(const AABB &) const;
+		bool operator==(const AABB &) const;
+
+		static AABB merge(const AABB &, const AABB &);
+		static AABB fromSphere(const BoundingSphere &);
+	};
+
+	struct BoundingSphere {
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
+
+		bool intersects(const AABB &) const;
+	};
+
+	/*
+		View frustum as 6 inward-facing planes (xyz - normal, w - distance)
+	*/
+	struct Frustum {
+		enum Plane { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, PLANE_COUNT };
+		enum Containment { OUTSIDE, INTERSECTING, INSIDE };
+
+		glm::vec4 planes[PLANE_COUNT];
+
+		/// Extract the planes from a projection-view matrix with [0, 1] clip depth
+		static Frustum fromMatrix(const glm::mat4 &projectionView);
+
+		bool intersects(const BoundingSphere &) const;
+		Containment classify(const AABB &) const;
+
+		/// Test spheres stored as separate coordinate arrays, 4 at a time
+		/// count has to be a multiple of 4, visible[i] is set to 1 if the sphere is at least partially inside
+		void intersects(const float *x, const float *y, const float *z, const float *radius, size_t count, uint8_t *visible) const;
+	};
+
+	/// Smallest box around the points and a sphere around the box center that fits them all
+	void computeBounds(const glm::vec3 *points, size_t count, size_t stride, AABB &outBox, BoundingSphere &outSphere);
+}
@@ -31,18 +31,38 @@ void Graphics::Camera::setFOV(float _fov) {
 	pvIsCorrect = false;
 }
 
+glm::mat4 Graphics::Camera::getProjectionMatrix() const {
+	return glm::perspective(glm::radians(fov), aspectRatio, NEAR_PLANE, FAR_PLANE);
+}
+
 glm::mat4 Graphics::Camera::getProjectionViewMatrix() {
 	if (!pvIsCorrect) {
 		if (!viewIsCorrect) {
 			viewMatrix = glm::lookAt(position, target, { 0.0f, 1.0f, 0.0f });
 			viewIsCorrect = true;
 		}
-		pvMatrix = glm::perspective(glm::radians(fov), aspectRatio, 0.1f, 100.0f) * viewMatrix;
+		pvMatrix = getProjectionMatrix() * viewMatrix;
 		pvIsCorrect = true;
 	}
 	return pvMatrix;
 }
 
+void Graphics::Camera::getRay(const glm::vec2 &point, glm::vec3 &outOrigin, glm::vec3 &outDirection) {
+	getRay(getProjectionViewMatrix(), point, outOrigin, outDirection);
+}
+
+void Graphics::Camera::getRay(const glm::mat4 &projectionView, const glm::vec2 &point, glm::vec3 &outOrigin, glm::vec3 &outDirection) {
+	glm::mat4 inverse = glm::inverse(projectionView);
+
+	// The vertex shaders flip Y after the projection, so device Y points down and clip Y up
+	// Clip depth is [0, 1]
+	glm::vec4 nearPoint = inverse * glm::vec4(point.x, -point.y, 0.0f, 1.0f);
+	glm::vec4 farPoint = inverse * glm::vec4(point.x, -point.y, 1.0f, 1.0f);
+
+	outOrigin = glm::vec3(nearPoint) / nearPoint.w;
+	outDirection = glm::vec3(farPoint) / farPoint.w - outOrigin;
+}
+
 glm::mat4 Graphics::Camera::getViewMatrix() {
 	if (!viewIsCorrect) {
 		viewMatrix = glm::lookAt(position, target, { 0.0f, 1.0f, 0.0f });
@@ -64,3 +84,7 @@ glm::vec3 Graphics::Camera::getPosition() const {
 	return position;
 }
 
+float Graphics::Camera::getFOV() const {
+	return fov;
+}
+
@@ -18,10 +18,21 @@ namespace Graphics {
 		// Get unnormalized look-vector of the camera
 		glm::vec3 getLookVector() const;
 		glm::vec3 getPosition() const;
+		/// Vertical field of view in degrees
+		float getFOV() const;
 
+		glm::mat4 getProjectionMatrix() const;
 		glm::mat4 getProjectionViewMatrix();
+		/// Ray through a point in normalized device coordinates, from the near to the far plane
+		/// The direction is not normalized, its length is the distance between the planes
+		void getRay(const glm::vec2 &point, glm::vec3 &outOrigin, glm::vec3 &outDirection);
+		/// Same as above for a given projection view matrix, like one copied for another thread
+		static void getRay(const glm::mat4 &projectionView, const glm::vec2 &point, glm::vec3 &outOrigin, glm::vec3 &outDirection);
 		glm::mat4 getViewMatrix();
 
+		static constexpr float NEAR_PLANE = 0.1f;
+		static constexpr float FAR_PLANE = 100.0f;
+
 	private:
 		bool pvIsCorrect = false;
 		bool viewIsCorrect = false;
@@ -1,14 +1,36 @@
 #include "Context.h"
 
+#include "../Jobs.h"
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <cstdlib>
+#include <filesystem>
+#include <thread>
+
 using namespace Graphics;
 
 const char * const SHADER_VERT_NAME = "data/shaders/basic_vert.spv";
 const char * const SHADER_FRAG_NAME = "data/shaders/basic_frag.spv";
+const char * const SHADER_BINDLESS_FRAG_NAME = "data/shaders/bindless_frag.spv";
+const char * const SHADER_DEPTH_VERT_NAME = "data/shaders/depth_vert.spv";
+const char * const SHADER_DEPTH_REDUCE_NAME = "data/shaders/depth_reduce_comp.spv";
+const char * const SHADER_CULL_NAME = "data/shaders/cull_comp.spv";
+const char * const SHADER_MESHLET_CULL_NAME = "data/shaders/meshlet_cull_comp.spv";
+const char * const SHADER_LIGHT_CULL_NAME = "data/shaders/light_cull_comp.spv";
+const char * const SHADER_UPSCALE_VERT_NAME = "data/shaders/upscale_vert.spv";
+const char * const SHADER_UPSCALE_FRAG_NAME = "data/shaders/upscale_frag.spv";
+const char * const SHADER_DIRECTORY = "data/shaders";
+// Takes the names of the changed sources, see the script for details
+// Relative to the working directory, like the data directory and every path above
+const char * const SHADER_COMPILE_SCRIPT = "./compile_shaders.sh";
+// Replaces the script when set, for a compiler somewhere else
+const char * const SHADER_COMPILE_COMMAND_VARIABLE = "GENGINE_SHADER_COMPILER";
+// Smallest maxComputeWorkGroupCount the spec allows
+const uint32_t MAX_DISPATCH_GROUPS = 65535;
 
 #ifdef NDEBUG
 const bool Context::Context::VALIDATION_LAYERS_ENABLED = false;
@@ -20,6 +42,8 @@ bool Context::initialized = false;
 
 VkInstance Context::instance;
 VkDebugUtilsMessengerEXT Context::callback;
+PFN_vkGetPhysicalDeviceFeatures2 Context::getPhysicalDeviceFeatures2 = nullptr;
+PFN_vkGetPhysicalDeviceProperties2 Context::getPhysicalDeviceProperties2 = nullptr;
 
 const std::vector<const char *> Context::VALIDATION_LAYERS = {
 		"VK_LAYER_LUNARG_standard_validation"
@@ -29,6 +53,15 @@ const std::vector<const char *> Context::DEVICE_EXTENSIONS = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
 };
 
+const std::vector<const char *> Context::BINDLESS_DEVICE_EXTENSIONS = {
+	VK_KHR_MAINTENANCE3_EXTENSION_NAME,
+	VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME
+};
+
+const std::vector<const char *> Context::TIMELINE_DEVICE_EXTENSIONS = {
+	VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME
+};
+
 const char * const Context::APP_NAME = "Demo";
 const char * const Context::ENGINE_NAME = "GEngine";
 const uint32_t Context::APP_VERSION = VK_MAKE_VERSION(0, 0, 0);
@@ -40,18 +73,28 @@ Context::Context(Window &window) : window(window) {
 	createLogicalDevice();
 
 	createCommandPool();
+	createPipelineCache();
 
 	createSwapchain();
 	createImageViews();
 	createDepthResources();
 	createRenderPass();
 	createDescriptorSetLayout();
-	createGraphicsPipeline();
-	createFramebuffers();
+	createBindlessResources();
+	createShaderModules();
+	createPipelineLayout();
+	createFallbackPipeline();
+	createDepthPrePassPipeline();
+	createTimestampQueries();
+	createUpscalePipelineLayout();
+	if (dynamicResolutionSupported)
+		createUpscalePipeline(upscalePipeline);
 
 	createUniformBuffers();
-	createDescriptorPool();
-	allocateDescriptorSets();
+	createLightCullPipeline();
+	createLightResources();
+	createHiZPipelines();
+	createHiZResources();
 	allocateCommandBuffers();
 	createSyncObjects();
 }
@@ -61,7 +104,16 @@ Context::~Context() {
 }
 
 void Context::draw(Scene &scene) {
-	vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
+	// CPU-side scene work overlaps with the GPU finishing older frames
+	scene.update();
+
+	waitForFrame();
+	frameWaited = false;
+
+	flushDeletionQueue();
+
+	if (swapchainPresentMode != presentModeSetting)
+		recreateSwapchain();
 
 	uint32_t imageIndex;
 	VkResult result = vkAcquireNextImageKHR(device, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
@@ -72,9 +124,66 @@ void Context::draw(Scene &scene) {
 	} else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
 		throw std::runtime_error("Failed to acquire swap chain image!");
 
+	// The image may still be rendered by an older frame that used a different frame slot
+	timeline->wait(imageValues[imageIndex]);
+
+	updateDynamicResolution(imageIndex);
 	updateUniformBuffer(imageIndex, scene);
-	updateDescriptorSet(descriptorSets[imageIndex], imageIndex, scene.object);
-	recordCommandBuffer(commandBuffers[imageIndex], imageIndex, scene);
+
+	// Draws switch from the fallback pipeline as soon as their own is ready, which re-records the buffer
+	reloadChangedShaders();
+	collectCompiledPipelines();
+
+	// Uniform changes don't need a new command buffer, only a changed draw list does
+	depthPrePassActive = depthPrePassEnabled;
+	buildDrawList(imageIndex, scene);
+	updateLightBuffer(imageIndex, scene);
+	statistics.gpuFrameTime = gpuFrameTime;
+	statistics.resolutionScale = static_cast<float>(renderExtent.width) / swapchainExtent.width;
+
+	// Whatever is in the depth image wasn't drawn with Hi-Z after switching it
+	if (hiZCullingActive != (hiZCullingEnabled && hiZSupported)) {
+		hiZCullingActive = !hiZCullingActive;
+		hiZHistoryValid = false;
+	}
+	meshletCullingActive = meshletCullingEnabled && hiZSupported;
+	if (hiZCullingActive || meshletCullingActive)
+		updateCullBuffers(imageIndex, scene);
+
+	// Switching features changes the passes of the frame, which is rare enough to wait for the GPU
+	if (frameGraph == nullptr || frameGraphHiZ != hiZCullingActive || frameGraphMeshlets != meshletCullingActive || frameGraphUpscale != dynamicResolutionActive) {
+		if (frameGraph != nullptr) {
+			timeline->wait(lastFrameValue);
+			delete frameGraph;
+		}
+		buildFrameGraph();
+		invalidateCommandBuffers();
+	}
+	statistics.framePasses = frameGraph->getPassCount();
+	statistics.culledFramePasses = frameGraph->getCulledPassCount();
+	statistics.transientMemory = frameGraph->getTransientMemorySize();
+
+	// The statistics are rebuilt during the frame, other threads only see whole frames
+	{
+		std::lock_guard<std::mutex> lock(statisticsMutex);
+		publishedStatistics = statistics;
+	}
+
+	RecordedCommandBuffer &recorded = recordedCommandBuffers[imageIndex];
+	if (!commandBufferReuseEnabled || !recorded.valid || recorded.drawList != drawList
+		|| recorded.hiZCulling != hiZCullingActive || recorded.hiZHistory != hiZHistoryValid
+		|| recorded.meshletCulling != meshletCullingActive || recorded.dynamicResolution != dynamicResolutionActive
+		|| recorded.renderExtent.width != renderExtent.width || recorded.renderExtent.height != renderExtent.height) {
+
+		recordCommandBuffer(commandBuffers[imageIndex], imageIndex);
+		recorded.drawList = drawList;
+		recorded.hiZCulling = hiZCullingActive;
+		recorded.hiZHistory = hiZHistoryValid;
+		recorded.meshletCulling = meshletCullingActive;
+		recorded.dynamicResolution = dynamicResolutionActive;
+		recorded.renderExtent = renderExtent;
+		recorded.valid = true;
+	}
 
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -91,10 +200,24 @@ void Context::draw(Scene &scene) {
 	submitInfo.signalSemaphoreCount = 1;
 	submitInfo.pSignalSemaphores = signalSemaphores;
 
-	vkResetFences(device, 1, &inFlightFences[currentFrame]);
+	// Uploads of meshes and textures the frame draws may still be running, so it waits for the last one
+	uint64_t value = timeline->submit(graphicsQueue, submitInfo, uploadValue);
+	frameValues[currentFrame] = value;
+	imageValues[imageIndex] = value;
+	lastFrameValue = value;
+
+	{
+		std::lock_guard<std::mutex> lock(deletionMutex);
+		for (auto &destroy : pendingDestructions)
+			deletionQueue.push_back({ value, std::move(destroy) });
+		pendingDestructions.clear();
+	}
+
+	if (dynamicResolutionSupported)
+		timestampsWritten[imageIndex] = true;
 
-	if (vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
-		throw std::runtime_error("Failed to submit draw command buffer!");
+	// The next frame's first phase can test against the depth this one leaves behind
+	hiZHistoryValid = hiZCullingActive;
 
 	VkPresentInfoKHR presentInfo = {};
 	presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
@@ -108,14 +231,111 @@ void Context::draw(Scene &scene) {
 	presentInfo.pImageIndices = &imageIndex;
 	presentInfo.pResults = nullptr; // Optional
 
-	result = vkQueuePresentKHR(presentQueue, &presentInfo);
+	result = timeline->present(presentQueue, presentInfo);
 
 	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
 		recreateSwapchain();
 	} else if (result != VK_SUCCESS)
 		throw std::runtime_error("failed to present swap chain image!");
 
-	currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+	currentFrame = (currentFrame + 1) % framesInFlight;
+}
+
+void Context::waitForFrame() {
+	if (frameWaited)
+		return;
+
+	// Slots are waited on in a different order with another count, so let every frame retire first
+	uint32_t framesSetting = framesInFlightSetting;
+	if (framesInFlight != framesSetting) {
+		timeline->wait(lastFrameValue);
+		framesInFlight = framesSetting;
+		currentFrame = 0;
+	}
+
+	timeline->wait(frameValues[currentFrame]);
+
+	float limit = frameLimit;
+	if (limit > 0.0f) {
+		// Sleeping overshoots by up to a scheduler tick, so wake up early and spin for the rest
+		const auto spin = std::chrono::milliseconds(1);
+		if (std::chrono::steady_clock::now() + spin < nextFrameTime)
+			std::this_thread::sleep_until(nextFrameTime - spin);
+		while (std::chrono::steady_clock::now() < nextFrameTime)
+			std::this_thread::yield();
+
+		// Keep to the schedule, unless a slow frame left it more than a frame behind
+		auto interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(1.0f / limit));
+		auto now = std::chrono::steady_clock::now();
+		nextFrameTime = nextFrameTime + interval < now ? now + interval : nextFrameTime + interval;
+	}
+
+	frameWaited = true;
+}
+
+void Context::setCommandBufferReuse(bool enabled) {
+	commandBufferReuseEnabled = enabled;
+}
+
+void Context::setOcclusionCulling(bool enabled) {
+	occlusionCullingEnabled = enabled;
+}
+
+void Context::setHiZCulling(bool enabled) {
+	hiZCullingEnabled = enabled;
+}
+
+void Context::setMeshletCulling(bool enabled) {
+	meshletCullingEnabled = enabled;
+}
+
+void Context::setDepthPrePass(bool enabled) {
+	depthPrePassEnabled = enabled;
+}
+
+void Context::setDynamicResolution(bool enabled) {
+	dynamicResolutionEnabled = enabled;
+}
+
+void Context::setDynamicResolutionBounds(float minScale, float maxScale) {
+	std::lock_guard<std::mutex> lock(resolutionSettingsMutex);
+	pendingMinScale = minScale;
+	pendingMaxScale = maxScale;
+	resolutionBoundsPending = true;
+}
+
+void Context::setTargetFrameTime(float milliseconds) {
+	std::lock_guard<std::mutex> lock(resolutionSettingsMutex);
+	pendingTargetFrameTime = milliseconds;
+	targetFrameTimePending = true;
+}
+
+void Context::setShaderHotReload(bool enabled) {
+	shaderHotReloadEnabled = enabled;
+}
+
+void Context::setFramesInFlight(uint32_t frames) {
+	if (frames < 1 || frames > MAX_FRAMES_IN_FLIGHT)
+		throw std::invalid_argument("Frames in flight out of range!");
+
+	framesInFlightSetting = frames;
+}
+
+void Context::setPresentMode(PresentMode mode) {
+	presentModeSetting = mode;
+}
+
+void Context::setFrameLimit(float framesPerSecond) {
+	frameLimit = std::max(framesPerSecond, 0.0f);
+}
+
+Context::Statistics Context::getStatistics() const {
+	std::lock_guard<std::mutex> lock(statisticsMutex);
+	return publishedStatistics;
+}
+
+Timeline &Context::getTimeline() {
+	return *timeline;
 }
 
 void Context::initialize() {
@@ -134,7 +354,8 @@ void Context::terminate() {
 		destroyDebugUtilsMessengerEXT(instance, callback, nullptr);
 
 	vkDestroyInstance(instance, nullptr);
-
+	getPhysicalDeviceFeatures2 = nullptr;
+	getPhysicalDeviceProperties2 = nullptr;
 
 	initialized = false;
 }
@@ -149,7 +370,13 @@ void Context::createVulkanInstance() {
 	appInfo.applicationVersion = APP_VERSION;
 	appInfo.pEngineName = ENGINE_NAME;
 	appInfo.engineVersion = ENGINE_VERSION;
-	appInfo.apiVersion = VK_API_VERSION_1_0;
+	// 1.1 gives us vkGetPhysicalDeviceFeatures2 for querying descriptor indexing support
+	// A 1.0 loader has no vkEnumerateInstanceVersion and fails instances asking for more than 1.0
+	uint32_t loaderVersion = VK_API_VERSION_1_0;
+	auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
+	if (enumerateInstanceVersion != nullptr && enumerateInstanceVersion(&loaderVersion) != VK_SUCCESS)
+		loaderVersion = VK_API_VERSION_1_0;
+	appInfo.apiVersion = loaderVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
 
 	VkInstanceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
@@ -167,6 +394,11 @@ void Context::createVulkanInstance() {
 
 	if (vkCreateInstance(&createInfo, nullptr, &instance) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create instance!");
+
+	if (appInfo.apiVersion >= VK_API_VERSION_1_1) {
+		getPhysicalDeviceFeatures2 = (PFN_vkGetPhysicalDeviceFeatures2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceFeatures2");
+		getPhysicalDeviceProperties2 = (PFN_vkGetPhysicalDeviceProperties2)vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceProperties2");
+	}
 }
 
 void Context::setupDebugCallback() {
@@ -264,9 +496,46 @@ void Context::createLogicalDevice() {
 	VkPhysicalDeviceFeatures deviceFeatures = {};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 
+	// Bindless textures are optional, we fall back to per-object descriptors if they are missing
+	bindlessEnabled = checkBindlessSupport(physicalDevice);
+
+	std::vector<const char *> extensions(DEVICE_EXTENSIONS);
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	if (bindlessEnabled) {
+		extensions.insert(extensions.end(), BINDLESS_DEVICE_EXTENSIONS.begin(), BINDLESS_DEVICE_EXTENSIONS.end());
+
+		// Texture indices come from push constants, so they are dynamically uniform
+		deviceFeatures.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+		indexingFeatures.runtimeDescriptorArray = VK_TRUE;
+		indexingFeatures.descriptorBindingPartiallyBound = VK_TRUE;
+		indexingFeatures.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+		indexingFeatures.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+
+		bindlessCapacity = getBindlessCapacity(physicalDevice);
+	}
+
+	// Without timeline semaphores every submission gets a fence, and uploads are waited for on the CPU
+	timelineSemaphoreEnabled = checkTimelineSemaphoreSupport(physicalDevice);
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+	if (timelineSemaphoreEnabled) {
+		extensions.insert(extensions.end(), TIMELINE_DEVICE_EXTENSIONS.begin(), TIMELINE_DEVICE_EXTENSIONS.end());
+		timelineFeatures.timelineSemaphore = VK_TRUE;
+		timelineFeatures.pNext = bindlessEnabled ? &indexingFeatures : nullptr;
+	}
+
 	// Creation parameters for our logical device
 	VkDeviceCreateInfo createInfo = {};
 	createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+	if (timelineSemaphoreEnabled)
+		createInfo.pNext = &timelineFeatures;
+	else
+		createInfo.pNext = bindlessEnabled ? &indexingFeatures : nullptr;
 	createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
 	createInfo.pQueueCreateInfos = queueCreateInfos.data();
 
@@ -280,14 +549,16 @@ void Context::createLogicalDevice() {
 	} else
 		createInfo.enabledLayerCount = 0;
 
-	createInfo.enabledExtensionCount = static_cast<uint32_t>(DEVICE_EXTENSIONS.size());
-	createInfo.ppEnabledExtensionNames = DEVICE_EXTENSIONS.data();
+	createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+	createInfo.ppEnabledExtensionNames = extensions.data();
 
 	if (vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create logical device!");
 
 	vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
 	vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+
+	timeline = new Timeline(device, timelineSemaphoreEnabled);
 }
 
 
@@ -295,6 +566,7 @@ void Context::createSwapchain() {
 	SwapchainSupportDetails swapchainSupport = querySwapchainSupport(physicalDevice);
 
 	VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapchainSupport.formats);
+	swapchainPresentMode = presentModeSetting;
 	VkPresentModeKHR presentMode = chooseSwapPresentMode(swapchainSupport.presentModes);
 	VkExtent2D extent = chooseSwapExtent(swapchainSupport.capabilities);
 
@@ -355,13 +627,20 @@ void Context::createImageViews() {
 }
 
 void Context::createDepthResources() {
-	VkFormat depthFormat = findSupportedFormat({ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+	depthFormat = findSupportedFormat({ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
+	// Hi-Z culling reads the depth image to build its pyramid
+	VkFormatProperties formatProperties;
+	vkGetPhysicalDeviceFormatProperties(physicalDevice, depthFormat, &formatProperties);
+	hiZSupported = (formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) != 0;
+	if (!hiZSupported) return;
+
+	// Outlives the frame, so the next one can test against it
 	createImage(
 		swapchainExtent.width, swapchainExtent.height,
 		depthFormat,
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+		VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 		depthImage, depthImageMemory);
 
@@ -372,89 +651,91 @@ void Context::createDepthResources() {
 }
 
 void Context::createRenderPass() {
-	VkAttachmentDescription colorAttachment = {};
-	colorAttachment.format = swapchainImageFormat;
-	colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-	colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-
-	VkAttachmentDescription depthAttachment = {};
-	depthAttachment.format = findSupportedFormat({ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D24_UNORM_S8_UINT }, VK_IMAGE_TILING_OPTIMAL, VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
-	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
-	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-	depthAttachment.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference colorAttachmentRef = {};
-	colorAttachmentRef.attachment = 0;
-	colorAttachmentRef.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-	VkAttachmentReference depthAttachmentRef = {};
-	depthAttachmentRef.attachment = 1;
-	depthAttachmentRef.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-	VkSubpassDescription subpass = {};
-	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-	subpass.colorAttachmentCount = 1;
-	subpass.pColorAttachments = &colorAttachmentRef;
-	subpass.pDepthStencilAttachment = &depthAttachmentRef;
-
-	VkSubpassDependency dependency = {};
-	dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-	dependency.dstSubpass = 0;
-	dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.srcAccessMask = 0;
-	dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-	std::array<VkAttachmentDescription, 2> attachments = { colorAttachment, depthAttachment };
-	VkRenderPassCreateInfo renderPassInfo = {};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-	renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-	renderPassInfo.pAttachments = attachments.data();
-	renderPassInfo.subpassCount = 1;
-	renderPassInfo.pSubpasses = &subpass;
-	renderPassInfo.dependencyCount = 1;
-	renderPassInfo.pDependencies = &dependency;
-
-	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create render pass!");
-}
-
-void Context::createGraphicsPipeline() {
+	// Pipelines only need a compatible pass, the frame graph creates the ones it begins
+	renderPass = RenderGraph::createCompatibleRenderPass(device, swapchainImageFormat, depthFormat);
+	upscaleRenderPass = RenderGraph::createCompatibleRenderPass(device, swapchainImageFormat, VK_FORMAT_UNDEFINED);
+}
+
+void Context::createPipelineCache() {
+	VkPipelineCacheCreateInfo cacheInfo = {};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+
+	if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline cache!");
+}
+
+void Context::createShaderModules() {
+	// Modules stay loaded, every material permutation specializes the same code
+	vertexShaderModule = createShaderModule(File::loadBinary(SHADER_VERT_NAME));
+	fragmentShaderModule = createShaderModule(File::loadBinary(bindlessEnabled ? SHADER_BINDLESS_FRAG_NAME : SHADER_FRAG_NAME));
+	depthShaderModule = createShaderModule(File::loadBinary(SHADER_DEPTH_VERT_NAME));
+}
+
+void Context::createPipelineLayout() {
+	// In-shader layout
+	// Set 0 holds per-image uniforms, set 1 (bindless mode only) holds every loaded texture
+	std::array<VkDescriptorSetLayout, 2> setLayouts = { descriptorSetLayout, bindlessSetLayout };
+
+	// Per-draw transforms (and bindless texture indices) are pushed, not stored in uniform buffers
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DrawPushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = bindlessEnabled ? 2 : 1;
+	pipelineLayoutInfo.pSetLayouts = setLayouts.data();
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create pipeline layout!");
+}
+
+VkPipeline Context::createGraphicsPipeline(const Material &material, DepthMode depthMode) {
 	// ========================================================================
 	// ===				Start with shaders (programmable pipeline)			===
 	// ========================================================================
 
-	auto vertShaderCode = File::loadBinary(SHADER_VERT_NAME);
-	auto fragShaderCode = File::loadBinary(SHADER_FRAG_NAME);
-
-	VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-	VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo = {};
 	vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-	vertShaderStageInfo.module = vertShaderModule;
+	vertShaderStageInfo.module = depthMode == DEPTH_ONLY ? depthShaderModule : vertexShaderModule;
 	// It's possible to use one fragment shader with different behaviors
 	// Here we would specify the different entry point
 	vertShaderStageInfo.pName = "main";
-	// TODO: research this
-	// seems like an oportunity for smart shaders with differing behavior that are optimized ahead of time
 	vertShaderStageInfo.pSpecializationInfo = nullptr;
 
+	// Material features are constants the driver folds in, so untaken branches cost nothing per pixel
+	MaterialConstants constants = {};
+	constants.normalMapping = material.normalMapping ? VK_TRUE : VK_FALSE;
+	constants.specularModel = material.specularModel;
+	constants.specularPower = material.specularPower;
+	constants.specularStrength = material.specularStrength;
+	constants.alphaTest = material.alphaTest ? VK_TRUE : VK_FALSE;
+	constants.alphaCutoff = material.alphaCutoff;
+
+	std::array<VkSpecializationMapEntry, 6> mapEntries = {};
+	mapEntries[0] = { 0, offsetof(MaterialConstants, normalMapping), sizeof(VkBool32) };
+	mapEntries[1] = { 1, offsetof(MaterialConstants, specularModel), sizeof(uint32_t) };
+	mapEntries[2] = { 2, offsetof(MaterialConstants, specularPower), sizeof(float) };
+	mapEntries[3] = { 3, offsetof(MaterialConstants, specularStrength), sizeof(float) };
+	mapEntries[4] = { 4, offsetof(MaterialConstants, alphaTest), sizeof(VkBool32) };
+	mapEntries[5] = { 5, offsetof(MaterialConstants, alphaCutoff), sizeof(float) };
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(mapEntries.size());
+	specializationInfo.pMapEntries = mapEntries.data();
+	specializationInfo.dataSize = sizeof(constants);
+	specializationInfo.pData = &constants;
+
 	VkPipelineShaderStageCreateInfo fragShaderStageInfo = {};
 	fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
 	fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-	fragShaderStageInfo.module = fragShaderModule;
+	fragShaderStageInfo.module = fragmentShaderModule;
 	fragShaderStageInfo.pName = "main";
+	fragShaderStageInfo.pSpecializationInfo = &specializationInfo;
 
 	VkPipelineShaderStageCreateInfo shaderStages[] = { vertShaderStageInfo, fragShaderStageInfo };
 
@@ -468,6 +749,12 @@ void Context::createGraphicsPipeline() {
 	vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
 	vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
 
+	// The depth pre-pass reads the tightly packed position buffers instead
+	if (depthMode == DEPTH_ONLY) {
+		bindingDescription.stride = sizeof(glm::vec3);
+		vertexInputInfo.vertexAttributeDescriptionCount = 1;
+	}
+
 	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
 	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
 	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
@@ -477,26 +764,11 @@ void Context::createGraphicsPipeline() {
 	// ===				Fixed Funtion part of the pipeline					===
 	// ========================================================================
 
-	// Viewport specifies which part of the frame we're drawing to
-	VkViewport viewport = {};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float)swapchainExtent.width;
-	viewport.height = (float)swapchainExtent.height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-
-	// A Scissor rectangle specifies what part of an image we're drawing
-	VkRect2D scissor = {};
-	scissor.offset = { 0, 0 };
-	scissor.extent = swapchainExtent;
-
+	// Viewport and scissor are set when the render pass begins, as dynamic resolution changes them between frames
 	VkPipelineViewportStateCreateInfo viewportState = {};
 	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
 
 	VkPipelineRasterizationStateCreateInfo rasterizer = {};
 	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -525,13 +797,15 @@ void Context::createGraphicsPipeline() {
 	VkPipelineDepthStencilStateCreateInfo depthStencil = {};
 	depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
 	depthStencil.depthTestEnable = VK_TRUE;
-	depthStencil.depthWriteEnable = VK_TRUE;
-	depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+	// Depth is already final after the pre-pass
+	depthStencil.depthWriteEnable = depthMode == DEPTH_EQUAL ? VK_FALSE : VK_TRUE;
+	depthStencil.depthCompareOp = depthMode == DEPTH_EQUAL ? VK_COMPARE_OP_EQUAL : VK_COMPARE_OP_LESS;
 	depthStencil.depthBoundsTestEnable = VK_FALSE;
 	depthStencil.stencilTestEnable = VK_FALSE;
 
 	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
-	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	// Without a fragment shader there is no color to write
+	colorBlendAttachment.colorWriteMask = depthMode == DEPTH_ONLY ? 0 : VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
 	colorBlendAttachment.blendEnable = VK_FALSE;
 	colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE; // Optional
 	colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO; // Optional
@@ -551,18 +825,11 @@ void Context::createGraphicsPipeline() {
 	colorBlending.blendConstants[2] = 0.0f; // Optional
 	colorBlending.blendConstants[3] = 0.0f; // Optional
 
-	// NOTE: VkDynamicState is a limited, but existent thing
-
-	// In-shader layout
-	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
-	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutInfo.setLayoutCount = 1; // Optional
-	pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout; // Optional
-	pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
-	pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
-
-	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create pipeline layout!");
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
 
 	// ========================================================================
 	// ===				Create the actual Pipeline object					===
@@ -570,7 +837,7 @@ void Context::createGraphicsPipeline() {
 
 	VkGraphicsPipelineCreateInfo pipelineInfo = {};
 	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-	pipelineInfo.stageCount = 2;
+	pipelineInfo.stageCount = depthMode == DEPTH_ONLY ? 1 : 2;
 	pipelineInfo.pStages = shaderStages;
 
 	pipelineInfo.pVertexInputState = &vertexInputInfo;
@@ -580,44 +847,270 @@ void Context::createGraphicsPipeline() {
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 
-	if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS)
+	VkPipeline pipeline;
+	if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline) != VK_SUCCESS)
 		throw std::runtime_error("failed to create graphics pipeline!");
 
-	// Shader modules won't be needed later, so we release them
-	vkDestroyShaderModule(device, fragShaderModule, nullptr);
-	vkDestroyShaderModule(device, vertShaderModule, nullptr);
+	return pipeline;
 }
 
-void Context::createFramebuffers() {
-	swapchainFramebuffers.resize(swapchainImageViews.size());
+void Context::createFallbackPipeline() {
+	// Objects start with the default material, so they never wait on the fallback
+	Material material;
+	fallbackPipeline.pipeline = createGraphicsPipeline(material);
+	fallbackPipeline.equalDepthPipeline = createGraphicsPipeline(material, DEPTH_EQUAL);
+	fallbackPipeline.id = static_cast<uint32_t>(materialPipelines.size());
+	materialPipelines.emplace(material, fallbackPipeline);
+}
 
-	for (size_t i = 0; i < swapchainImageViews.size(); i++) {
-		std::array<VkImageView, 2> attachments = {
-			swapchainImageViews[i],
-			depthImageView
-		};
+void Context::createDepthPrePassPipeline() {
+	depthPrePassPipeline = createGraphicsPipeline(Material(), DEPTH_ONLY);
+}
+
+const Context::MaterialPipeline &Context::getMaterialPipeline(const Material &material) {
+	auto it = materialPipelines.find(material);
+	if (it != materialPipelines.end())
+		return it->second.pipeline != VK_NULL_HANDLE ? it->second : fallbackPipeline;
+
+	MaterialPipeline materialPipeline = {};
+	materialPipeline.pipeline = VK_NULL_HANDLE;
+	materialPipeline.equalDepthPipeline = VK_NULL_HANDLE;
+	materialPipeline.id = static_cast<uint32_t>(materialPipelines.size());
+	materialPipelines.emplace(material, materialPipeline);
+	compileMaterialPipeline(material);
+
+	return fallbackPipeline;
+}
+
+void Context::compileMaterialPipeline(const Material &material) {
+	{
+		std::lock_guard<std::mutex> lock(compiledPipelinesMutex);
+		++compilingPipelineCount;
+	}
+
+	// Swapchain resources the compilation reads are only replaced after destroyMaterialPipelines waited for it
+	Jobs::submit([this, material]() {
+		VkPipeline pipeline = VK_NULL_HANDLE, equalDepthPipeline = VK_NULL_HANDLE;
+		try {
+			pipeline = createGraphicsPipeline(material);
+			// Discarded fragments would still write depth in the pre-pass, so alpha-tested materials skip it
+			if (!material.alphaTest)
+				equalDepthPipeline = createGraphicsPipeline(material, DEPTH_EQUAL);
+		} catch (const std::exception &e) {
+			// The material keeps drawing with the fallback
+			std::cerr << "Material pipeline: " << e.what() << std::endl;
+			if (pipeline != VK_NULL_HANDLE)
+				vkDestroyPipeline(device, pipeline, nullptr);
+			pipeline = VK_NULL_HANDLE;
+		}
+
+		std::lock_guard<std::mutex> lock(compiledPipelinesMutex);
+		compiledPipelines.push_back({ material, pipeline, equalDepthPipeline });
+		--compilingPipelineCount;
+		compiledPipelinesCondition.notify_all();
+	});
+}
+
+void Context::collectCompiledPipelines() {
+	std::lock_guard<std::mutex> lock(compiledPipelinesMutex);
+	for (const auto &compiled : compiledPipelines) {
+		// A reload that failed to compile keeps the last working pipeline
+		if (compiled.pipeline == VK_NULL_HANDLE)
+			continue;
+
+		MaterialPipeline &entry = materialPipelines[compiled.material];
+		if (entry.pipeline != VK_NULL_HANDLE) {
+			VkPipeline replaced = entry.pipeline, replacedEqualDepth = entry.equalDepthPipeline;
+			deferDestruction([this, replaced, replacedEqualDepth]() {
+				vkDestroyPipeline(device, replaced, nullptr);
+				vkDestroyPipeline(device, replacedEqualDepth, nullptr);
+			});
+		}
+		entry.pipeline = compiled.pipeline;
+		entry.equalDepthPipeline = compiled.equalDepthPipeline;
+		if (entry.id == fallbackPipeline.id)
+			fallbackPipeline = entry;
+	}
+	compiledPipelines.clear();
+}
+
+void Context::waitForCompilingPipelines() {
+	std::unique_lock<std::mutex> lock(compiledPipelinesMutex);
+	compiledPipelinesCondition.wait(lock, [this]() { return compilingPipelineCount == 0; });
+}
+
+void Context::destroyMaterialPipelines() {
+	waitForCompilingPipelines();
+	collectCompiledPipelines();
+
+	// Destroying null handles does nothing
+	for (auto &entry : materialPipelines) {
+		vkDestroyPipeline(device, entry.second.pipeline, nullptr);
+		vkDestroyPipeline(device, entry.second.equalDepthPipeline, nullptr);
+	}
+	materialPipelines.clear();
+}
+
+void Context::reloadChangedShaders() {
+	if (shaderHotReloadEnabled != (shaderWatcher != nullptr)) {
+		if (shaderWatcher != nullptr) {
+			delete shaderWatcher;
+			shaderWatcher = nullptr;
+		} else {
+			try {
+				shaderWatcher = new FileWatcher(SHADER_DIRECTORY);
+
+				// Binaries changed by other means still reload, so a missing compiler is only reported
+				const char *compiler = std::getenv(SHADER_COMPILE_COMMAND_VARIABLE);
+				if ((compiler == nullptr || compiler[0] == '\0') && !std::filesystem::exists(SHADER_COMPILE_SCRIPT))
+					std::cerr << "Shader hot reload: " << SHADER_COMPILE_SCRIPT << " is not in the working directory, set "
+						<< SHADER_COMPILE_COMMAND_VARIABLE << " to compile edited sources" << std::endl;
+			} catch (const std::exception &e) {
+				std::cerr << "Shader hot reload: " << e.what() << std::endl;
+				shaderHotReloadEnabled = false;
+			}
+		}
+	}
+	if (shaderWatcher == nullptr)
+		return;
+
+	String sources;
+	bool graphicsChanged = false;
+	for (const auto &name : shaderWatcher->poll()) {
+		String extension = name.substr(name.find_last_of('.') + 1);
+		if (extension == "vert" || extension == "frag" || extension == "comp" || extension == "glsl") {
+			sources += " " + name;
+			continue;
+		}
+		if (extension != "spv")
+			continue;
+
+		// Binaries of other modes, like the non-bindless fragment shader, aren't in use
+		String path = String(SHADER_DIRECTORY) + "/" + name;
+		if (path == SHADER_VERT_NAME || path == (bindlessEnabled ? SHADER_BINDLESS_FRAG_NAME : SHADER_FRAG_NAME))
+			graphicsChanged = true;
+		else if (path == SHADER_DEPTH_VERT_NAME)
+			reloadDepthPrePassPipeline();
+		else if (path == SHADER_LIGHT_CULL_NAME)
+			reloadComputePipeline(SHADER_LIGHT_CULL_NAME, lightCullPipelineLayout, lightCullPipeline);
+		else if (dynamicResolutionSupported && (path == SHADER_UPSCALE_VERT_NAME || path == SHADER_UPSCALE_FRAG_NAME))
+			reloadUpscalePipeline();
+		else if (hiZSupported && path == SHADER_DEPTH_REDUCE_NAME)
+			reloadComputePipeline(SHADER_DEPTH_REDUCE_NAME, depthReducePipelineLayout, depthReducePipeline);
+		else if (hiZSupported && path == SHADER_CULL_NAME)
+			reloadComputePipeline(SHADER_CULL_NAME, cullPipelineLayout, cullPipeline);
+		else if (hiZSupported && path == SHADER_MESHLET_CULL_NAME)
+			reloadComputePipeline(SHADER_MESHLET_CULL_NAME, meshletCullPipelineLayout, meshletCullPipeline);
+	}
+
+	// The compiler replaces the binaries, which shows up in a later poll
+	if (!sources.empty()) {
+		const char *compiler = std::getenv(SHADER_COMPILE_COMMAND_VARIABLE);
+		String command = String(compiler != nullptr && compiler[0] != '\0' ? compiler : SHADER_COMPILE_SCRIPT) + sources;
+		Jobs::submit([command]() {
+			// The compiler prints its own errors, the old binaries stay in use
+			int status = std::system(command.c_str());
+			if (status != 0)
+				std::cerr << "Shader hot reload: compile failed with status " << status << ": " << command << std::endl;
+		});
+	}
+
+	if (graphicsChanged)
+		reloadGraphicsPipelines();
+}
+
+void Context::reloadGraphicsPipelines() {
+	// Compilations in flight still read the old modules
+	waitForCompilingPipelines();
+
+	// The old modules stay until both new ones are created, so a broken binary changes nothing
+	VkShaderModule vertexModule = VK_NULL_HANDLE, fragmentModule = VK_NULL_HANDLE;
+	try {
+		vertexModule = createShaderModule(File::loadBinary(SHADER_VERT_NAME));
+		fragmentModule = createShaderModule(File::loadBinary(bindlessEnabled ? SHADER_BINDLESS_FRAG_NAME : SHADER_FRAG_NAME));
+	} catch (const std::exception &e) {
+		std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		vkDestroyShaderModule(device, vertexModule, nullptr);
+		return;
+	}
 
-		VkFramebufferCreateInfo framebufferInfo = {};
-		framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferInfo.renderPass = renderPass;
-		framebufferInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferInfo.pAttachments = attachments.data();
-		framebufferInfo.width = swapchainExtent.width;
-		framebufferInfo.height = swapchainExtent.height;
-		framebufferInfo.layers = 1;
+	// Pipelines don't need their modules once created
+	vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+	vkDestroyShaderModule(device, fragmentShaderModule, nullptr);
+	vertexShaderModule = vertexModule;
+	fragmentShaderModule = fragmentModule;
+
+	// Old pipelines keep drawing until their replacements are collected at a frame start
+	for (const auto &entry : materialPipelines)
+		compileMaterialPipeline(entry.first);
+}
 
-		if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &swapchainFramebuffers[i]) != VK_SUCCESS)
-			throw std::runtime_error("Failed to create framebuffer!");
+void Context::reloadDepthPrePassPipeline() {
+	// Like compute pipelines, the single depth pipeline is rebuilt right away
+	waitForCompilingPipelines();
+
+	// Pipelines are created from the module member, the old one is put back if the new one fails
+	VkShaderModule previousModule = depthShaderModule;
+	VkPipeline reloaded;
+	try {
+		depthShaderModule = createShaderModule(File::loadBinary(SHADER_DEPTH_VERT_NAME));
+		reloaded = createGraphicsPipeline(Material(), DEPTH_ONLY);
+	} catch (const std::exception &e) {
+		std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		if (depthShaderModule != previousModule)
+			vkDestroyShaderModule(device, depthShaderModule, nullptr);
+		depthShaderModule = previousModule;
+		return;
 	}
+	vkDestroyShaderModule(device, previousModule, nullptr);
+
+	VkPipeline replaced = depthPrePassPipeline;
+	deferDestruction([this, replaced]() { vkDestroyPipeline(device, replaced, nullptr); });
+	depthPrePassPipeline = reloaded;
+
+	invalidateCommandBuffers();
+}
+
+void Context::reloadComputePipeline(const char *shaderName, const VkPipelineLayout &layout, VkPipeline &pipeline) {
+	// Compute pipelines are a single small shader, they are rebuilt right away
+	VkPipeline reloaded;
+	try {
+		createComputePipeline(shaderName, layout, reloaded);
+	} catch (const std::exception &e) {
+		std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		return;
+	}
+
+	VkPipeline replaced = pipeline;
+	deferDestruction([this, replaced]() { vkDestroyPipeline(device, replaced, nullptr); });
+	pipeline = reloaded;
+
+	// Recorded buffers still bind the old pipeline
+	invalidateCommandBuffers();
 }
 
+void Context::reloadUpscalePipeline() {
+	VkPipeline reloaded;
+	try {
+		createUpscalePipeline(reloaded);
+	} catch (const std::exception &e) {
+		std::cerr << "Shader hot reload: " << e.what() << std::endl;
+		return;
+	}
+
+	VkPipeline replaced = upscalePipeline;
+	deferDestruction([this, replaced]() { vkDestroyPipeline(device, replaced, nullptr); });
+	upscalePipeline = reloaded;
+
+	invalidateCommandBuffers();
+}
 
 void Context::createDescriptorSetLayout() {
 	VkDescriptorSetLayoutBinding vertexUboLayoutBinding = {};
@@ -634,31 +1127,846 @@ void Context::createDescriptorSetLayout() {
 	fragUboLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	fragUboLayoutBinding.pImmutableSamplers = nullptr;
 
-	VkDescriptorSetLayoutBinding diffuseTextureSamplerBinding = {};
-	diffuseTextureSamplerBinding.binding = 2;
-	diffuseTextureSamplerBinding.descriptorCount = 1;
-	diffuseTextureSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	diffuseTextureSamplerBinding.pImmutableSamplers = nullptr;
-	diffuseTextureSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	VkDescriptorSetLayoutBinding diffuseTextureSamplerBinding = {};
+	diffuseTextureSamplerBinding.binding = 2;
+	diffuseTextureSamplerBinding.descriptorCount = 1;
+	diffuseTextureSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	diffuseTextureSamplerBinding.pImmutableSamplers = nullptr;
+	diffuseTextureSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutBinding normalMapSamplerBinding = {};
+	normalMapSamplerBinding.binding = 3;
+	normalMapSamplerBinding.descriptorCount = 1;
+	normalMapSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	normalMapSamplerBinding.pImmutableSamplers = nullptr;
+	normalMapSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Local lights and the lists of them in each cluster
+	VkDescriptorSetLayoutBinding lightBufferBinding = {};
+	lightBufferBinding.binding = 4;
+	lightBufferBinding.descriptorCount = 1;
+	lightBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	lightBufferBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutBinding clusterBufferBinding = lightBufferBinding;
+	clusterBufferBinding.binding = 5;
+
+	// In bindless mode textures live in their own set instead
+	std::vector<VkDescriptorSetLayoutBinding> bindings = { vertexUboLayoutBinding, fragUboLayoutBinding, lightBufferBinding, clusterBufferBinding };
+	if (!bindlessEnabled) {
+		bindings.push_back(diffuseTextureSamplerBinding);
+		bindings.push_back(normalMapSamplerBinding);
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create descriptor set layout!");
+}
+
+void Context::createBindlessResources() {
+	if (!bindlessEnabled) return;
+
+	// ========================================================================
+	// ===							Set layout								===
+	// ========================================================================
+	VkDescriptorSetLayoutBinding texturesBinding = {};
+	texturesBinding.binding = 0;
+	texturesBinding.descriptorCount = bindlessCapacity;
+	texturesBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	texturesBinding.pImmutableSamplers = nullptr;
+	texturesBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	// Not every slot is filled and new textures are written while older frames are still in flight
+	VkDescriptorBindingFlagsEXT bindingFlags =
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT
+		| VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT
+		| VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo = {};
+	bindingFlagsInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+	bindingFlagsInfo.bindingCount = 1;
+	bindingFlagsInfo.pBindingFlags = &bindingFlags;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.pNext = &bindingFlagsInfo;
+	layoutInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &texturesBinding;
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &bindlessSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create bindless descriptor set layout!");
+
+	// ========================================================================
+	// ===							Pool and set							===
+	// ========================================================================
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = bindlessCapacity;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &bindlessPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create bindless descriptor pool!");
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = bindlessPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &bindlessSetLayout;
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, &bindlessSet) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate bindless descriptor set!");
+}
+
+
+void Context::createComputePipeline(const char *shaderName, const VkPipelineLayout &layout, VkPipeline &outPipeline) {
+	auto shaderCode = File::loadBinary(shaderName);
+	VkShaderModule shaderModule = createShaderModule(shaderCode);
+
+	VkComputePipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineInfo.stage.module = shaderModule;
+	pipelineInfo.stage.pName = "main";
+	pipelineInfo.layout = layout;
+
+	if (vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &outPipeline) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create compute pipeline!");
+
+	vkDestroyShaderModule(device, shaderModule, nullptr);
+}
+
+void Context::createHiZPipelines() {
+	if (!hiZSupported) return;
+
+	// ========================================================================
+	// ===							Set layouts								===
+	// ========================================================================
+	std::array<VkDescriptorSetLayoutBinding, 2> reduceBindings = {};
+	reduceBindings[0].binding = 0;
+	reduceBindings[0].descriptorCount = 1;
+	reduceBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	reduceBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reduceBindings[1].binding = 1;
+	reduceBindings[1].descriptorCount = 1;
+	reduceBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	reduceBindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(reduceBindings.size());
+	layoutInfo.pBindings = reduceBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &depthReduceSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth reduce descriptor set layout!");
+
+	// Uniforms, draw bounds, indirect commands and the depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 4> cullBindings = {};
+	VkDescriptorType cullTypes[] = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+	};
+	for (uint32_t i = 0; i < cullBindings.size(); ++i) {
+		cullBindings[i].binding = i;
+		cullBindings[i].descriptorCount = 1;
+		cullBindings[i].descriptorType = cullTypes[i];
+		cullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(cullBindings.size());
+	layoutInfo.pBindings = cullBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &cullSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create cull descriptor set layout!");
+
+	// ========================================================================
+	// ===							Pipelines								===
+	// ========================================================================
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	pushConstantRange.offset = 0;
+	pushConstantRange.size = sizeof(DepthReducePushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &depthReduceSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &depthReducePipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth reduce pipeline layout!");
+
+	pushConstantRange.size = sizeof(CullPushConstants);
+	pipelineLayoutInfo.pSetLayouts = &cullSetLayout;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &cullPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create cull pipeline layout!");
+
+	createComputePipeline(SHADER_DEPTH_REDUCE_NAME, depthReducePipelineLayout, depthReducePipeline);
+	createComputePipeline(SHADER_CULL_NAME, cullPipelineLayout, cullPipeline);
+
+	// ========================================================================
+	// ===							Meshlet culling							===
+	// ========================================================================
+	// Uniforms, draws, indirect commands, packed indices, visibility and the depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, 6> meshletCullBindings = {};
+	VkDescriptorType meshletCullTypes[] = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER
+	};
+	for (uint32_t i = 0; i < meshletCullBindings.size(); ++i) {
+		meshletCullBindings[i].binding = i;
+		meshletCullBindings[i].descriptorCount = 1;
+		meshletCullBindings[i].descriptorType = meshletCullTypes[i];
+		meshletCullBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(meshletCullBindings.size());
+	layoutInfo.pBindings = meshletCullBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &meshletCullSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create meshlet cull descriptor set layout!");
+
+	// A mesh's meshlets and its index buffer
+	std::array<VkDescriptorSetLayoutBinding, 2> meshletBindings = {};
+	for (uint32_t i = 0; i < meshletBindings.size(); ++i) {
+		meshletBindings[i].binding = i;
+		meshletBindings[i].descriptorCount = 1;
+		meshletBindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		meshletBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	layoutInfo.bindingCount = static_cast<uint32_t>(meshletBindings.size());
+	layoutInfo.pBindings = meshletBindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &meshletSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create meshlet descriptor set layout!");
+
+	VkDescriptorSetLayout meshletCullSetLayouts[] = { meshletCullSetLayout, meshletSetLayout };
+	pushConstantRange.size = sizeof(MeshletCullPushConstants);
+	pipelineLayoutInfo.setLayoutCount = 2;
+	pipelineLayoutInfo.pSetLayouts = meshletCullSetLayouts;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &meshletCullPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create meshlet cull pipeline layout!");
+
+	createComputePipeline(SHADER_MESHLET_CULL_NAME, meshletCullPipelineLayout, meshletCullPipeline);
+}
+
+void Context::createHiZResources() {
+	if (!hiZSupported) return;
+
+	// ========================================================================
+	// ===							Depth pyramid							===
+	// ========================================================================
+	// Level 0 is half the depth buffer (rounding up), then mip levels down to a single texel
+	depthPyramidExtent = { (swapchainExtent.width + 1) / 2, (swapchainExtent.height + 1) / 2 };
+	uint32_t levelCount = 1;
+	while ((std::max(depthPyramidExtent.width, depthPyramidExtent.height) >> levelCount) > 0)
+		++levelCount;
+
+	createImage(
+		depthPyramidExtent.width, depthPyramidExtent.height,
+		VK_FORMAT_R32_SFLOAT,
+		VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		depthPyramid, depthPyramidMemory, levelCount);
+
+	depthPyramidView = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 0, levelCount);
+	depthPyramidLevelViews.resize(levelCount);
+	for (uint32_t i = 0; i < levelCount; ++i)
+		depthPyramidLevelViews[i] = createImageView(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, i, 1);
+
+	// Written and read by compute only, so it never leaves the general layout
+	transitionImageLayout(depthPyramid, VK_FORMAT_R32_SFLOAT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL, levelCount);
+
+	// Shaders only use texelFetch, but a sampler is still needed to bind the images
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_NEAREST;
+	samplerInfo.minFilter = VK_FILTER_NEAREST;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.maxLod = static_cast<float>(levelCount);
+
+	if (vkCreateSampler(device, &samplerInfo, nullptr, &depthPyramidSampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create depth pyramid sampler!");
+
+	// ========================================================================
+	// ===							Pool and sets							===
+	// ========================================================================
+	uint32_t imageCount = static_cast<uint32_t>(swapchainImages.size());
+
+	std::array<VkDescriptorPoolSize, 4> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSizes[0].descriptorCount = levelCount + 2 * imageCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	poolSizes[1].descriptorCount = levelCount;
+	poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[2].descriptorCount = 2 * imageCount;
+	poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[3].descriptorCount = 6 * imageCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = levelCount + 2 * imageCount;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &hiZDescriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create Hi-Z descriptor pool!");
+
+	std::vector<VkDescriptorSetLayout> reduceLayouts(levelCount, depthReduceSetLayout);
+	std::vector<VkDescriptorSetLayout> cullLayouts(imageCount, cullSetLayout);
+	std::vector<VkDescriptorSetLayout> meshletCullLayouts(imageCount, meshletCullSetLayout);
+	depthReduceSets.resize(levelCount);
+	cullSets.resize(imageCount);
+	meshletCullSets.resize(imageCount);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = hiZDescriptorPool;
+	allocInfo.descriptorSetCount = levelCount;
+	allocInfo.pSetLayouts = reduceLayouts.data();
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, depthReduceSets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate depth reduce descriptor sets!");
+
+	allocInfo.descriptorSetCount = imageCount;
+	allocInfo.pSetLayouts = cullLayouts.data();
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, cullSets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate cull descriptor sets!");
+
+	allocInfo.pSetLayouts = meshletCullLayouts.data();
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, meshletCullSets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate meshlet cull descriptor sets!");
+
+	createCullBuffers();
+	writeHiZDescriptorSets();
+}
+
+void Context::createCullBuffers() {
+	cullUniformBuffers.resize(swapchainImages.size());
+	cullDrawBuffers.resize(swapchainImages.size());
+	indirectBuffers.resize(swapchainImages.size());
+	cullUniformBufferMemories.resize(swapchainImages.size());
+	cullDrawBufferMemories.resize(swapchainImages.size());
+	indirectBufferMemories.resize(swapchainImages.size());
+	meshletDrawBuffers.resize(swapchainImages.size());
+	meshletIndirectBuffers.resize(swapchainImages.size());
+	meshletIndexBuffers.resize(swapchainImages.size());
+	meshletVisibilityBuffers.resize(swapchainImages.size());
+	meshletDrawBufferMemories.resize(swapchainImages.size());
+	meshletIndirectBufferMemories.resize(swapchainImages.size());
+	meshletIndexBufferMemories.resize(swapchainImages.size());
+	meshletVisibilityBufferMemories.resize(swapchainImages.size());
+
+	for (auto i = 0; i < swapchainImages.size(); ++i) {
+		createBuffer(sizeof(CullUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullUniformBuffers[i], cullUniformBufferMemories[i]);
+		createBuffer(cullDrawCapacity * sizeof(CullDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, cullDrawBuffers[i], cullDrawBufferMemories[i]);
+		// Commands of both phases, only ever touched by the GPU
+		createBuffer(2 * cullDrawCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indirectBuffers[i], indirectBufferMemories[i]);
+
+		createBuffer(cullDrawCapacity * sizeof(MeshletCullDraw), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, meshletDrawBuffers[i], meshletDrawBufferMemories[i]);
+		// Cleared at the start of every frame, then counted up by the culling pass
+		createBuffer(2 * cullDrawCapacity * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletIndirectBuffers[i], meshletIndirectBufferMemories[i]);
+		createBuffer(meshletCullIndexCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletIndexBuffers[i], meshletIndexBufferMemories[i]);
+		createBuffer(meshletCullCapacity * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletVisibilityBuffers[i], meshletVisibilityBufferMemories[i]);
+	}
+}
+
+void Context::writeHiZDescriptorSets() {
+	std::vector<VkDescriptorImageInfo> sourceInfos(depthReduceSets.size());
+	std::vector<VkDescriptorImageInfo> destinationInfos(depthReduceSets.size());
+	std::vector<VkWriteDescriptorSet> descriptorWrites;
+
+	// Level 0 reads the depth buffer, every other level the one below it
+	for (size_t i = 0; i < depthReduceSets.size(); ++i) {
+		sourceInfos[i].sampler = depthPyramidSampler;
+		sourceInfos[i].imageView = i == 0 ? depthImageView : depthPyramidLevelViews[i - 1];
+		sourceInfos[i].imageLayout = i == 0 ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		destinationInfos[i].imageView = depthPyramidLevelViews[i];
+		destinationInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = depthReduceSets[i];
+		write.descriptorCount = 1;
+
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pImageInfo = &sourceInfos[i];
+		descriptorWrites.push_back(write);
+
+		write.dstBinding = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		write.pImageInfo = &destinationInfos[i];
+		descriptorWrites.push_back(write);
+	}
+
+	VkDescriptorImageInfo pyramidInfo = {};
+	pyramidInfo.sampler = depthPyramidSampler;
+	pyramidInfo.imageView = depthPyramidView;
+	pyramidInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	std::vector<std::array<VkDescriptorBufferInfo, 3>> bufferInfos(cullSets.size());
+	for (size_t i = 0; i < cullSets.size(); ++i) {
+		bufferInfos[i][0] = { cullUniformBuffers[i], 0, sizeof(CullUBO) };
+		bufferInfos[i][1] = { cullDrawBuffers[i], 0, VK_WHOLE_SIZE };
+		bufferInfos[i][2] = { indirectBuffers[i], 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = cullSets[i];
+		write.descriptorCount = 1;
+
+		write.dstBinding = 0;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+		write.pBufferInfo = &bufferInfos[i][0];
+		descriptorWrites.push_back(write);
+
+		write.dstBinding = 1;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		write.pBufferInfo = &bufferInfos[i][1];
+		descriptorWrites.push_back(write);
+
+		write.dstBinding = 2;
+		write.pBufferInfo = &bufferInfos[i][2];
+		descriptorWrites.push_back(write);
+
+		write.dstBinding = 3;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pBufferInfo = nullptr;
+		write.pImageInfo = &pyramidInfo;
+		descriptorWrites.push_back(write);
+	}
+
+	std::vector<std::array<VkDescriptorBufferInfo, 5>> meshletBufferInfos(meshletCullSets.size());
+	for (size_t i = 0; i < meshletCullSets.size(); ++i) {
+		meshletBufferInfos[i][0] = { cullUniformBuffers[i], 0, sizeof(CullUBO) };
+		meshletBufferInfos[i][1] = { meshletDrawBuffers[i], 0, VK_WHOLE_SIZE };
+		meshletBufferInfos[i][2] = { meshletIndirectBuffers[i], 0, VK_WHOLE_SIZE };
+		meshletBufferInfos[i][3] = { meshletIndexBuffers[i], 0, VK_WHOLE_SIZE };
+		meshletBufferInfos[i][4] = { meshletVisibilityBuffers[i], 0, VK_WHOLE_SIZE };
+
+		VkWriteDescriptorSet write = {};
+		write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		write.dstSet = meshletCullSets[i];
+		write.descriptorCount = 1;
+
+		for (uint32_t binding = 0; binding < meshletBufferInfos[i].size(); ++binding) {
+			write.dstBinding = binding;
+			write.descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			write.pBufferInfo = &meshletBufferInfos[i][binding];
+			descriptorWrites.push_back(write);
+		}
+
+		write.dstBinding = 5;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		write.pBufferInfo = nullptr;
+		write.pImageInfo = &pyramidInfo;
+		descriptorWrites.push_back(write);
+	}
+
+	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+}
+
+
+void Context::createLightCullPipeline() {
+	// Uniforms, lights and cluster lists
+	std::array<VkDescriptorSetLayoutBinding, 3> bindings = {};
+	VkDescriptorType types[] = {
+		VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+	};
+	for (uint32_t i = 0; i < bindings.size(); ++i) {
+		bindings[i].binding = i;
+		bindings[i].descriptorCount = 1;
+		bindings[i].descriptorType = types[i];
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
+	layoutInfo.pBindings = bindings.data();
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &lightCullSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light cull descriptor set layout!");
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &lightCullSetLayout;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &lightCullPipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light cull pipeline layout!");
+
+	createComputePipeline(SHADER_LIGHT_CULL_NAME, lightCullPipelineLayout, lightCullPipeline);
+}
+
+void Context::createLightResources() {
+	uint32_t imageCount = static_cast<uint32_t>(swapchainImages.size());
+
+	lightBuffers.resize(imageCount);
+	clusterBuffers.resize(imageCount);
+	lightBufferMemories.resize(imageCount);
+	clusterBufferMemories.resize(imageCount);
+
+	for (uint32_t i = 0; i < imageCount; ++i) {
+		// Written every frame, the count first and then the lights
+		createBuffer(sizeof(glm::vec4) + MAX_LIGHTS * sizeof(LightData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, lightBuffers[i], lightBufferMemories[i]);
+		// Written by the light culling pass and read by the fragments, a count and the light indices per cluster
+		createBuffer(CLUSTER_COUNT * (MAX_LIGHTS_PER_CLUSTER + 1) * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, clusterBuffers[i], clusterBufferMemories[i]);
+	}
+
+	std::array<VkDescriptorPoolSize, 2> poolSizes = {};
+	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+	poolSizes[0].descriptorCount = imageCount;
+	poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	poolSizes[1].descriptorCount = 2 * imageCount;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+	poolInfo.pPoolSizes = poolSizes.data();
+	poolInfo.maxSets = imageCount;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &lightCullDescriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create light cull descriptor pool!");
+
+	std::vector<VkDescriptorSetLayout> layouts(imageCount, lightCullSetLayout);
+	lightCullSets.resize(imageCount);
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = lightCullDescriptorPool;
+	allocInfo.descriptorSetCount = imageCount;
+	allocInfo.pSetLayouts = layouts.data();
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, lightCullSets.data()) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate light cull descriptor sets!");
+
+	for (uint32_t i = 0; i < imageCount; ++i) {
+		std::array<VkDescriptorBufferInfo, 3> bufferInfos = {};
+		bufferInfos[0].buffer = fragmentUniformBuffers[i];
+		bufferInfos[0].range = sizeof(FragmentUBO);
+		bufferInfos[1].buffer = lightBuffers[i];
+		bufferInfos[1].range = VK_WHOLE_SIZE;
+		bufferInfos[2].buffer = clusterBuffers[i];
+		bufferInfos[2].range = VK_WHOLE_SIZE;
+
+		std::array<VkWriteDescriptorSet, 3> descriptorWrites = {};
+		for (uint32_t binding = 0; binding < descriptorWrites.size(); ++binding) {
+			descriptorWrites[binding].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			descriptorWrites[binding].dstSet = lightCullSets[i];
+			descriptorWrites[binding].dstBinding = binding;
+			descriptorWrites[binding].descriptorCount = 1;
+			descriptorWrites[binding].descriptorType = binding == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			descriptorWrites[binding].pBufferInfo = &bufferInfos[binding];
+		}
+
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+	}
+}
+
+void Context::createTimestampQueries() {
+	// Dynamic resolution is driven by the measured GPU time of every frame
+	VkPhysicalDeviceProperties properties = getDeviceProperties(physicalDevice);
+	dynamicResolutionSupported = properties.limits.timestampComputeAndGraphics == VK_TRUE;
+	if (!dynamicResolutionSupported) return;
+
+	timestampPeriod = properties.limits.timestampPeriod;
+	timestampsWritten.resize(swapchainImages.size(), false);
+
+	VkQueryPoolCreateInfo queryPoolInfo = {};
+	queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+	queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+	queryPoolInfo.queryCount = 2 * static_cast<uint32_t>(swapchainImages.size());
+
+	if (vkCreateQueryPool(device, &queryPoolInfo, nullptr, &timestampQueryPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timestamp query pool!");
+}
+
+void Context::createUpscalePipelineLayout() {
+	if (!dynamicResolutionSupported) return;
+
+	VkDescriptorSetLayoutBinding sceneBinding = {};
+	sceneBinding.binding = 0;
+	sceneBinding.descriptorCount = 1;
+	sceneBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	sceneBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
+	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	layoutInfo.bindingCount = 1;
+	layoutInfo.pBindings = &sceneBinding;
+
+	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &upscaleSetLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upscale descriptor set layout!");
+
+	VkPushConstantRange pushConstantRange = {};
+	pushConstantRange.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	pushConstantRange.size = sizeof(UpscalePushConstants);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutInfo = {};
+	pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutInfo.setLayoutCount = 1;
+	pipelineLayoutInfo.pSetLayouts = &upscaleSetLayout;
+	pipelineLayoutInfo.pushConstantRangeCount = 1;
+	pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+	if (vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &upscalePipelineLayout) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upscale pipeline layout!");
+
+	// A single set, pointed at the new scene image whenever the frame graph is rebuilt
+	VkDescriptorPoolSize poolSize = {};
+	poolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	poolSize.descriptorCount = 1;
+
+	VkDescriptorPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolInfo.poolSizeCount = 1;
+	poolInfo.pPoolSizes = &poolSize;
+	poolInfo.maxSets = 1;
+
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &upscaleDescriptorPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upscale descriptor pool!");
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorPool = upscaleDescriptorPool;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &upscaleSetLayout;
+
+	if (vkAllocateDescriptorSets(device, &allocInfo, &upscaleSet) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate upscale descriptor set!");
+
+	// Bilinear taps between the rendered texels, clamped in the shader
+	VkSamplerCreateInfo samplerInfo = {};
+	samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerInfo.magFilter = VK_FILTER_LINEAR;
+	samplerInfo.minFilter = VK_FILTER_LINEAR;
+	samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+	if (vkCreateSampler(device, &samplerInfo, nullptr, &sceneColorSampler) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create scene color sampler!");
+}
+
+void Context::createUpscalePipeline(VkPipeline &outPipeline) {
+	VkShaderModule vertexModule = createShaderModule(File::loadBinary(SHADER_UPSCALE_VERT_NAME));
+	VkShaderModule fragmentModule;
+	try {
+		fragmentModule = createShaderModule(File::loadBinary(SHADER_UPSCALE_FRAG_NAME));
+	} catch (...) {
+		vkDestroyShaderModule(device, vertexModule, nullptr);
+		throw;
+	}
+
+	std::array<VkPipelineShaderStageCreateInfo, 2> shaderStages = {};
+	shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+	shaderStages[0].module = vertexModule;
+	shaderStages[0].pName = "main";
+	shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+	shaderStages[1].module = fragmentModule;
+	shaderStages[1].pName = "main";
+
+	// The fullscreen triangle comes from the vertex index alone
+	VkPipelineVertexInputStateCreateInfo vertexInputInfo = {};
+	vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+
+	VkPipelineInputAssemblyStateCreateInfo inputAssembly = {};
+	inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+	inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+	VkPipelineViewportStateCreateInfo viewportState = {};
+	viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+	viewportState.viewportCount = 1;
+	viewportState.scissorCount = 1;
+
+	VkPipelineRasterizationStateCreateInfo rasterizer = {};
+	rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+	rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+	rasterizer.lineWidth = 1.0f;
+	rasterizer.cullMode = VK_CULL_MODE_NONE;
+	rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+	VkPipelineMultisampleStateCreateInfo multisampling = {};
+	multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+	multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+	VkPipelineColorBlendAttachmentState colorBlendAttachment = {};
+	colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+	colorBlendAttachment.blendEnable = VK_FALSE;
+
+	VkPipelineColorBlendStateCreateInfo colorBlending = {};
+	colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+	colorBlending.attachmentCount = 1;
+	colorBlending.pAttachments = &colorBlendAttachment;
+
+	std::array<VkDynamicState, 2> dynamicStates = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+	VkPipelineDynamicStateCreateInfo dynamicState = {};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
+	dynamicState.pDynamicStates = dynamicStates.data();
+
+	VkGraphicsPipelineCreateInfo pipelineInfo = {};
+	pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+	pipelineInfo.stageCount = static_cast<uint32_t>(shaderStages.size());
+	pipelineInfo.pStages = shaderStages.data();
+	pipelineInfo.pVertexInputState = &vertexInputInfo;
+	pipelineInfo.pInputAssemblyState = &inputAssembly;
+	pipelineInfo.pViewportState = &viewportState;
+	pipelineInfo.pRasterizationState = &rasterizer;
+	pipelineInfo.pMultisampleState = &multisampling;
+	pipelineInfo.pColorBlendState = &colorBlending;
+	pipelineInfo.pDynamicState = &dynamicState;
+	pipelineInfo.layout = upscalePipelineLayout;
+	pipelineInfo.renderPass = upscaleRenderPass;
+	pipelineInfo.subpass = 0;
+
+	VkResult result = vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &outPipeline);
+
+	vkDestroyShaderModule(device, fragmentModule, nullptr);
+	vkDestroyShaderModule(device, vertexModule, nullptr);
+
+	if (result != VK_SUCCESS)
+		throw std::runtime_error("Failed to create upscale pipeline!");
+}
+
+void Context::buildFrameGraph() {
+	frameGraph = new RenderGraph(device, physicalDevice);
+	RenderGraph &graph = *frameGraph;
+	frameGraphHiZ = hiZCullingActive;
+	frameGraphMeshlets = meshletCullingActive;
+	frameGraphUpscale = dynamicResolutionActive;
+	bool indirect = hiZCullingActive || meshletCullingActive;
+
+	// ========================================================================
+	// ===							Resources								===
+	// ========================================================================
+	RenderGraph::Resource swapchainImage = graph.importImage("swapchain", swapchainImages, swapchainImageViews, swapchainImageFormat, swapchainExtent,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR);
+	// As large as the window, only the top left part of it is rendered to at lower scales
+	RenderGraph::Resource color = dynamicResolutionActive ? graph.createImage("scene color", swapchainImageFormat, swapchainExtent) : swapchainImage;
+	RenderGraph::Resource depth = hiZCullingActive
+		? graph.importImage("depth", { depthImage }, { depthImageView }, depthFormat, swapchainExtent,
+			VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL)
+		: graph.createImage("depth", depthFormat, swapchainExtent);
+	RenderGraph::Resource depthPyramidImage = hiZCullingActive
+		? graph.importImage("depth pyramid", { depthPyramid }, { depthPyramidView }, VK_FORMAT_R32_SFLOAT, depthPyramidExtent, VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_LAYOUT_GENERAL)
+		: 0;
+	RenderGraph::Resource clusters = graph.createBuffer("clusters");
+	// Indirect commands of the culling passes, and the indices packed by meshlet culling
+	RenderGraph::Resource commands = graph.createBuffer("draw commands");
+
+	// ========================================================================
+	// ===								Passes								===
+	// ========================================================================
+	// Lights are binned before anything is shaded
+	graph.addComputePass("light culling", [this](const VkCommandBuffer &buffer, uint32_t currentImage) { recordLightCull(buffer, currentImage); })
+		.write(clusters, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT);
+
+	// Hi-Z culling draws in two phases, the first tests against last frame's depth, the second against the depth of the first
+	uint32_t phaseCount = hiZCullingActive ? 2 : 1;
+	for (uint32_t phase = 0; phase < phaseCount; ++phase) {
+		if (hiZCullingActive) {
+			// Without a history the first phase culls against the frustum alone
+			graph.addComputePass("depth pyramid", [this, phase](const VkCommandBuffer &buffer, uint32_t) {
+				if (phase == 1 || hiZHistoryValid)
+					recordDepthPyramid(buffer);
+			})
+				.sample(depth, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)
+				.storage(depthPyramidImage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+
+		if (indirect) {
+			// Meshlet culling tests parts of draws instead of whole ones, and zeroes the commands it adds their indices to
+			RenderGraph::Pass &cull = meshletCullingActive
+				? graph.addComputePass("meshlet culling", [this, phase](const VkCommandBuffer &buffer, uint32_t currentImage) { recordMeshletCull(buffer, currentImage, drawList, phase); })
+					.write(commands, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT)
+				: graph.addComputePass("culling", [this, phase](const VkCommandBuffer &buffer, uint32_t currentImage) { recordCull(buffer, currentImage, static_cast<uint32_t>(drawList.size()), phase); })
+					.write(commands, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+			if (hiZCullingActive)
+				cull.sample(depthPyramidImage, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+		}
+
+		// The second phase adds to what the first one drew
+		VkAttachmentLoadOp loadOp = phase == 0 ? VK_ATTACHMENT_LOAD_OP_CLEAR : VK_ATTACHMENT_LOAD_OP_LOAD;
+		RenderGraph::Pass &scenePass = graph.addGraphicsPass(phase == 0 ? "scene" : "scene second phase", [this, phase](const VkCommandBuffer &buffer, uint32_t currentImage) {
+			uint32_t firstCommand = phase * static_cast<uint32_t>(drawList.size());
+			if (meshletCullingActive)
+				recordDraws(buffer, drawList, meshletIndirectBuffers[currentImage], firstCommand, meshletIndexBuffers[currentImage]);
+			else if (hiZCullingActive)
+				recordDraws(buffer, drawList, indirectBuffers[currentImage], firstCommand);
+			else
+				recordDraws(buffer, drawList);
+		}, [this]() { return renderExtent; })
+			.color(color, loadOp)
+			.depth(depth, loadOp)
+			.read(clusters, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+		if (indirect)
+			scenePass.read(commands, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_INDEX_READ_BIT);
+	}
+
+	// Every pixel of the swapchain image is overwritten, so the old contents don't matter
+	if (dynamicResolutionActive) {
+		graph.addGraphicsPass("upscale", [this](const VkCommandBuffer &buffer, uint32_t) { recordUpscale(buffer); })
+			.color(swapchainImage, VK_ATTACHMENT_LOAD_OP_DONT_CARE)
+			.sample(color, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+	}
+
+	graph.compile();
 
-	VkDescriptorSetLayoutBinding normalMapSamplerBinding = {};
-	normalMapSamplerBinding.binding = 3;
-	normalMapSamplerBinding.descriptorCount = 1;
-	normalMapSamplerBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	normalMapSamplerBinding.pImmutableSamplers = nullptr;
-	normalMapSamplerBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+	// The scene image is new with every graph
+	if (dynamicResolutionActive) {
+		VkDescriptorImageInfo imageInfo = {};
+		imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		imageInfo.imageView = graph.getImageView(color);
+		imageInfo.sampler = sceneColorSampler;
 
-	std::array<VkDescriptorSetLayoutBinding, 4> bindings = { vertexUboLayoutBinding, fragUboLayoutBinding, diffuseTextureSamplerBinding, normalMapSamplerBinding };
-	VkDescriptorSetLayoutCreateInfo layoutInfo = {};
-	layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-	layoutInfo.bindingCount = static_cast<uint32_t>(bindings.size());
-	layoutInfo.pBindings = bindings.data();
+		VkWriteDescriptorSet descriptorWrite = {};
+		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrite.dstSet = upscaleSet;
+		descriptorWrite.dstBinding = 0;
+		descriptorWrite.descriptorCount = 1;
+		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		descriptorWrite.pImageInfo = &imageInfo;
 
-	if (vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS)
-		throw std::runtime_error("Failed to create descriptor set layout!");
+		vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+	}
 }
 
-
 void Context::createCommandPool() {
 	QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
 
@@ -669,6 +1977,10 @@ void Context::createCommandPool() {
 
 	if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create command pool!");
+
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+	if (vkCreateCommandPool(device, &poolInfo, nullptr, &uploadCommandPool) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create command pool!");
 }
 
 void Context::createUniformBuffers() {
@@ -683,40 +1995,37 @@ void Context::createUniformBuffers() {
 	}
 }
 
-void Context::createDescriptorPool() {
-	std::array<VkDescriptorPoolSize, 3> poolSizes = {};
+void Context::createDescriptorPool(VkDescriptorPool &outPool) {
+	std::vector<VkDescriptorPoolSize> poolSizes(2);
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(swapchainImages.size());
+	poolSizes[0].descriptorCount = DESCRIPTOR_POOL_SIZE;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(swapchainImages.size());
-	poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[2].descriptorCount = static_cast<uint32_t>(swapchainImages.size());
+	poolSizes[1].descriptorCount = DESCRIPTOR_POOL_SIZE;
+	// Light and cluster buffers per set
+	VkDescriptorPoolSize storageSize = {};
+	storageSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	storageSize.descriptorCount = 2 * DESCRIPTOR_POOL_SIZE;
+	poolSizes.push_back(storageSize);
+	if (!bindlessEnabled) {
+		// Diffuse texture and normal map per set
+		VkDescriptorPoolSize samplerSize = {};
+		samplerSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		samplerSize.descriptorCount = 2 * DESCRIPTOR_POOL_SIZE;
+		poolSizes.push_back(samplerSize);
+	}
 
 	VkDescriptorPoolCreateInfo poolInfo = {};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(swapchainImages.size());
+	poolInfo.maxSets = DESCRIPTOR_POOL_SIZE;
 
-	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS)
+	if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &outPool) != VK_SUCCESS)
 		throw std::runtime_error("failed to create descriptor pool!");
 }
 
-void Context::allocateDescriptorSets() {
-	std::vector<VkDescriptorSetLayout> layouts(swapchainImages.size(), descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo = {};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(swapchainImages.size());
-	allocInfo.pSetLayouts = layouts.data();
-
-	descriptorSets.resize(swapchainImages.size());
-	if (vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()) != VK_SUCCESS)
-		throw std::runtime_error("Failed to allocate descriptor sets!");
-}
-
 void Context::allocateCommandBuffers() {
-	commandBuffers.resize(swapchainFramebuffers.size());
+	commandBuffers.resize(swapchainImages.size());
 
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -726,24 +2035,23 @@ void Context::allocateCommandBuffers() {
 
 	if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS)
 		throw std::runtime_error("Failed to allocate command buffers!");
+
+	recordedCommandBuffers.resize(commandBuffers.size());
 }
 
 void Context::createSyncObjects() {
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-	inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+	// Nothing was submitted yet, and the timeline starts out having reached 0
+	frameValues.assign(MAX_FRAMES_IN_FLIGHT, 0);
+	imageValues.assign(swapchainImages.size(), 0);
 
 	VkSemaphoreCreateInfo semaphoreInfo = {};
 	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
 
-	VkFenceCreateInfo fenceInfo = {};
-	fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-	fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-
 	for (auto i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 		if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS
-			|| vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS
-			|| vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i])) {
+			|| vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 
 			throw std::runtime_error("Failed to create synchronization objects for a frame!");
 		}
@@ -754,16 +2062,25 @@ void Context::createSyncObjects() {
 void Context::cleanupSwapchain() {
 	vkDeviceWaitIdle(device);
 
-	vkDestroyImageView(device, depthImageView, nullptr);
-	vkDestroyImage(device, depthImage, nullptr);
-	vkFreeMemory(device, depthImageMemory, nullptr);
+	// Holds the swapchain images and every swapchain-sized target, the next frame builds it again
+	delete frameGraph;
+	frameGraph = nullptr;
 
-	for (auto framebuffer : swapchainFramebuffers)
-		vkDestroyFramebuffer(device, framebuffer, nullptr);
+	cleanupHiZResources();
 
-	vkDestroyPipeline(device, graphicsPipeline, nullptr);
-	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	if (hiZSupported) {
+		vkDestroyImageView(device, depthImageView, nullptr);
+		vkDestroyImage(device, depthImage, nullptr);
+		vkFreeMemory(device, depthImageMemory, nullptr);
+	}
+
+	// Pipelines are built for render passes of the old swapchain format, the next frames compile them again
+	destroyMaterialPipelines();
+	vkDestroyPipeline(device, depthPrePassPipeline, nullptr);
+	if (dynamicResolutionSupported)
+		vkDestroyPipeline(device, upscalePipeline, nullptr);
 	vkDestroyRenderPass(device, renderPass, nullptr);
+	vkDestroyRenderPass(device, upscaleRenderPass, nullptr);
 
 	for (auto imageView : swapchainImageViews)
 		vkDestroyImageView(device, imageView, nullptr);
@@ -771,27 +2088,114 @@ void Context::cleanupSwapchain() {
 	vkDestroySwapchainKHR(device, swapchain, nullptr);
 }
 
+void Context::cleanupHiZResources() {
+	if (!hiZSupported) return;
+
+	destroyCullBuffers();
+
+	vkDestroyDescriptorPool(device, hiZDescriptorPool, nullptr);
+	vkDestroySampler(device, depthPyramidSampler, nullptr);
+
+	for (auto imageView : depthPyramidLevelViews)
+		vkDestroyImageView(device, imageView, nullptr);
+	vkDestroyImageView(device, depthPyramidView, nullptr);
+	vkDestroyImage(device, depthPyramid, nullptr);
+	vkFreeMemory(device, depthPyramidMemory, nullptr);
+}
+
+void Context::destroyCullBuffers() {
+	for (auto i = 0; i < swapchainImages.size(); ++i) {
+		vkDestroyBuffer(device, cullUniformBuffers[i], nullptr);
+		vkFreeMemory(device, cullUniformBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, cullDrawBuffers[i], nullptr);
+		vkFreeMemory(device, cullDrawBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, indirectBuffers[i], nullptr);
+		vkFreeMemory(device, indirectBufferMemories[i], nullptr);
+
+		vkDestroyBuffer(device, meshletDrawBuffers[i], nullptr);
+		vkFreeMemory(device, meshletDrawBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, meshletIndirectBuffers[i], nullptr);
+		vkFreeMemory(device, meshletIndirectBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, meshletIndexBuffers[i], nullptr);
+		vkFreeMemory(device, meshletIndexBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, meshletVisibilityBuffers[i], nullptr);
+		vkFreeMemory(device, meshletVisibilityBufferMemories[i], nullptr);
+	}
+}
+
 void Context::cleanup() {
 	cleanupSwapchain();
 
-	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+	if (shaderWatcher != nullptr)
+		delete shaderWatcher;
 
+	// Device is idle after the swapchain cleanup
+	flushDeletionQueue(true);
+
+	for (auto pool : descriptorPools)
+		vkDestroyDescriptorPool(device, pool, nullptr);
+
+	vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+	vkDestroyShaderModule(device, fragmentShaderModule, nullptr);
+	vkDestroyShaderModule(device, vertexShaderModule, nullptr);
+	vkDestroyShaderModule(device, depthShaderModule, nullptr);
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 	vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
+	if (bindlessEnabled) {
+		vkDestroyDescriptorPool(device, bindlessPool, nullptr);
+		vkDestroyDescriptorSetLayout(device, bindlessSetLayout, nullptr);
+	}
+
+	if (hiZSupported) {
+		vkDestroyPipeline(device, depthReducePipeline, nullptr);
+		vkDestroyPipeline(device, cullPipeline, nullptr);
+		vkDestroyPipelineLayout(device, depthReducePipelineLayout, nullptr);
+		vkDestroyPipelineLayout(device, cullPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, depthReduceSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, cullSetLayout, nullptr);
+
+		for (auto pool : meshletDescriptorPools)
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		vkDestroyPipeline(device, meshletCullPipeline, nullptr);
+		vkDestroyPipelineLayout(device, meshletCullPipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, meshletCullSetLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, meshletSetLayout, nullptr);
+	}
+
+	vkDestroyPipeline(device, lightCullPipeline, nullptr);
+	vkDestroyPipelineLayout(device, lightCullPipelineLayout, nullptr);
+	vkDestroyDescriptorPool(device, lightCullDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(device, lightCullSetLayout, nullptr);
+
+	if (dynamicResolutionSupported) {
+		vkDestroySampler(device, sceneColorSampler, nullptr);
+		vkDestroyPipelineLayout(device, upscalePipelineLayout, nullptr);
+		vkDestroyDescriptorPool(device, upscaleDescriptorPool, nullptr);
+		vkDestroyDescriptorSetLayout(device, upscaleSetLayout, nullptr);
+		vkDestroyQueryPool(device, timestampQueryPool, nullptr);
+	}
+
 	for (auto i = 0; i < swapchainImages.size(); ++i) {
 		vkDestroyBuffer(device, vertexUniformBuffers[i], nullptr);
 		vkFreeMemory(device, vertexUniformBufferMemories[i], nullptr);
 		vkDestroyBuffer(device, fragmentUniformBuffers[i], nullptr);
 		vkFreeMemory(device, fragmentUniformBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, lightBuffers[i], nullptr);
+		vkFreeMemory(device, lightBufferMemories[i], nullptr);
+		vkDestroyBuffer(device, clusterBuffers[i], nullptr);
+		vkFreeMemory(device, clusterBufferMemories[i], nullptr);
 	}
 
 	for (auto i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 		vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
 		vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-		vkDestroyFence(device, inFlightFences[i], nullptr);
 	}
 
+	// Destroying the pool frees the upload command buffers as well
+	vkDestroyCommandPool(device, uploadCommandPool, nullptr);
 	vkDestroyCommandPool(device, commandPool, nullptr);
+	delete timeline;
 
 	vkDestroyDevice(device, nullptr);
 }
@@ -806,29 +2210,533 @@ void Context::recreateSwapchain() {
 	createImageViews();
 	createDepthResources();
 	createRenderPass();
-	createGraphicsPipeline();
-	createFramebuffers();
+	createFallbackPipeline();
+	createDepthPrePassPipeline();
+	if (dynamicResolutionSupported)
+		createUpscalePipeline(upscalePipeline);
+	createHiZResources();
+
+	// Recorded buffers reference the old pipeline and frame graph
+	invalidateCommandBuffers();
+	hiZHistoryValid = false;
+	imageValues.assign(swapchainImages.size(), 0);
+}
+
+
+void Graphics::Context::updateDynamicResolution(uint32_t currentImage) {
+	if (!dynamicResolutionSupported) {
+		renderExtent = swapchainExtent;
+		return;
+	}
+
+	// The image's last frame was waited for, so its queries are done
+	if (timestampsWritten[currentImage]) {
+		std::array<uint64_t, 2> timestamps;
+		if (vkGetQueryPoolResults(device, timestampQueryPool, 2 * currentImage, 2, sizeof(timestamps), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+			gpuFrameTime = static_cast<float>(timestamps[1] - timestamps[0]) * timestampPeriod / 1e6f;
+			if (dynamicResolutionActive)
+				resolutionController.update(gpuFrameTime);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(resolutionSettingsMutex);
+		if (resolutionBoundsPending)
+			resolutionController.setBounds(pendingMinScale, pendingMaxScale);
+		if (targetFrameTimePending)
+			resolutionController.setTargetFrameTime(pendingTargetFrameTime);
+		resolutionBoundsPending = targetFrameTimePending = false;
+	}
+
+	bool enabled = dynamicResolutionEnabled;
+	if (dynamicResolutionActive != enabled) {
+		dynamicResolutionActive = enabled;
+		resolutionController.reset();
+	}
+
+	float scale = dynamicResolutionActive ? resolutionController.getScale() : 1.0f;
+	VkExtent2D extent = {
+		std::max(static_cast<uint32_t>(swapchainExtent.width * scale + 0.5f), 1u),
+		std::max(static_cast<uint32_t>(swapchainExtent.height * scale + 0.5f), 1u)
+	};
+
+	// The depth left behind covers a different part of the image
+	if (extent.width != renderExtent.width || extent.height != renderExtent.height) {
+		renderExtent = extent;
+		hiZHistoryValid = false;
+	}
+}
+
+void Graphics::Context::buildDrawList(uint32_t currentImage, Scene &scene) {
+	drawList.clear();
+	statistics = Statistics();
+
+	// Objects fully outside of the view never reach the command buffer
+	glm::mat4 projectionView = scene.camera.getProjectionViewMatrix();
+	visibleObjects.clear();
+	scene.cull(Frustum::fromMatrix(projectionView), visibleObjects);
+	statistics.culledObjects = static_cast<uint32_t>(scene.objects.size() - visibleObjects.size());
+
+	if (occlusionCullingEnabled)
+		cullOccludedObjects(projectionView, scene);
+	statistics.visibleObjects = static_cast<uint32_t>(visibleObjects.size());
+
+	unsortedDrawList.clear();
+	renderQueue.clear();
+	glm::vec3 cameraPosition = scene.camera.getPosition();
+	for (auto object : visibleObjects) {
+		DrawCommand command = {};
+		command.object = object;
+		command.transformRevision = scene.transforms.getRevision(object->transform);
+		command.descriptorSet = getDescriptorSet(currentImage, *object);
+		const MaterialPipeline &pipeline = getMaterialPipeline(object->material);
+		command.depthPrePass = depthPrePassActive && pipeline.equalDepthPipeline != VK_NULL_HANDLE;
+		command.pipeline = command.depthPrePass ? pipeline.equalDepthPipeline : pipeline.pipeline;
+		if (pipeline.pipeline == fallbackPipeline.pipeline && object->material != Material())
+			++statistics.fallbackDraws;
+		if (command.depthPrePass)
+			++statistics.depthPrePassDraws;
+		command.lod = selectLod(*object, scene);
+		statistics.triangles += object->mesh.getLod(command.lod).indexCount / 3;
+
+		// Descriptor sets hold the textures, so they group draws within a pipeline
+		BoundingSphere bounds = scene.transforms.getWorldBounds(object->transform);
+		float depth = glm::length(bounds.center - cameraPosition) - bounds.radius;
+		uint64_t key = RenderQueue::makeKey(RenderQueue::PASS_OPAQUE, pipeline.id,
+			RenderQueue::makeId(reinterpret_cast<uint64_t>(command.descriptorSet)),
+			RenderQueue::makeId(reinterpret_cast<uint64_t>(&object->mesh)), depth);
+		renderQueue.push(key, static_cast<uint32_t>(unsortedDrawList.size()));
+		unsortedDrawList.push_back(command);
+	}
+
+	// Opaque draws are grouped by state, then go front to back so closer ones fail fewer depth tests
+	renderQueue.sort();
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	const Mesh *boundMesh = nullptr;
+	VkDescriptorSet boundSet = VK_NULL_HANDLE;
+	for (const auto &item : renderQueue.getItems()) {
+		const DrawCommand &command = unsortedDrawList[item.index];
+		drawList.push_back(command);
+
+		if (command.pipeline != boundPipeline) {
+			boundPipeline = command.pipeline;
+			++statistics.pipelineBinds;
+		}
+
+		if (&command.object->mesh != boundMesh) {
+			boundMesh = &command.object->mesh;
+			++statistics.meshBinds;
+		}
+		if (command.descriptorSet != boundSet) {
+			boundSet = command.descriptorSet;
+			++statistics.materialBinds;
+		}
+	}
+}
+
+void Graphics::Context::cullOccludedObjects(const glm::mat4 &projectionView, Scene &scene) {
+	occlusionCuller.begin(projectionView);
+
+	bool hasOccluders = false;
+	for (auto object : visibleObjects) {
+		if (object->occluder) {
+			occlusionCuller.addOccluder(scene.transforms.getWorldMatrix(object->transform), object->mesh.getPositions(), object->mesh.getIndices());
+			hasOccluders = true;
+		}
+	}
+	if (!hasOccluders)
+		return;
+
+	occlusionCuller.rasterize();
+
+	// Occluders themselves are always drawn
+	auto hidden = std::remove_if(visibleObjects.begin(), visibleObjects.end(), [&](Object *object) {
+		return !object->occluder && !occlusionCuller.isVisible(AABB::fromSphere(scene.transforms.getWorldBounds(object->transform)));
+	});
+	statistics.occludedObjects = static_cast<uint32_t>(visibleObjects.end() - hidden);
+	visibleObjects.erase(hidden, visibleObjects.end());
 }
 
+uint32_t Graphics::Context::selectLod(Object &object, Scene &scene) {
+	const Mesh &mesh = object.mesh;
+	if (mesh.getLodCount() == 1)
+		return 0;
 
-void Graphics::Context::recordCommandBuffer(const VkCommandBuffer &buffer, uint32_t currentImage, Scene & scene) {
-	beginRenderPassBuffer(buffer, currentImage);
+	// Radius of the bounding sphere in pixels
+	BoundingSphere bounds = scene.transforms.getWorldBounds(object.transform);
+	float distance = glm::length(bounds.center - scene.camera.getPosition());
+	if (distance <= bounds.radius) {
+		object.lod = 0;
+		return 0;
+	}
+	float pixelsPerUnit = swapchainExtent.height * 0.5f / std::tan(glm::radians(scene.camera.getFOV()) * 0.5f);
+	float screenRadius = bounds.radius / distance * pixelsPerUnit;
+
+	// Errors are relative to the radius, so they project the same way
+	uint32_t lod = std::min(object.lod, static_cast<uint32_t>(mesh.getLodCount() - 1));
+	while (lod > 0 && mesh.getLod(lod).error * screenRadius > LOD_PIXEL_ERROR * (1.0f + LOD_HYSTERESIS))
+		--lod;
+	while (lod + 1 < mesh.getLodCount() && mesh.getLod(lod + 1).error * screenRadius < LOD_PIXEL_ERROR * (1.0f - LOD_HYSTERESIS))
+		++lod;
+
+	object.lod = lod;
+	return lod;
+}
 
-	VkBuffer vertexBuffers[] = { scene.object.mesh.vertexBuffer };
-	VkDeviceSize offsets[] = { 0 };
+void Graphics::Context::recordCommandBuffer(const VkCommandBuffer &buffer, uint32_t currentImage) {
+	beginCommandBuffer(buffer);
 
-	vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
-	vkCmdBindIndexBuffer(buffer, scene.object.mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
-	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentImage], 0, nullptr);
+	// Every image has its own pair of queries, so frames still in flight keep their results
+	if (dynamicResolutionSupported) {
+		vkCmdResetQueryPool(buffer, timestampQueryPool, 2 * currentImage, 2);
+		vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestampQueryPool, 2 * currentImage);
+	}
 
-	vkCmdDrawIndexed(buffer, static_cast<uint32_t>(scene.object.mesh.indexCount), 1, 0, 0, 0);
+	frameGraph->execute(buffer, currentImage);
 
-	vkCmdEndRenderPass(buffer);
+	if (dynamicResolutionSupported)
+		vkCmdWriteTimestamp(buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestampQueryPool, 2 * currentImage + 1);
 
 	if (vkEndCommandBuffer(buffer) != VK_SUCCESS)
 		throw std::runtime_error("Failed to record command buffer!");
 }
 
+void Graphics::Context::recordDraws(const VkCommandBuffer &buffer, const std::vector<DrawCommand> &drawList, const VkBuffer &indirectBuffer, uint32_t firstCommand, const VkBuffer &indexBuffer) {
+	// Same subpass, so the shading draws below see the pre-pass depth in submission order
+	recordDepthPrePass(buffer, drawList, indirectBuffer, firstCommand, indexBuffer);
+
+	// One set for all textures, individual draws only push their indices
+	if (bindlessEnabled)
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &bindlessSet, 0, nullptr);
+
+	// Culled draws read packed indices from one shared buffer
+	if (indexBuffer != VK_NULL_HANDLE)
+		vkCmdBindIndexBuffer(buffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	// The draw list is sorted by state, so consecutive draws often share their pipeline, buffers and set
+	VkPipeline boundPipeline = VK_NULL_HANDLE;
+	const Mesh *boundMesh = nullptr;
+	VkDescriptorSet boundSet = VK_NULL_HANDLE;
+	VkDeviceSize commandOffset = firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+	for (const auto &command : drawList) {
+		Object &object = *command.object;
+
+		if (command.pipeline != boundPipeline) {
+			vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipeline);
+			boundPipeline = command.pipeline;
+		}
+		if (&object.mesh != boundMesh) {
+			VkBuffer vertexBuffers[] = { object.mesh.vertexBuffer };
+			VkDeviceSize offsets[] = { 0 };
+
+			vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+			if (indexBuffer == VK_NULL_HANDLE)
+				vkCmdBindIndexBuffer(buffer, object.mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundMesh = &object.mesh;
+		}
+		if (command.descriptorSet != boundSet) {
+			vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &command.descriptorSet, 0, nullptr);
+			boundSet = command.descriptorSet;
+		}
+
+		// Both matrices were computed in bulk by the scene's transform store
+		DrawPushConstants pushConstants = {};
+		pushConstants.model = object.scene.transforms.getWorldMatrix(object.transform);
+		const glm::mat3x4 &normal = object.scene.transforms.getNormalMatrix(object.transform);
+		for (auto i = 0; i < 3; ++i)
+			pushConstants.normal[i] = normal[i];
+		pushConstants.diffuseTextureIndex = object.diffuseTexture.bindlessIndex;
+		pushConstants.normalMapIndex = object.normalMap.bindlessIndex;
+		vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+
+		// Culled indirect draws have an instance count of 0
+		if (indirectBuffer != VK_NULL_HANDLE) {
+			vkCmdDrawIndexedIndirect(buffer, indirectBuffer, commandOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
+			commandOffset += sizeof(VkDrawIndexedIndirectCommand);
+		} else {
+			const Mesh::Lod &lod = object.mesh.getLod(command.lod);
+			vkCmdDrawIndexed(buffer, lod.indexCount, 1, lod.firstIndex, 0, 0);
+		}
+	}
+}
+
+void Graphics::Context::recordDepthPrePass(const VkCommandBuffer &buffer, const std::vector<DrawCommand> &drawList, const VkBuffer &indirectBuffer, uint32_t firstCommand, const VkBuffer &indexBuffer) {
+	auto first = std::find_if(drawList.begin(), drawList.end(), [](const DrawCommand &command) { return command.depthPrePass; });
+	if (first == drawList.end())
+		return;
+
+	// Every set of a frame points at the same vertex uniforms, which are all the pre-pass reads
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, depthPrePassPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &first->descriptorSet, 0, nullptr);
+	if (indexBuffer != VK_NULL_HANDLE)
+		vkCmdBindIndexBuffer(buffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+	const Mesh *boundMesh = nullptr;
+	VkDeviceSize commandOffset = firstCommand * sizeof(VkDrawIndexedIndirectCommand);
+	for (const auto &command : drawList) {
+		if (!command.depthPrePass) {
+			commandOffset += sizeof(VkDrawIndexedIndirectCommand);
+			continue;
+		}
+		Object &object = *command.object;
+
+		if (&object.mesh != boundMesh) {
+			VkBuffer vertexBuffers[] = { object.mesh.positionBuffer };
+			VkDeviceSize offsets[] = { 0 };
+
+			vkCmdBindVertexBuffers(buffer, 0, 1, vertexBuffers, offsets);
+			if (indexBuffer == VK_NULL_HANDLE)
+				vkCmdBindIndexBuffer(buffer, object.mesh.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+			boundMesh = &object.mesh;
+		}
+
+		// Only the model matrix at the start of the draw constants is read
+		const glm::mat4 &model = object.scene.transforms.getWorldMatrix(object.transform);
+		vkCmdPushConstants(buffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(model), &model);
+
+		if (indirectBuffer != VK_NULL_HANDLE) {
+			vkCmdDrawIndexedIndirect(buffer, indirectBuffer, commandOffset, 1, sizeof(VkDrawIndexedIndirectCommand));
+			commandOffset += sizeof(VkDrawIndexedIndirectCommand);
+		} else {
+			const Mesh::Lod &lod = object.mesh.getLod(command.lod);
+			vkCmdDrawIndexed(buffer, lod.indexCount, 1, lod.firstIndex, 0, 0);
+		}
+	}
+}
+
+void Graphics::Context::recordDepthPyramid(const VkCommandBuffer &buffer) {
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipeline);
+
+	// Only the rendered part of the depth image is reduced, the rest of every level is left stale
+	DepthReducePushConstants pushConstants = {};
+	pushConstants.destinationSize = glm::ivec2(renderExtent.width, renderExtent.height);
+	for (uint32_t i = 0; i < depthReduceSets.size(); ++i) {
+		pushConstants.sourceSize = pushConstants.destinationSize;
+		pushConstants.destinationSize = i == 0
+			? (pushConstants.sourceSize + 1) / 2
+			: glm::max(pushConstants.sourceSize / 2, glm::ivec2(1));
+
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout, 0, 1, &depthReduceSets[i], 0, nullptr);
+		vkCmdPushConstants(buffer, depthReducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+		vkCmdDispatch(buffer, (pushConstants.destinationSize.x + 7) / 8, (pushConstants.destinationSize.y + 7) / 8, 1);
+
+		// The next level reads this one, the frame graph orders the culling pass after the last
+		if (i + 1 < depthReduceSets.size()) {
+			VkMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+		}
+	}
+}
+
+void Graphics::Context::recordCull(const VkCommandBuffer &buffer, uint32_t currentImage, uint32_t drawCount, uint32_t phase) {
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullSets[currentImage], 0, nullptr);
+
+	CullPushConstants pushConstants = {};
+	pushConstants.drawCount = drawCount;
+	pushConstants.phase = phase;
+	pushConstants.hasHistory = hiZHistoryValid ? 1 : 0;
+	vkCmdPushConstants(buffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDispatch(buffer, (drawCount + 63) / 64, 1, 1);
+}
+
+void Graphics::Context::recordMeshletCull(const VkCommandBuffer &buffer, uint32_t currentImage, const std::vector<DrawCommand> &drawList, uint32_t phase) {
+	if (drawList.empty())
+		return;
+	uint32_t drawCount = static_cast<uint32_t>(drawList.size());
+
+	// Meshlets add their indices to zeroed commands
+	if (phase == 0) {
+		vkCmdFillBuffer(buffer, meshletIndirectBuffers[currentImage], 0, 2 * drawCount * sizeof(VkDrawIndexedIndirectCommand), 0);
+
+		VkMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+		vkCmdPipelineBarrier(buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+	}
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshletCullPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshletCullPipelineLayout, 0, 1, &meshletCullSets[currentImage], 0, nullptr);
+
+	MeshletCullPushConstants pushConstants = {};
+	pushConstants.commandCount = drawCount;
+	pushConstants.phase = phase;
+	pushConstants.hiZ = hiZCullingActive ? 1 : 0;
+	pushConstants.hasHistory = hiZHistoryValid ? 1 : 0;
+
+	// Meshes keep their meshlets in buffers of their own, so draws of one mesh share a dispatch
+	// The render queue sorts draws by mesh, so with few meshes that's a handful of dispatches a frame
+	// One workgroup per meshlet slot, the shader finds the slot's draw by its first slot
+	uint32_t firstSlot = 0;
+	for (uint32_t first = 0; first < drawCount;) {
+		const Mesh &mesh = drawList[first].object->mesh;
+		uint32_t slotCount = 0, end = first;
+		for (; end < drawCount && &drawList[end].object->mesh == &mesh; ++end)
+			slotCount += mesh.getLod(drawList[end].lod).meshletCount;
+
+		pushConstants.firstDraw = first;
+		pushConstants.drawCount = end - first;
+		vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, meshletCullPipelineLayout, 1, 1, &mesh.meshletSet, 0, nullptr);
+
+		// Large runs are split to stay under the smallest workgroup count limit
+		for (uint32_t offset = 0; offset < slotCount; offset += MAX_DISPATCH_GROUPS) {
+			pushConstants.firstSlot = firstSlot + offset;
+			vkCmdPushConstants(buffer, meshletCullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pushConstants), &pushConstants);
+			vkCmdDispatch(buffer, std::min(slotCount - offset, MAX_DISPATCH_GROUPS), 1, 1);
+		}
+
+		firstSlot += slotCount;
+		first = end;
+	}
+}
+
+void Graphics::Context::recordUpscale(const VkCommandBuffer &buffer) {
+	glm::vec2 imageSize(swapchainExtent.width, swapchainExtent.height);
+	glm::vec2 renderSize(renderExtent.width, renderExtent.height);
+	UpscalePushConstants pushConstants = {};
+	pushConstants.uvScale = renderSize / imageSize;
+	pushConstants.uvMax = (renderSize - 0.5f) / imageSize;
+
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, upscalePipelineLayout, 0, 1, &upscaleSet, 0, nullptr);
+	vkCmdPushConstants(buffer, upscalePipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(pushConstants), &pushConstants);
+	vkCmdDraw(buffer, 3, 1, 0, 0);
+}
+
+void Graphics::Context::recordLightCull(const VkCommandBuffer &buffer, uint32_t currentImage) {
+	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, lightCullPipeline);
+	vkCmdBindDescriptorSets(buffer, VK_PIPELINE_BIND_POINT_COMPUTE, lightCullPipelineLayout, 0, 1, &lightCullSets[currentImage], 0, nullptr);
+	// The light count is read on the GPU, so the recording stays valid as lights come and go
+	vkCmdDispatch(buffer, (CLUSTER_COUNT + 63) / 64, 1, 1);
+}
+
+void Graphics::Context::updateCullBuffers(uint32_t currentImage, Scene &scene) {
+	// Every draw gets a range of meshlet slots and packed indices as large as its level of detail
+	size_t meshletCount = 0, indexCount = 0;
+	if (meshletCullingActive) {
+		for (const auto &command : drawList) {
+			const Mesh::Lod &lod = command.object->mesh.getLod(command.lod);
+			meshletCount += lod.meshletCount;
+			indexCount += lod.indexCount;
+		}
+	}
+
+	// Growing is rare enough that simply waiting for every frame to finish is fine
+	if (drawList.size() > cullDrawCapacity || meshletCount > meshletCullCapacity || indexCount > meshletCullIndexCapacity) {
+		timeline->wait(lastFrameValue);
+		destroyCullBuffers();
+		while (cullDrawCapacity < drawList.size())
+			cullDrawCapacity *= 2;
+		while (meshletCullCapacity < meshletCount)
+			meshletCullCapacity *= 2;
+		while (meshletCullIndexCapacity < indexCount)
+			meshletCullIndexCapacity *= 2;
+		createCullBuffers();
+		writeHiZDescriptorSets();
+		invalidateCommandBuffers();
+	}
+
+	CullUBO cullUBO = {};
+	cullUBO.projectionView = scene.camera.getProjectionViewMatrix();
+	cullUBO.previousProjectionView = previousProjectionView;
+	Frustum frustum = Frustum::fromMatrix(cullUBO.projectionView);
+	std::copy(std::begin(frustum.planes), std::end(frustum.planes), cullUBO.frustumPlanes);
+	cullUBO.viewportSize = glm::vec2(renderExtent.width, renderExtent.height);
+	cullUBO.levelCount = static_cast<int32_t>(depthPyramidLevelViews.size());
+	previousProjectionView = cullUBO.projectionView;
+
+	void* data;
+	vkMapMemory(device, cullUniformBufferMemories[currentImage], 0, sizeof(cullUBO), 0, &data);
+	memcpy(data, &cullUBO, sizeof(cullUBO));
+	vkUnmapMemory(device, cullUniformBufferMemories[currentImage]);
+
+	if (drawList.empty())
+		return;
+
+	if (meshletCullingActive) {
+		vkMapMemory(device, meshletDrawBufferMemories[currentImage], 0, drawList.size() * sizeof(MeshletCullDraw), 0, &data);
+		MeshletCullDraw *draws = static_cast<MeshletCullDraw *>(data);
+		uint32_t firstSlot = 0, firstIndex = 0;
+		for (const auto &command : drawList) {
+			const Object &object = *command.object;
+			const Mesh::Lod &lod = object.mesh.getLod(command.lod);
+			const glm::mat4 &model = scene.transforms.getWorldMatrix(object.transform);
+
+			// The normal matrix is the inverse-transpose, so its transpose takes directions back to model space
+			glm::mat3 inverse = glm::transpose(glm::mat3(scene.transforms.getNormalMatrix(object.transform)));
+			float scaleSquared = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+				std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+			draws->model = model;
+			draws->localCamera = glm::vec4(inverse * (scene.camera.getPosition() - glm::vec3(model[3])), std::sqrt(scaleSquared));
+			draws->firstMeshlet = lod.firstMeshlet;
+			draws->meshletCount = lod.meshletCount;
+			draws->firstSlot = firstSlot;
+			draws->firstIndex = firstIndex;
+			firstSlot += lod.meshletCount;
+			firstIndex += lod.indexCount;
+			++draws;
+		}
+		vkUnmapMemory(device, meshletDrawBufferMemories[currentImage]);
+		return;
+	}
+
+	vkMapMemory(device, cullDrawBufferMemories[currentImage], 0, drawList.size() * sizeof(CullDraw), 0, &data);
+	CullDraw *draws = static_cast<CullDraw *>(data);
+	for (const auto &command : drawList) {
+		BoundingSphere bounds = scene.transforms.getWorldBounds(command.object->transform);
+		const Mesh::Lod &lod = command.object->mesh.getLod(command.lod);
+		draws->sphere = glm::vec4(bounds.center, bounds.radius);
+		draws->indexCount = lod.indexCount;
+		draws->firstIndex = lod.firstIndex;
+		++draws;
+	}
+	vkUnmapMemory(device, cullDrawBufferMemories[currentImage]);
+}
+
+void Context::invalidateCommandBuffers() {
+	for (auto &recorded : recordedCommandBuffers)
+		recorded.valid = false;
+}
+
+void Context::deferDestruction(std::function<void()> &&destroy) {
+	// The frame being prepared may use the resource too, and its value is only known once it is submitted
+	std::lock_guard<std::mutex> lock(deletionMutex);
+	pendingDestructions.push_back(std::move(destroy));
+}
+
+void Context::deferDestruction(uint64_t value, std::function<void()> &&destroy) {
+	std::lock_guard<std::mutex> lock(deletionMutex);
+	deletionQueue.push_back({ value, std::move(destroy) });
+}
+
+void Context::flushDeletionQueue(bool deviceIdle) {
+	std::vector<std::function<void()>> destructions;
+	{
+		std::lock_guard<std::mutex> lock(deletionMutex);
+		if (deviceIdle) {
+			for (auto &destroy : pendingDestructions)
+				destructions.push_back(std::move(destroy));
+			pendingDestructions.clear();
+		}
+
+		// Values are mostly increasing, one that isn't only holds the ones behind it back a little
+		uint64_t completed = timeline->getCompletedValue();
+		while (!deletionQueue.empty() && (deviceIdle || deletionQueue.front().value <= completed)) {
+			destructions.push_back(std::move(deletionQueue.front().destroy));
+			deletionQueue.pop_front();
+		}
+	}
+
+	// Outside of the lock, so destructions may release further resources
+	for (auto &destroy : destructions)
+		destroy();
+}
+
 void Graphics::Context::updateDescriptorSet(const VkDescriptorSet & descriptorSet, uint32_t currentImage, Object & object) {
 	VkDescriptorBufferInfo vertexBufferInfo = {};
 	vertexBufferInfo.buffer = vertexUniformBuffers[currentImage];
@@ -840,6 +2748,16 @@ void Graphics::Context::updateDescriptorSet(const VkDescriptorSet & descriptorSe
 	fragmentBufferInfo.offset = 0;
 	fragmentBufferInfo.range = sizeof(FragmentUBO);
 
+	VkDescriptorBufferInfo lightBufferInfo = {};
+	lightBufferInfo.buffer = lightBuffers[currentImage];
+	lightBufferInfo.offset = 0;
+	lightBufferInfo.range = VK_WHOLE_SIZE;
+
+	VkDescriptorBufferInfo clusterBufferInfo = {};
+	clusterBufferInfo.buffer = clusterBuffers[currentImage];
+	clusterBufferInfo.offset = 0;
+	clusterBufferInfo.range = VK_WHOLE_SIZE;
+
 	VkDescriptorImageInfo diffuseTextureInfo = {};
 	diffuseTextureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 	diffuseTextureInfo.imageView = object.diffuseTexture.imageView;
@@ -850,7 +2768,7 @@ void Graphics::Context::updateDescriptorSet(const VkDescriptorSet & descriptorSe
 	normalMapInfo.imageView = object.normalMap.imageView;
 	normalMapInfo.sampler = object.normalMap.sampler;
 
-	std::array<VkWriteDescriptorSet, 4> descriptorWrites = {};
+	std::array<VkWriteDescriptorSet, 6> descriptorWrites = {};
 
 	descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[0].dstSet = descriptorSet;
@@ -870,33 +2788,211 @@ void Graphics::Context::updateDescriptorSet(const VkDescriptorSet & descriptorSe
 
 	descriptorWrites[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[2].dstSet = descriptorSet;
-	descriptorWrites[2].dstBinding = 2;
+	descriptorWrites[2].dstBinding = 4;
 	descriptorWrites[2].dstArrayElement = 0;
-	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	descriptorWrites[2].descriptorCount = 1;
-	descriptorWrites[2].pImageInfo = &diffuseTextureInfo;
+	descriptorWrites[2].pBufferInfo = &lightBufferInfo;
 
 	descriptorWrites[3].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
 	descriptorWrites[3].dstSet = descriptorSet;
-	descriptorWrites[3].dstBinding = 3;
+	descriptorWrites[3].dstBinding = 5;
 	descriptorWrites[3].dstArrayElement = 0;
-	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[3].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
 	descriptorWrites[3].descriptorCount = 1;
-	descriptorWrites[3].pImageInfo = &normalMapInfo;
+	descriptorWrites[3].pBufferInfo = &clusterBufferInfo;
+
+	descriptorWrites[4].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[4].dstSet = descriptorSet;
+	descriptorWrites[4].dstBinding = 2;
+	descriptorWrites[4].dstArrayElement = 0;
+	descriptorWrites[4].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[4].descriptorCount = 1;
+	descriptorWrites[4].pImageInfo = &diffuseTextureInfo;
+
+	descriptorWrites[5].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrites[5].dstSet = descriptorSet;
+	descriptorWrites[5].dstBinding = 3;
+	descriptorWrites[5].dstArrayElement = 0;
+	descriptorWrites[5].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrites[5].descriptorCount = 1;
+	descriptorWrites[5].pImageInfo = &normalMapInfo;
+
+	// Bindless mode has no per-set textures, only the buffers
+	uint32_t writeCount = bindlessEnabled ? 4 : static_cast<uint32_t>(descriptorWrites.size());
+	vkUpdateDescriptorSets(device, writeCount, descriptorWrites.data(), 0, nullptr);
+}
+
+VkDescriptorSet Context::getDescriptorSet(uint32_t currentImage, Object &object) {
+	DescriptorSetKey key = {};
+	key.vertexUniformBuffer = vertexUniformBuffers[currentImage];
+	key.fragmentUniformBuffer = fragmentUniformBuffers[currentImage];
+	if (!bindlessEnabled) {
+		key.diffuseImageView = object.diffuseTexture.imageView;
+		key.diffuseSampler = object.diffuseTexture.sampler;
+		key.normalMapImageView = object.normalMap.imageView;
+		key.normalMapSampler = object.normalMap.sampler;
+	}
+
+	auto it = descriptorSetCache.find(key);
+	if (it != descriptorSetCache.end())
+		return it->second;
+
+	// Only a never-before-seen combination of resources gets written
+	VkDescriptorSet descriptorSet = allocateDescriptorSet();
+	updateDescriptorSet(descriptorSet, currentImage, object);
+	descriptorSetCache.emplace(key, descriptorSet);
+
+	return descriptorSet;
+}
+
+VkDescriptorSet Context::allocateDescriptorSet() {
+	if (!freeDescriptorSets.empty()) {
+		VkDescriptorSet descriptorSet = freeDescriptorSets.back();
+		freeDescriptorSets.pop_back();
+		return descriptorSet;
+	}
+
+	VkDescriptorSetAllocateInfo allocInfo = {};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount = 1;
+	allocInfo.pSetLayouts = &descriptorSetLayout;
+
+	VkDescriptorSet descriptorSet;
+	if (!descriptorPools.empty()) {
+		allocInfo.descriptorPool = descriptorPools.back();
+		if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) == VK_SUCCESS)
+			return descriptorSet;
+	}
+
+	// The last pool is full (or there is none yet), grow by another one
+	descriptorPools.emplace_back();
+	createDescriptorPool(descriptorPools.back());
+
+	allocInfo.descriptorPool = descriptorPools.back();
+	if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate descriptor set!");
+
+	return descriptorSet;
+}
+
+void Context::forgetDescriptorSets(const Texture &texture) {
+	// Sets are recycled rather than freed, they get rewritten when handed out again
+	for (auto it = descriptorSetCache.begin(); it != descriptorSetCache.end();) {
+		const DescriptorSetKey &key = it->first;
+		if (key.diffuseImageView == texture.imageView || key.normalMapImageView == texture.imageView) {
+			// In-flight frames may still have the set bound
+			VkDescriptorSet descriptorSet = it->second;
+			deferDestruction([this, descriptorSet]() { freeDescriptorSets.push_back(descriptorSet); });
+			it = descriptorSetCache.erase(it);
+		} else
+			++it;
+	}
+}
+
+VkDescriptorSet Context::allocateMeshletSet(const Mesh &mesh) {
+	VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+	if (!freeMeshletSets.empty()) {
+		descriptorSet = freeMeshletSets.back();
+		freeMeshletSets.pop_back();
+	} else {
+		VkDescriptorSetAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+		allocInfo.descriptorSetCount = 1;
+		allocInfo.pSetLayouts = &meshletSetLayout;
+
+		if (!meshletDescriptorPools.empty()) {
+			allocInfo.descriptorPool = meshletDescriptorPools.back();
+			if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+				descriptorSet = VK_NULL_HANDLE;
+		}
+
+		// The last pool is full (or there is none yet), grow by another one
+		if (descriptorSet == VK_NULL_HANDLE) {
+			VkDescriptorPoolSize poolSize = {};
+			poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+			poolSize.descriptorCount = 2 * DESCRIPTOR_POOL_SIZE;
+
+			VkDescriptorPoolCreateInfo poolInfo = {};
+			poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+			poolInfo.poolSizeCount = 1;
+			poolInfo.pPoolSizes = &poolSize;
+			poolInfo.maxSets = DESCRIPTOR_POOL_SIZE;
+
+			meshletDescriptorPools.emplace_back();
+			if (vkCreateDescriptorPool(device, &poolInfo, nullptr, &meshletDescriptorPools.back()) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create meshlet descriptor pool!");
+
+			allocInfo.descriptorPool = meshletDescriptorPools.back();
+			if (vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS)
+				throw std::runtime_error("Failed to allocate meshlet descriptor set!");
+		}
+	}
+
+	std::array<VkDescriptorBufferInfo, 2> bufferInfos = {};
+	bufferInfos[0] = { mesh.meshletBuffer, 0, VK_WHOLE_SIZE };
+	bufferInfos[1] = { mesh.indexBuffer, 0, VK_WHOLE_SIZE };
+
+	std::array<VkWriteDescriptorSet, 2> descriptorWrites = {};
+	for (uint32_t i = 0; i < descriptorWrites.size(); ++i) {
+		descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[i].dstSet = descriptorSet;
+		descriptorWrites[i].dstBinding = i;
+		descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		descriptorWrites[i].descriptorCount = 1;
+		descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+	}
 
 	vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+
+	return descriptorSet;
+}
+
+void Context::releaseMeshletSet(const VkDescriptorSet &descriptorSet) {
+	// Recycled like the per-object sets, once no in-flight frame can have it bound
+	VkDescriptorSet set = descriptorSet;
+	deferDestruction([this, set]() { freeMeshletSets.push_back(set); });
+}
+
+uint32_t Context::registerBindlessTexture(const Texture &texture) {
+	uint32_t index;
+	if (!freeBindlessIndices.empty()) {
+		index = freeBindlessIndices.back();
+		freeBindlessIndices.pop_back();
+	} else if (bindlessTextureCount < bindlessCapacity) {
+		index = bindlessTextureCount++;
+	} else
+		throw std::runtime_error("Ran out of bindless texture slots!");
+
+	VkDescriptorImageInfo imageInfo = {};
+	imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	imageInfo.imageView = texture.imageView;
+	imageInfo.sampler = texture.sampler;
+
+	VkWriteDescriptorSet descriptorWrite = {};
+	descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	descriptorWrite.dstSet = bindlessSet;
+	descriptorWrite.dstBinding = 0;
+	descriptorWrite.dstArrayElement = index;
+	descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	descriptorWrite.descriptorCount = 1;
+	descriptorWrite.pImageInfo = &imageInfo;
+
+	vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+
+	return index;
+}
+
+void Context::releaseBindlessTexture(uint32_t index) {
+	// NOTE: the stale descriptor stays in the array until the slot is reused, which is fine as it's partially bound
+	// The slot is only handed out again once no in-flight frame can be reading it
+	deferDestruction([this, index]() { freeBindlessIndices.push_back(index); });
 }
 
 void Context::updateUniformBuffer(uint32_t currentImage, Scene &scene) {
 	scene.camera.setAspectRatio(((float)swapchainExtent.width) / swapchainExtent.height);
 	VertexUBO vertexUBO = {};
-	vertexUBO.modelViewProjection = scene.camera.getProjectionViewMatrix() * scene.object.getTransformationMatrix();
-	vertexUBO.model = scene.object.getTransformationMatrix();
-	vertexUBO.view = scene.camera.getViewMatrix();
-	vertexUBO.normal = glm::transpose(glm::inverse(glm::mat3(vertexUBO.model)));
-
-	vertexUBO.lightPosition = glm::vec4(scene.lightPosition, 1.0f);
-	vertexUBO.viewPosition = glm::vec4(scene.camera.getPosition(), 1.0f);
+	vertexUBO.projectionView = scene.camera.getProjectionViewMatrix();
 
 	void* data;
 	vkMapMemory(device, vertexUniformBufferMemories[currentImage], 0, sizeof(vertexUBO), 0, &data);
@@ -905,18 +3001,58 @@ void Context::updateUniformBuffer(uint32_t currentImage, Scene &scene) {
 
 
 	FragmentUBO fragmentUBO = {};
+	fragmentUBO.lightPosition = glm::vec4(scene.lightPosition, 1.0f);
 	fragmentUBO.lightColor = glm::vec4(scene.lightColor, 1.0f);
 	fragmentUBO.ambientColor = glm::vec4(scene.ambientColor, 1.0f);
+	fragmentUBO.viewPosition = glm::vec4(scene.camera.getPosition(), 1.0f);
+
+	glm::mat4 projection = scene.camera.getProjectionMatrix();
+	fragmentUBO.view = scene.camera.getViewMatrix();
+	fragmentUBO.projection = glm::vec4(projection[0][0], projection[1][1], Camera::NEAR_PLANE, Camera::FAR_PLANE);
+	fragmentUBO.viewportSize = glm::vec2(renderExtent.width, renderExtent.height);
+
+	// Slice = log(depth / near) / log(far / near) * slice count
+	float sliceScale = CLUSTER_GRID_Z / std::log(Camera::FAR_PLANE / Camera::NEAR_PLANE);
+	fragmentUBO.clusterDepth = glm::vec2(sliceScale, -std::log(Camera::NEAR_PLANE) * sliceScale);
 
 	vkMapMemory(device, fragmentUniformBufferMemories[currentImage], 0, sizeof(fragmentUBO), 0, &data);
 	memcpy(data, &fragmentUBO, sizeof(fragmentUBO));
 	vkUnmapMemory(device, fragmentUniformBufferMemories[currentImage]);
 }
 
+void Context::updateLightBuffer(uint32_t currentImage, Scene &scene) {
+	uint32_t lightCount = static_cast<uint32_t>(std::min<size_t>(scene.lights.size(), MAX_LIGHTS));
+	statistics.lights = lightCount;
+
+	void *data;
+	vkMapMemory(device, lightBufferMemories[currentImage], 0, sizeof(glm::vec4) + lightCount * sizeof(LightData), 0, &data);
+	memcpy(data, &lightCount, sizeof(lightCount));
+
+	LightData *lights = reinterpret_cast<LightData *>(static_cast<char *>(data) + sizeof(glm::vec4));
+	for (uint32_t i = 0; i < lightCount; ++i) {
+		const Light &light = scene.lights[i];
+		// The windowed falloff divides by the range
+		lights[i].position = glm::vec4(light.position, std::max(light.range, 1e-3f));
+
+		// The cone is clamp(dot(direction, -lightDir) * scale + offset), points are lit in every direction
+		float scale = 0.0f, offset = 1.0f;
+		glm::vec3 direction(0.0f);
+		if (light.type == Light::SPOT) {
+			float cosInner = std::cos(glm::radians(light.innerConeAngle));
+			float cosOuter = std::cos(glm::radians(light.outerConeAngle));
+			scale = 1.0f / std::max(cosInner - cosOuter, 1e-4f);
+			offset = -cosOuter * scale;
+			direction = glm::normalize(light.direction);
+		}
+		lights[i].color = glm::vec4(light.color, scale);
+		lights[i].direction = glm::vec4(direction, offset);
+	}
+
+	vkUnmapMemory(device, lightBufferMemories[currentImage]);
+}
 
-void Context::transitionImageLayout(const VkImage &image, const VkFormat &format, const VkImageLayout &oldLayout, const VkImageLayout &newLayout) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
 
+void Context::transitionImageLayout(const VkImage &image, const VkFormat &format, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, uint32_t mipLevels) {
 	VkImageMemoryBarrier barrier = {};
 	barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
 	barrier.oldLayout = oldLayout;
@@ -926,7 +3062,7 @@ void Context::transitionImageLayout(const VkImage &image, const VkFormat &format
 	barrier.image = image;
 	barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	barrier.subresourceRange.baseMipLevel = 0;
-	barrier.subresourceRange.levelCount = 1;
+	barrier.subresourceRange.levelCount = mipLevels;
 	barrier.subresourceRange.baseArrayLayer = 0;
 	barrier.subresourceRange.layerCount = 1;
 
@@ -951,6 +3087,12 @@ void Context::transitionImageLayout(const VkImage &image, const VkFormat &format
 
 		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
 		destinationStage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	} else if (oldLayout == VK_IMAGE_LAYOUT_UNDEFINED && newLayout == VK_IMAGE_LAYOUT_GENERAL) {
+		barrier.srcAccessMask = 0;
+		barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+
+		sourceStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+		destinationStage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
 	} else {
 		throw std::invalid_argument("Unsupported layout transition!");
 	}
@@ -964,16 +3106,16 @@ void Context::transitionImageLayout(const VkImage &image, const VkFormat &format
 		barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 	}
 
-	vkCmdPipelineBarrier(
-		commandBuffer,
-		sourceStage, destinationStage,
-		0,
-		0, nullptr,
-		0, nullptr,
-		1, &barrier
-	);
-
-	endSingleTimeCommands(commandBuffer);
+	submitSingleTimeCommands([&](const VkCommandBuffer &commandBuffer) {
+		vkCmdPipelineBarrier(
+			commandBuffer,
+			sourceStage, destinationStage,
+			0,
+			0, nullptr,
+			0, nullptr,
+			1, &barrier
+		);
+	});
 }
 
 std::vector<VkPhysicalDevice> Context::getPhysicalDevices() {
@@ -1025,13 +3167,17 @@ bool Context::checkValidationLayerSupport() {
 }
 
 bool Context::checkDeviceExtensionSupport(const VkPhysicalDevice &device) {
+	return checkDeviceExtensionSupport(device, DEVICE_EXTENSIONS);
+}
+
+bool Context::checkDeviceExtensionSupport(const VkPhysicalDevice &device, const std::vector<const char *> &extensions) {
 	uint32_t extensionCount;
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
 
 	std::vector<VkExtensionProperties> availableExtensions(extensionCount);
 	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, availableExtensions.data());
 
-	std::set<std::string> requiredExtensions(DEVICE_EXTENSIONS.begin(), DEVICE_EXTENSIONS.end());
+	std::set<std::string> requiredExtensions(extensions.begin(), extensions.end());
 
 	for (const auto& extension : availableExtensions) {
 		requiredExtensions.erase(extension.extensionName);
@@ -1040,6 +3186,61 @@ bool Context::checkDeviceExtensionSupport(const VkPhysicalDevice &device) {
 	return requiredExtensions.empty();
 }
 
+bool Context::checkBindlessSupport(const VkPhysicalDevice &device) {
+	if (getPhysicalDeviceFeatures2 == nullptr || getPhysicalDeviceProperties2 == nullptr) return false;
+	if (getDeviceProperties(device).apiVersion < VK_API_VERSION_1_1) return false;
+	if (!checkDeviceExtensionSupport(device, BINDLESS_DEVICE_EXTENSIONS)) return false;
+
+	VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexingFeatures = {};
+	indexingFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &indexingFeatures;
+	getPhysicalDeviceFeatures2(device, &features);
+
+	return features.features.shaderSampledImageArrayDynamicIndexing
+		&& indexingFeatures.runtimeDescriptorArray
+		&& indexingFeatures.descriptorBindingPartiallyBound
+		&& indexingFeatures.descriptorBindingSampledImageUpdateAfterBind
+		&& indexingFeatures.descriptorBindingUpdateUnusedWhilePending;
+}
+
+bool Context::checkTimelineSemaphoreSupport(const VkPhysicalDevice &device) {
+	if (getPhysicalDeviceFeatures2 == nullptr) return false;
+	if (getDeviceProperties(device).apiVersion < VK_API_VERSION_1_1) return false;
+	if (!checkDeviceExtensionSupport(device, TIMELINE_DEVICE_EXTENSIONS)) return false;
+
+	VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+	timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+	VkPhysicalDeviceFeatures2 features = {};
+	features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	features.pNext = &timelineFeatures;
+	getPhysicalDeviceFeatures2(device, &features);
+
+	return timelineFeatures.timelineSemaphore;
+}
+
+uint32_t Context::getBindlessCapacity(const VkPhysicalDevice &device) {
+	VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexingProperties = {};
+	indexingProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+
+	VkPhysicalDeviceProperties2 properties = {};
+	properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+	properties.pNext = &indexingProperties;
+	getPhysicalDeviceProperties2(device, &properties);
+
+	// Combined image samplers count against both sampler and sampled image limits
+	return std::min({
+		MAX_BINDLESS_TEXTURES,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSamplers,
+		indexingProperties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSamplers,
+		indexingProperties.maxDescriptorSetUpdateAfterBindSampledImages
+	});
+}
+
 
 Context::QueueFamilyIndices Context::findQueueFamilies(const VkPhysicalDevice &device) {
 	QueueFamilyIndices indices;
@@ -1104,6 +3305,19 @@ VkSurfaceFormatKHR Context::chooseSwapSurfaceFormat(const std::vector<VkSurfaceF
 }
 
 VkPresentModeKHR Context::chooseSwapPresentMode(const std::vector<VkPresentModeKHR> &availablePresentModes) {
+	if (swapchainPresentMode != PRESENT_AUTO) {
+		VkPresentModeKHR mode = VK_PRESENT_MODE_FIFO_KHR;
+		if (swapchainPresentMode == PRESENT_MAILBOX)
+			mode = VK_PRESENT_MODE_MAILBOX_KHR;
+		else if (swapchainPresentMode == PRESENT_IMMEDIATE)
+			mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+
+		// FIFO is the only mode every device has to support
+		if (std::find(availablePresentModes.begin(), availablePresentModes.end(), mode) != availablePresentModes.end())
+			return mode;
+		return VK_PRESENT_MODE_FIFO_KHR;
+	}
+
 	// Some drivers don't properly support FIFO PM, so we replace fallback with Immediate if it's available
 	VkPresentModeKHR bestMode = VK_PRESENT_MODE_FIFO_KHR;
 
@@ -1166,40 +3380,53 @@ VkFormat Context::findSupportedFormat(const std::vector<VkFormat> &candidates, c
 	throw std::runtime_error("Failed to find supported format!");
 }
 
-VkCommandBuffer Context::beginSingleTimeCommands() {
+uint64_t Context::submitSingleTimeCommands(const std::function<void(const VkCommandBuffer &)> &record) {
+	std::lock_guard<std::mutex> lock(uploadMutex);
+
+	// Nothing waits for uploads to finish, so finished ones are freed on the next upload
+	while (!uploadCommandBuffers.empty() && timeline->isComplete(uploadCommandBuffers.front().first)) {
+		vkFreeCommandBuffers(device, uploadCommandPool, 1, &uploadCommandBuffers.front().second);
+		uploadCommandBuffers.pop_front();
+	}
+
 	VkCommandBufferAllocateInfo allocInfo = {};
 	allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
 	allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-	allocInfo.commandPool = commandPool;
+	allocInfo.commandPool = uploadCommandPool;
 	allocInfo.commandBufferCount = 1;
 
 	VkCommandBuffer commandBuffer;
-	vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
+	if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer) != VK_SUCCESS)
+		throw std::runtime_error("Failed to allocate upload command buffer!");
 
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-	vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-	return commandBuffer;
-}
-
-void Context::endSingleTimeCommands(const VkCommandBuffer &commandBuffer) {
-	vkEndCommandBuffer(commandBuffer);
-
 	VkSubmitInfo submitInfo = {};
 	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 	submitInfo.commandBufferCount = 1;
 	submitInfo.pCommandBuffers = &commandBuffer;
 
-	vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-	vkQueueWaitIdle(graphicsQueue);
+	uint64_t value;
+	try {
+		vkBeginCommandBuffer(commandBuffer, &beginInfo);
+		record(commandBuffer);
+		vkEndCommandBuffer(commandBuffer);
+
+		value = timeline->submit(graphicsQueue, submitInfo);
+	} catch (...) {
+		// Never submitted, so nothing else references it
+		vkFreeCommandBuffers(device, uploadCommandPool, 1, &commandBuffer);
+		throw;
+	}
 
-	vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+	uploadCommandBuffers.push_back({ value, commandBuffer });
+	uploadValue = value;
+	return value;
 }
 
-void Graphics::Context::beginRenderPassBuffer(const VkCommandBuffer &buffer, uint32_t currentImage) {
+void Graphics::Context::beginCommandBuffer(const VkCommandBuffer &buffer) {
 	VkCommandBufferBeginInfo beginInfo = {};
 	beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 	beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
@@ -1207,25 +3434,6 @@ void Graphics::Context::beginRenderPassBuffer(const VkCommandBuffer &buffer, uin
 
 	if (vkBeginCommandBuffer(buffer, &beginInfo) != VK_SUCCESS)
 		throw std::runtime_error("Failed to begin recording command buffer!");
-
-	VkRenderPassBeginInfo renderPassInfo = {};
-	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-	renderPassInfo.renderPass = renderPass;
-	renderPassInfo.framebuffer = swapchainFramebuffers[currentImage];
-	renderPassInfo.renderArea.offset = { 0, 0 };
-	renderPassInfo.renderArea.extent = swapchainExtent;
-
-	std::array<VkClearValue, 2> clearValues = {};
-	clearValues[0].color = { 0.0f, 0.0f, 0.0f, 1.0f };
-	clearValues[1].depthStencil = { 1.0f, 0 };
-
-	renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
-	renderPassInfo.pClearValues = clearValues.data();
-
-
-	vkCmdBeginRenderPass(buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-	vkCmdBindPipeline(buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
 }
 
 
@@ -1243,15 +3451,15 @@ VkShaderModule Context::createShaderModule(const std::vector<char> &code) {
 	return shaderModule;
 }
 
-VkImageView Context::createImageView(const VkImage &image, const VkFormat &format, const VkImageAspectFlags &aspectFlags) {
+VkImageView Context::createImageView(const VkImage &image, const VkFormat &format, const VkImageAspectFlags &aspectFlags, uint32_t baseMipLevel, uint32_t levelCount) {
 	VkImageViewCreateInfo viewInfo = {};
 	viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
 	viewInfo.image = image;
 	viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
 	viewInfo.format = format;
 	viewInfo.subresourceRange.aspectMask = aspectFlags;
-	viewInfo.subresourceRange.baseMipLevel = 0;
-	viewInfo.subresourceRange.levelCount = 1;
+	viewInfo.subresourceRange.baseMipLevel = baseMipLevel;
+	viewInfo.subresourceRange.levelCount = levelCount;
 	viewInfo.subresourceRange.baseArrayLayer = 0;
 	viewInfo.subresourceRange.layerCount = 1;
 
@@ -1298,7 +3506,8 @@ void Context::createImage(
 	const VkImageTiling & tiling,
 	const VkImageUsageFlags & usage,
 	const VkMemoryPropertyFlags & properties,
-	VkImage & outImage, VkDeviceMemory & outImageMemory) {
+	VkImage & outImage, VkDeviceMemory & outImageMemory,
+	uint32_t mipLevels) {
 
 	VkImageCreateInfo imageInfo = {};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1306,7 +3515,7 @@ void Context::createImage(
 	imageInfo.extent.width = width;
 	imageInfo.extent.height = height;
 	imageInfo.extent.depth = 1;
-	imageInfo.mipLevels = 1;
+	imageInfo.mipLevels = mipLevels;
 	imageInfo.arrayLayers = 1;
 	imageInfo.format = format;
 	imageInfo.tiling = tiling;
@@ -1332,19 +3541,16 @@ void Context::createImage(
 	vkBindImageMemory(device, outImage, outImageMemory, 0);
 }
 
-void Context::copyBuffer(const VkBuffer &srcBuffer, const VkBuffer &dstBuffer, const VkDeviceSize &size) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+uint64_t Context::copyBuffer(const VkBuffer &srcBuffer, const VkBuffer &dstBuffer, const VkDeviceSize &size) {
 	VkBufferCopy copyRegion = {};
 	copyRegion.size = size;
-	vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
 
-	endSingleTimeCommands(commandBuffer);
+	return submitSingleTimeCommands([&](const VkCommandBuffer &commandBuffer) {
+		vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
+	});
 }
 
-void Context::copyBufferToImage(const VkBuffer & buffer, const VkImage & image, uint32_t width, uint32_t height) {
-	VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
+uint64_t Context::copyBufferToImage(const VkBuffer & buffer, const VkImage & image, uint32_t width, uint32_t height) {
 	VkBufferImageCopy region = {};
 	region.bufferOffset = 0;
 	region.bufferRowLength = 0;
@@ -1362,16 +3568,39 @@ void Context::copyBufferToImage(const VkBuffer & buffer, const VkImage & image,
 		1
 	};
 
-	vkCmdCopyBufferToImage(
-		commandBuffer,
-		buffer,
-		image,
-		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-		1,
-		&region
-	);
+	return submitSingleTimeCommands([&](const VkCommandBuffer &commandBuffer) {
+		vkCmdCopyBufferToImage(
+			commandBuffer,
+			buffer,
+			image,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			1,
+			&region
+		);
+	});
+}
+
+void Context::releaseStagingBuffer(const VkBuffer &buffer, const VkDeviceMemory &memory, uint64_t value) {
+	VkBuffer stagingBuffer = buffer;
+	VkDeviceMemory stagingBufferMemory = memory;
+	deferDestruction(value, [this, stagingBuffer, stagingBufferMemory]() {
+		vkDestroyBuffer(device, stagingBuffer, nullptr);
+		vkFreeMemory(device, stagingBufferMemory, nullptr);
+	});
+}
+
+bool Context::DrawCommand::operator==(const DrawCommand &other) const {
+	return object == other.object && transformRevision == other.transformRevision && descriptorSet == other.descriptorSet && pipeline == other.pipeline
+		&& lod == other.lod && depthPrePass == other.depthPrePass;
+}
+
+bool Context::DrawCommand::operator!=(const DrawCommand &other) const {
+	return !(*this == other);
+}
 
-	endSingleTimeCommands(commandBuffer);
+bool Context::DescriptorSetKey::operator<(const DescriptorSetKey &other) const {
+	return std::tie(vertexUniformBuffer, fragmentUniformBuffer, diffuseImageView, diffuseSampler, normalMapImageView, normalMapSampler)
+		< std::tie(other.vertexUniformBuffer, other.fragmentUniformBuffer, other.diffuseImageView, other.diffuseSampler, other.normalMapImageView, other.normalMapSampler);
 }
 
 inline bool Context::hasStencilComponent(const VkFormat &format) {
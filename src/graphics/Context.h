@@ -6,19 +6,33 @@
 	A single file as the rest of the program is supposed to be API-agnostic (at least in hopeful future).
 */
 
+#include "OcclusionCuller.h"
+#include "RenderGraph.h"
+#include "RenderQueue.h"
+#include "ResolutionController.h"
 #include "Scene.h"
+#include "Timeline.h"
 #include "Vertex.h"
 
 #include "../File.h"
+#include "../FileWatcher.h"
 #include "../Window.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
+#include <deque>
+#include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <optional>
 #include <set>
 #include <stdexcept>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 namespace Graphics {
@@ -45,23 +59,220 @@ namespace Graphics {
 			std::vector<VkPresentModeKHR> presentModes;
 		};
 
+		// Per-frame data only, per-object transforms are pushed with each draw
 		struct VertexUBO {
-			glm::mat4 modelViewProjection;
-			glm::mat4 model;
-			glm::mat4 view;
-			glm::mat4 normal;
-
-			glm::vec4 lightPosition;
-			glm::vec4 viewPosition;
+			glm::mat4 projectionView;
 		};
 
+		// Read by the light culling pass as well, to build the clusters the fragments look up
 		struct FragmentUBO {
+			glm::vec4 lightPosition;
 			glm::vec4 lightColor;
 			glm::vec4 ambientColor;
+			glm::vec4 viewPosition;
+			glm::mat4 view;
+			// x and y scale of the projection, near and far plane
+			glm::vec4 projection;
+			glm::vec2 viewportSize;
+			// Scale and bias turning the log of a view depth into a depth slice
+			glm::vec2 clusterDepth;
+		};
+
+		// A local light as the shaders read it, the light buffer starts with the light count padded to 16 bytes
+		struct LightData {
+			// Range in w
+			glm::vec4 position;
+			// Spot cone scale in w
+			glm::vec4 color;
+			// Spot cone offset in w
+			glm::vec4 direction;
+		};
+
+		// Fragment shader specialization constants, in constant_id order
+		struct MaterialConstants {
+			VkBool32	normalMapping;
+			uint32_t	specularModel;
+			float		specularPower;
+			float		specularStrength;
+			VkBool32	alphaTest;
+			float		alphaCutoff;
+		};
+
+		// How a graphics pipeline treats depth
+		// The pre-pass lays down depth alone, the main pass after it only shades fragments with equal depth
+		enum DepthMode { DEPTH_DEFAULT, DEPTH_EQUAL, DEPTH_ONLY };
+
+		// A material permutation, id is small and unique for sort keys
+		// Pipelines are VK_NULL_HANDLE while a worker thread compiles them
+		struct MaterialPipeline {
+			VkPipeline	pipeline;
+			// Drawn after the depth pre-pass, null for alpha-tested materials as they skip the pre-pass
+			VkPipeline	equalDepthPipeline;
+			uint32_t	id;
+		};
+
+		// Pipelines finished on a worker thread, waiting for the render thread to pick them up
+		struct CompiledPipeline {
+			Material	material;
+			VkPipeline	pipeline;
+			VkPipeline	equalDepthPipeline;
+		};
+
+		// Everything a per-object descriptor set points at, sets are only written once per unique key
+		struct DescriptorSetKey {
+			VkBuffer		vertexUniformBuffer;
+			VkBuffer		fragmentUniformBuffer;
+			VkImageView		diffuseImageView;
+			VkSampler		diffuseSampler;
+			VkImageView		normalMapImageView;
+			VkSampler		normalMapSampler;
+
+			bool operator<(const DescriptorSetKey &) const;
+		};
+
+		// A single draw as it was recorded, used to detect when a command buffer is outdated
+		struct DrawCommand {
+			Object			*object;
+			uint32_t		transformRevision;
+			VkDescriptorSet	descriptorSet;
+			VkPipeline		pipeline;
+			uint32_t		lod;
+			// Drawn in the depth pre-pass as well
+			bool			depthPrePass;
+
+			bool operator==(const DrawCommand &) const;
+			bool operator!=(const DrawCommand &) const;
+		};
+
+		struct RecordedCommandBuffer {
+			bool						valid = false;
+			std::vector<DrawCommand>	drawList;
+			// Hi-Z buffers record a different pass structure
+			bool						hiZCulling = false;
+			bool						hiZHistory = false;
+			bool						meshletCulling = false;
+			bool						dynamicResolution = false;
+			VkExtent2D					renderExtent = {};
+		};
+
+		// A destruction that has to wait for the submissions that might still use the resource
+		struct DeferredDestruction {
+			// Timeline value of the last of them
+			uint64_t				value;
+			std::function<void()>	destroy;
+		};
+
+		// Per-draw data recorded inline into the command buffer
+		// NOTE: has to stay within the guaranteed 128 bytes of push constant space
+		struct DrawPushConstants {
+			glm::mat4 model;
+			// Normal matrix columns, padded the way std430 lays out a mat3
+			glm::vec4 normal[3];
+
+			uint32_t diffuseTextureIndex;
+			uint32_t normalMapIndex;
+		};
+
+		// Per-frame data of the Hi-Z culling pass
+		struct CullUBO {
+			glm::mat4 projectionView;
+			// The depth pyramid of the first phase was drawn with this
+			glm::mat4 previousProjectionView;
+			glm::vec4 frustumPlanes[Frustum::PLANE_COUNT];
+			glm::vec2 viewportSize;
+			int32_t levelCount;
+		};
+
+		// Per-draw input of the Hi-Z culling pass, laid out the way std430 pads it
+		struct CullDraw {
+			glm::vec4 sphere;
+			uint32_t indexCount;
+			uint32_t firstIndex;
+			uint32_t padding[2];
+		};
+
+		struct CullPushConstants {
+			uint32_t drawCount;
+			uint32_t phase;
+			uint32_t hasHistory;
+		};
+
+		// Per-draw input of the meshlet culling pass
+		struct MeshletCullDraw {
+			glm::mat4 model;
+			// Camera position in model space, largest axis scale of the model matrix in w
+			glm::vec4 localCamera;
+			uint32_t firstMeshlet;
+			uint32_t meshletCount;
+			// Start of the draw's meshlets in the visibility buffer
+			uint32_t firstSlot;
+			// Start of the draw's range in the packed index buffer
+			uint32_t firstIndex;
+		};
+
+		struct MeshletCullPushConstants {
+			// Draws of the dispatch, they share a mesh
+			uint32_t firstDraw;
+			uint32_t drawCount;
+			// Meshlet slot of the first workgroup
+			uint32_t firstSlot;
+			// Draws of the whole frame, second phase commands start after them
+			uint32_t commandCount;
+			uint32_t phase;
+			uint32_t hiZ;
+			uint32_t hasHistory;
+		};
+
+		struct DepthReducePushConstants {
+			glm::ivec2 sourceSize;
+			glm::ivec2 destinationSize;
+		};
+
+		struct UpscalePushConstants {
+			// Rendered part of the scene image in texture coordinates
+			glm::vec2 uvScale;
+			// Half a texel inside of it, so filtering never reads texels outside
+			glm::vec2 uvMax;
 		};
 
 
 	public:
+		/// How finished frames are handed to the display
+		/// Auto prefers mailbox, then immediate, and falls back to FIFO, which waits for vertical blank
+		enum PresentMode { PRESENT_AUTO, PRESENT_FIFO, PRESENT_MAILBOX, PRESENT_IMMEDIATE };
+
+		/// Counters of the last drawn frame
+		struct Statistics {
+			uint32_t visibleObjects = 0;
+			// Outside of the view frustum
+			uint32_t culledObjects = 0;
+			// Inside the frustum, but hidden behind occluders
+			uint32_t occludedObjects = 0;
+			// Of the chosen levels of detail, before any GPU culling
+			uint32_t triangles = 0;
+			// Pipeline binds of the sorted draw list, one per material in use
+			uint32_t pipelineBinds = 0;
+			// Drawn with the fallback pipeline while their own was still compiling
+			uint32_t fallbackDraws = 0;
+			// Drawn in the depth pre-pass before being shaded
+			uint32_t depthPrePassDraws = 0;
+			// Vertex and index buffer binds of the sorted draw list
+			uint32_t meshBinds = 0;
+			// Descriptor set binds of the sorted draw list
+			uint32_t materialBinds = 0;
+			// Local lights binned into clusters
+			uint32_t lights = 0;
+			// Of the last frame the GPU finished, in milliseconds, 0 where timestamps aren't supported
+			float gpuFrameTime = 0.0f;
+			// Share of the window's width and height the scene was rendered at
+			float resolutionScale = 1.0f;
+			// Passes of the frame graph, and the ones it dropped as nothing used their results
+			uint32_t framePasses = 0;
+			uint32_t culledFramePasses = 0;
+			// Memory of the images that only live during a frame, in bytes
+			uint64_t transientMemory = 0;
+		};
+
 		// ========================================================================
 		// ===								Functions							===
 		// ========================================================================
@@ -70,6 +281,55 @@ namespace Graphics {
 
 		void draw(Scene &object);
 
+		/// Wait until the next frame may start, for its frame slot to retire and then for the frame limiter
+		/// draw waits by itself, calling this first lets the caller sample input as late as possible before submitting
+		void waitForFrame();
+
+		/// Reuse recorded command buffers while the draw list stays the same (enabled by default)
+		/// Disabling re-records every frame
+		void setCommandBufferReuse(bool);
+
+		/// Skip objects hidden behind occluders (enabled by default)
+		void setOcclusionCulling(bool);
+
+		/// Test objects against a depth pyramid on the GPU (disabled by default)
+		/// Ignored on devices that can't sample the depth format
+		void setHiZCulling(bool);
+
+		/// Cull the meshlets of every draw on the GPU and draw only the triangles of visible ones (disabled by default)
+		/// Uses the depth pyramid too while Hi-Z culling is enabled, ignored where Hi-Z culling isn't supported
+		void setMeshletCulling(bool);
+
+		/// Lay down depth with a position-only pass first, so only the visible fragments are shaded (disabled by default)
+		/// Alpha-tested materials skip the pre-pass
+		void setDepthPrePass(bool);
+
+		/// Render the scene at a scale of the window that keeps the GPU frame time under the target, then upscale it (disabled by default)
+		/// Ignored on devices without graphics queue timestamps
+		void setDynamicResolution(bool);
+		/// Bounds of the scale along each axis, 0.5 to 1 by default
+		void setDynamicResolutionBounds(float minScale, float maxScale);
+		/// GPU time per frame dynamic resolution aims to stay under, in milliseconds (16.7 by default)
+		void setTargetFrameTime(float milliseconds);
+
+		/// Recompile changed shader sources in data/shaders and swap in the rebuilt pipelines (disabled by default)
+		/// Only Linux reports file changes for now
+		void setShaderHotReload(bool);
+
+		/// Frames the CPU may record ahead of the GPU, 1 to MAX_FRAMES_IN_FLIGHT (2 by default)
+		/// Fewer frames shorten the time from input to display at the cost of throughput
+		void setFramesInFlight(uint32_t);
+		/// Present mode of the swapchain, auto by default, unsupported modes fall back to FIFO
+		void setPresentMode(PresentMode);
+		/// Start frames no faster than the given rate, 0 disables the limiter (default)
+		void setFrameLimit(float framesPerSecond);
+
+		/// Statistics of the last frame drawn, safe from any thread
+		Statistics getStatistics() const;
+
+		/// Progress of every submission to the GPU, frames and uploads alike
+		Timeline &getTimeline();
+
 		static void initialize();
 		static void terminate();
 
@@ -78,10 +338,34 @@ namespace Graphics {
 		// ===								Constants							===
 		// ========================================================================
 
-		static const uint32_t MAX_FRAMES_IN_FLIGHT = 2;
+		static const uint32_t MAX_FRAMES_IN_FLIGHT = 3;
+		// Upper bound of the bindless texture array, further clamped by device limits
+		static const uint32_t MAX_BINDLESS_TEXTURES = 4096;
+		// Number of sets each descriptor pool can hold before another one is created
+		static const uint32_t DESCRIPTOR_POOL_SIZE = 64;
+		// Initial number of draws the Hi-Z culling buffers can hold, grown when exceeded
+		static const uint32_t HIZ_DRAW_CAPACITY = 256;
+		// Initial number of meshlets and packed indices the meshlet culling buffers can hold, grown when exceeded
+		static const uint32_t MESHLET_CULL_CAPACITY = 4096;
+		static const uint32_t MESHLET_CULL_INDEX_CAPACITY = 1 << 18;
+		// Local lights the light buffers hold, further ones in the scene aren't drawn
+		static const uint32_t MAX_LIGHTS = 4096;
+		// Froxel grid the lights are binned into, has to match clusters.glsl
+		static const uint32_t CLUSTER_GRID_X = 16;
+		static const uint32_t CLUSTER_GRID_Y = 9;
+		static const uint32_t CLUSTER_GRID_Z = 24;
+		static const uint32_t CLUSTER_COUNT = CLUSTER_GRID_X * CLUSTER_GRID_Y * CLUSTER_GRID_Z;
+		// Bounds the shading cost of a pixel, further lights in a cluster are dropped
+		static const uint32_t MAX_LIGHTS_PER_CLUSTER = 128;
+		// Largest simplification error, in pixels, a level of detail may show on screen
+		static constexpr float LOD_PIXEL_ERROR = 1.0f;
+		// Share of LOD_PIXEL_ERROR the projected error has to move past before the level changes
+		static constexpr float LOD_HYSTERESIS = 0.25f;
 		static const bool VALIDATION_LAYERS_ENABLED;
 		static const std::vector<const char *> VALIDATION_LAYERS;
 		static const std::vector<const char *> DEVICE_EXTENSIONS;
+		static const std::vector<const char *> BINDLESS_DEVICE_EXTENSIONS;
+		static const std::vector<const char *> TIMELINE_DEVICE_EXTENSIONS;
 		static const char * const APP_NAME;
 		static const char * const ENGINE_NAME;
 		static const uint32_t APP_VERSION;;
@@ -96,8 +380,26 @@ namespace Graphics {
 		static bool initialized;
 		static VkInstance instance;
 		static VkDebugUtilsMessengerEXT callback;
+		// Vulkan 1.1 functions, loaded only when the loader supports 1.1 so 1.0 systems still start
+		// Without them bindless textures and timeline semaphores stay off
+		static PFN_vkGetPhysicalDeviceFeatures2 getPhysicalDeviceFeatures2;
+		static PFN_vkGetPhysicalDeviceProperties2 getPhysicalDeviceProperties2;
 
 		size_t							currentFrame = 0;
+		// Frame slots in use, the setting is applied by the render thread once every frame has retired
+		// Settings are written from the console thread, so they are atomic
+		uint32_t						framesInFlight = 2;
+		std::atomic<uint32_t>			framesInFlightSetting = { 2 };
+		// Whether waitForFrame already waited for the frame about to be drawn
+		bool							frameWaited = false;
+		std::atomic<float>				frameLimit = { 0.0f };
+		std::chrono::steady_clock::time_point nextFrameTime;
+
+		// Destructions waiting for the next frame to be submitted, they retire along with it
+		std::vector<std::function<void()>> pendingDestructions;
+		std::deque<DeferredDestruction>	deletionQueue;
+		// Resources are released from the thread that loads them as well as the render thread
+		std::mutex						deletionMutex;
 
 		VkPhysicalDevice				physicalDevice;
 		VkDevice						device;
@@ -108,31 +410,189 @@ namespace Graphics {
 		VkQueue							presentQueue;
 
 		VkSwapchainKHR					swapchain;
+		// The swapchain is recreated when the setting no longer matches the one it was created with
+		std::atomic<PresentMode>		presentModeSetting = { PRESENT_AUTO };
+		PresentMode						swapchainPresentMode = PRESENT_AUTO;
 		VkFormat						swapchainImageFormat;
 		VkExtent2D						swapchainExtent;
 		std::vector<VkImage>			swapchainImages;
 		std::vector<VkImageView>		swapchainImageViews;
-		std::vector<VkFramebuffer>		swapchainFramebuffers;
 
+		// Only for creating pipelines, the frame graph begins compatible passes of its own
 		VkRenderPass					renderPass;
 		VkDescriptorSetLayout			descriptorSetLayout;
-		VkDescriptorPool				descriptorPool;
-		std::vector<VkDescriptorSet>	descriptorSets;
+		// Long-lived sets, allocated on first use and reused while their resources stay the same
+		// There are no per-frame pools: the light, culling and upscale sets are written once per swapchain image,
+		// and reused command buffers keep them bound, so resetting a pool every frame would force a re-record
+		std::vector<VkDescriptorPool>	descriptorPools;
+		std::map<DescriptorSetKey, VkDescriptorSet> descriptorSetCache;
+		std::vector<VkDescriptorSet>	freeDescriptorSets;
 		VkPipelineLayout				pipelineLayout;
-		VkPipeline						graphicsPipeline;
+		VkShaderModule					vertexShaderModule;
+		VkShaderModule					fragmentShaderModule;
+		VkShaderModule					depthShaderModule;
+		// Reads only the meshes' position buffers and has no fragment shader
+		VkPipeline						depthPrePassPipeline;
+		// Set from the console thread, copied to the active flag at the start of each frame
+		std::atomic<bool>				depthPrePassEnabled = { false };
+		bool							depthPrePassActive = false;
+		// Every material permutation seen with the current swapchain, compiled in the background on first use
+		std::unordered_map<Material, MaterialPipeline> materialPipelines;
+		// The default material, compiled up front and drawn in place of pipelines that aren't ready yet
+		MaterialPipeline				fallbackPipeline;
+		std::mutex						compiledPipelinesMutex;
+		std::condition_variable			compiledPipelinesCondition;
+		// Both guarded by compiledPipelinesMutex
+		std::vector<CompiledPipeline>	compiledPipelines;
+		uint32_t						compilingPipelineCount = 0;
+		// Watches the shader directory while hot reload is enabled, owned by the render thread
+		// Set from the console thread, cleared by the render thread if the directory can't be watched
+		std::atomic<bool>				shaderHotReloadEnabled = { false };
+		FileWatcher						*shaderWatcher = nullptr;
+		// Lets the driver reuse compiled shaders, pipelines are recompiled quickly after a resize
+		VkPipelineCache					pipelineCache;
+
+		// Bindless mode keeps every texture in one descriptor array and selects them with push constants
+		bool							bindlessEnabled = false;
+		uint32_t						bindlessCapacity = 0;
+		uint32_t						bindlessTextureCount = 0;
+		std::vector<uint32_t>			freeBindlessIndices;
+		VkDescriptorSetLayout			bindlessSetLayout;
+		VkDescriptorPool				bindlessPool;
+		VkDescriptorSet					bindlessSet;
 
 		VkCommandPool					commandPool;
 		std::vector<VkCommandBuffer>	commandBuffers;
-
+		// What each swapchain image's command buffer currently contains
+		std::vector<RecordedCommandBuffer> recordedCommandBuffers;
+		std::vector<DrawCommand>		drawList;
+		// Draws in the order they were culled, drawList holds them sorted by the render queue
+		std::vector<DrawCommand>		unsortedDrawList;
+		RenderQueue						renderQueue;
+		std::vector<Object *>			visibleObjects;
+		OcclusionCuller					occlusionCuller;
+		// Set from the console thread
+		std::atomic<bool>				occlusionCullingEnabled = { true };
+		// Set from the console thread
+		std::atomic<bool>				commandBufferReuseEnabled = { true };
+		// Filled in while drawing, then copied for getStatistics once the frame's numbers are complete
+		Statistics						statistics;
+		Statistics						publishedStatistics;
+		mutable std::mutex				statisticsMutex;
+
+		// The passes of a frame, rebuilt when the features deciding them change
+		RenderGraph						*frameGraph = nullptr;
+		// Features the frame graph was built for
+		bool							frameGraphHiZ = false;
+		bool							frameGraphMeshlets = false;
+		bool							frameGraphUpscale = false;
+
+		VkFormat						depthFormat;
+		// Hi-Z culling keeps the depth of the last frame, without it depth is a transient image of the frame graph
 		VkImage							depthImage;
 		VkDeviceMemory					depthImageMemory;
 		VkImageView						depthImageView;
 
+		// Dynamic resolution renders the scene into a swapchain-sized transient image, but only a scaled part of it
+		// The upscale pass then stretches that part over the swapchain image
+		bool							dynamicResolutionSupported = false;
+		// Set from the console thread
+		std::atomic<bool>				dynamicResolutionEnabled = { false };
+		bool							dynamicResolutionActive = false;
+		// Owned by the render thread, settings from other threads wait in the pending fields until the next frame
+		ResolutionController			resolutionController;
+		std::mutex						resolutionSettingsMutex;
+		float							pendingMinScale = 0.0f, pendingMaxScale = 0.0f, pendingTargetFrameTime = 0.0f;
+		bool							resolutionBoundsPending = false, targetFrameTimePending = false;
+		// Part of the depth and scene images that is rendered to, the whole swapchain extent without dynamic resolution
+		VkExtent2D						renderExtent = {};
+		// Start and end of every swapchain image's command buffer
+		VkQueryPool						timestampQueryPool;
+		// Nanoseconds per timestamp tick
+		float							timestampPeriod = 0.0f;
+		std::vector<bool>				timestampsWritten;
+		float							gpuFrameTime = 0.0f;
+		VkSampler						sceneColorSampler;
+		// Only for creating the upscale pipeline, which draws without depth
+		VkRenderPass					upscaleRenderPass;
+		VkDescriptorSetLayout			upscaleSetLayout;
+		VkPipelineLayout				upscalePipelineLayout;
+		VkPipeline						upscalePipeline;
+		VkDescriptorPool				upscaleDescriptorPool;
+		VkDescriptorSet					upscaleSet;
+
+		// Hi-Z culling draws in two phases, each culled by a compute pass against a depth pyramid
+		// The first phase tests against last frame's depth, the second against the depth of the first
+		bool							hiZSupported = false;
+		// Set from the console thread
+		std::atomic<bool>				hiZCullingEnabled = { false };
+		// Whether the current command buffers are recorded for Hi-Z
+		bool							hiZCullingActive = false;
+		// Whether the depth image holds a finished Hi-Z frame
+		bool							hiZHistoryValid = false;
+		glm::mat4						previousProjectionView;
+		VkDescriptorSetLayout			depthReduceSetLayout, cullSetLayout;
+		VkPipelineLayout				depthReducePipelineLayout, cullPipelineLayout;
+		VkPipeline						depthReducePipeline, cullPipeline;
+		VkImage							depthPyramid;
+		VkDeviceMemory					depthPyramidMemory;
+		VkImageView						depthPyramidView;
+		std::vector<VkImageView>		depthPyramidLevelViews;
+		VkExtent2D						depthPyramidExtent;
+		VkSampler						depthPyramidSampler;
+		VkDescriptorPool				hiZDescriptorPool;
+		// One set per pyramid level, then one per swapchain image
+		std::vector<VkDescriptorSet>	depthReduceSets, cullSets;
+		uint32_t						cullDrawCapacity = HIZ_DRAW_CAPACITY;
+		std::vector<VkBuffer>			cullUniformBuffers, cullDrawBuffers, indirectBuffers;
+		std::vector<VkDeviceMemory>		cullUniformBufferMemories, cullDrawBufferMemories, indirectBufferMemories;
+
+		// Meshlet culling replaces the per-draw test, visible triangles are packed into a separate index buffer
+		// Set from the console thread
+		std::atomic<bool>				meshletCullingEnabled = { false };
+		bool							meshletCullingActive = false;
+		// Per image buffers and pyramid, then per mesh meshlets and indices
+		VkDescriptorSetLayout			meshletCullSetLayout, meshletSetLayout;
+		VkPipelineLayout				meshletCullPipelineLayout;
+		VkPipeline						meshletCullPipeline;
+		std::vector<VkDescriptorSet>	meshletCullSets;
+		std::vector<VkDescriptorPool>	meshletDescriptorPools;
+		std::vector<VkDescriptorSet>	freeMeshletSets;
+		uint32_t						meshletCullCapacity = MESHLET_CULL_CAPACITY;
+		uint32_t						meshletCullIndexCapacity = MESHLET_CULL_INDEX_CAPACITY;
+		std::vector<VkBuffer>			meshletDrawBuffers, meshletIndirectBuffers, meshletIndexBuffers, meshletVisibilityBuffers;
+		std::vector<VkDeviceMemory>		meshletDrawBufferMemories, meshletIndirectBufferMemories, meshletIndexBufferMemories, meshletVisibilityBufferMemories;
+
 		std::vector<VkBuffer>			vertexUniformBuffers, fragmentUniformBuffers;
 		std::vector<VkDeviceMemory>		vertexUniformBufferMemories, fragmentUniformBufferMemories;
 
+		// Clustered lighting, a compute pass at the start of every frame lists the lights reaching each cluster
+		VkDescriptorSetLayout			lightCullSetLayout;
+		VkPipelineLayout				lightCullPipelineLayout;
+		VkPipeline						lightCullPipeline;
+		VkDescriptorPool				lightCullDescriptorPool;
+		// Per swapchain image, like the uniform buffers the main pass reads along with them
+		std::vector<VkDescriptorSet>	lightCullSets;
+		std::vector<VkBuffer>			lightBuffers, clusterBuffers;
+		std::vector<VkDeviceMemory>		lightBufferMemories, clusterBufferMemories;
+
 		std::vector<VkSemaphore>		imageAvailableSemaphores, renderFinishedSemaphores;
-		std::vector<VkFence>			inFlightFences;
+		// Uploads and frames signal the same timeline, on devices without timeline semaphores it keeps a fence per submission
+		bool							timelineSemaphoreEnabled = false;
+		Timeline						*timeline = nullptr;
+		// Timeline value of the last frame submitted from each frame slot, and of the last frame rendering to each swapchain image
+		std::vector<uint64_t>			frameValues;
+		std::vector<uint64_t>			imageValues;
+		// Waiting for it lets every frame retire while uploads keep going, unlike waiting for the device to idle
+		uint64_t						lastFrameValue = 0;
+		// Last upload submitted, the next frame waits for it
+		std::atomic<uint64_t>			uploadValue = { 0 };
+		// Uploads come from the loading thread and the render thread, so they record into a pool of their own
+		// Held while an upload is recorded and submitted
+		std::mutex						uploadMutex;
+		VkCommandPool					uploadCommandPool;
+		// Upload command buffers with their timeline values, freed once they have finished
+		std::deque<std::pair<uint64_t, VkCommandBuffer>> uploadCommandBuffers;
 
 		Window		&window;
 
@@ -167,31 +627,106 @@ namespace Graphics {
 		void createImageViews();
 		void createDepthResources();
 		void createRenderPass();
-		void createGraphicsPipeline();
-		void createFramebuffers();
+		void createPipelineCache();
+		void createShaderModules();
+		void createPipelineLayout();
+		/// Compile the graphics pipeline of one material permutation, safe to call from worker threads
+		/// The material is ignored for DEPTH_ONLY, which uses the depth shader alone
+		VkPipeline createGraphicsPipeline(const Material &material, DepthMode depthMode = DEPTH_DEFAULT);
+		void createFallbackPipeline();
+		void createDepthPrePassPipeline();
+		/// The material's pipeline, or the fallback one until a worker thread has compiled it
+		const MaterialPipeline &getMaterialPipeline(const Material &material);
+		/// Compile the material's pipeline on a worker thread, collectCompiledPipelines picks it up
+		void compileMaterialPipeline(const Material &material);
+		/// Start drawing with the pipelines that finished compiling since the last frame
+		void collectCompiledPipelines();
+		void waitForCompilingPipelines();
+		/// Wait for pipelines still compiling, then destroy every material's pipeline
+		void destroyMaterialPipelines();
+		/// Recompile changed shader sources, and rebuild the pipelines of changed binaries
+		void reloadChangedShaders();
+		/// Load the graphics shaders again and recompile every material in the background
+		void reloadGraphicsPipelines();
+		void reloadDepthPrePassPipeline();
+		/// Replace a compute pipeline once the frames using the old one have retired
+		void reloadComputePipeline(const char *shaderName, const VkPipelineLayout &layout, VkPipeline &pipeline);
+		void createComputePipeline(const char *shaderName, const VkPipelineLayout &layout, VkPipeline &outPipeline);
 
 		void createDescriptorSetLayout();
+		void createBindlessResources();
+		void createHiZPipelines();
+		void createHiZResources();
+		void createCullBuffers();
+		void writeHiZDescriptorSets();
+		void createLightCullPipeline();
+		void createLightResources();
+		void createTimestampQueries();
+		void createUpscalePipelineLayout();
+		void createUpscalePipeline(VkPipeline &outPipeline);
+		void reloadUpscalePipeline();
+		/// Declare and compile the passes of a frame for the active features
+		void buildFrameGraph();
 
 		void createCommandPool();
 		void allocateCommandBuffers();
 		void createUniformBuffers();
-		void createDescriptorPool();
-		void allocateDescriptorSets();
+		void createDescriptorPool(VkDescriptorPool &outPool);
 		void createSyncObjects();
 
 
 		void cleanupSwapchain();
+		void cleanupHiZResources();
+		void destroyCullBuffers();
 		void cleanup();
 
 		void recreateSwapchain();
 
 
-		void recordCommandBuffer(const VkCommandBuffer &commandBuffer, uint32_t currentImage, Scene &scene);
+		/// Read the GPU time of the image's last frame, and pick the render extent of the next one
+		void updateDynamicResolution(uint32_t currentImage);
+		void buildDrawList(uint32_t currentImage, Scene &scene);
+		/// Remove visible objects that are hidden behind visible occluders
+		void cullOccludedObjects(const glm::mat4 &projectionView, Scene &scene);
+		/// Pick the coarsest level of detail that looks the same at the object's screen size
+		uint32_t selectLod(Object &object, Scene &scene);
+		void recordCommandBuffer(const VkCommandBuffer &commandBuffer, uint32_t currentImage);
+		/// Draw directly, or with one indirect command per draw starting at firstCommand
+		/// indexBuffer replaces the meshes' own index buffers, for the indices packed by meshlet culling
+		void recordDraws(const VkCommandBuffer &commandBuffer, const std::vector<DrawCommand> &drawList, const VkBuffer &indirectBuffer = VK_NULL_HANDLE, uint32_t firstCommand = 0, const VkBuffer &indexBuffer = VK_NULL_HANDLE);
+		/// Draw the depth of every draw that takes part in the pre-pass, arguments are the same as recordDraws
+		void recordDepthPrePass(const VkCommandBuffer &commandBuffer, const std::vector<DrawCommand> &drawList, const VkBuffer &indirectBuffer, uint32_t firstCommand, const VkBuffer &indexBuffer);
+		void recordDepthPyramid(const VkCommandBuffer &commandBuffer);
+		void recordCull(const VkCommandBuffer &commandBuffer, uint32_t currentImage, uint32_t drawCount, uint32_t phase);
+		void recordMeshletCull(const VkCommandBuffer &commandBuffer, uint32_t currentImage, const std::vector<DrawCommand> &drawList, uint32_t phase);
+		/// Bin this frame's lights into clusters, before anything is shaded
+		void recordLightCull(const VkCommandBuffer &commandBuffer, uint32_t currentImage);
+		/// Stretch the rendered part of the scene image over the swapchain image
+		void recordUpscale(const VkCommandBuffer &commandBuffer);
+		/// Write this frame's draw bounds for the Hi-Z or meshlet culling pass, growing the buffers if needed
+		void updateCullBuffers(uint32_t currentImage, Scene &scene);
+		void invalidateCommandBuffers();
+
+		/// Run the function once every frame submitted up to now, and the one being prepared, has finished on the GPU
+		void deferDestruction(std::function<void()> &&destroy);
+		/// Run the function once the timeline has reached the value
+		void deferDestruction(uint64_t value, std::function<void()> &&destroy);
+		/// Destroy resources whose submissions have finished, or everything if the device is idle
+		void flushDeletionQueue(bool deviceIdle = false);
 		void updateDescriptorSet(const VkDescriptorSet &descriptorSet, uint32_t currentImage, Object &object);
+		VkDescriptorSet getDescriptorSet(uint32_t currentImage, Object &object);
+		VkDescriptorSet allocateDescriptorSet();
+		void forgetDescriptorSets(const Texture &);
+		VkDescriptorSet allocateMeshletSet(const Mesh &);
+		void releaseMeshletSet(const VkDescriptorSet &);
 		void updateUniformBuffer(uint32_t currentImage, Scene &object);
+		void updateLightBuffer(uint32_t currentImage, Scene &scene);
+
+		uint32_t registerBindlessTexture(const Texture &);
+		void releaseBindlessTexture(uint32_t index);
 		
 
-		void transitionImageLayout(const VkImage &image, const VkFormat &format, const VkImageLayout &oldLayout, const VkImageLayout &newLayout);
+		void transitionImageLayout(const VkImage &image, const VkFormat &format, const VkImageLayout &oldLayout, const VkImageLayout &newLayout, uint32_t mipLevels = 1);
 
 		static std::vector<VkPhysicalDevice> getPhysicalDevices();
 		static VkPhysicalDeviceFeatures getDeviceFeatures(const VkPhysicalDevice &);
@@ -199,6 +734,10 @@ namespace Graphics {
 		static std::vector<const char *> getRequiredExtensions();
 		static bool checkValidationLayerSupport();
 		static bool checkDeviceExtensionSupport(const VkPhysicalDevice &);
+		static bool checkDeviceExtensionSupport(const VkPhysicalDevice &, const std::vector<const char *> &extensions);
+		static bool checkBindlessSupport(const VkPhysicalDevice &);
+		static bool checkTimelineSemaphoreSupport(const VkPhysicalDevice &);
+		static uint32_t getBindlessCapacity(const VkPhysicalDevice &);
 
 		QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice &);
 		SwapchainSupportDetails querySwapchainSupport(const VkPhysicalDevice &);
@@ -209,18 +748,23 @@ namespace Graphics {
 		uint32_t findMemoryType(uint32_t typeFilter, const VkMemoryPropertyFlags &properties);
 		VkFormat findSupportedFormat(const std::vector<VkFormat> &candidates, const VkImageTiling &tiling, const VkFormatFeatureFlags &features);
 
-		VkCommandBuffer beginSingleTimeCommands();
-		void endSingleTimeCommands(const VkCommandBuffer &);
+		/// Records commands into an upload command buffer and submits it without waiting, blocking other uploads meanwhile
+		/// Returns the timeline value the commands finish at, the next frame waits for them
+		/// Resources they read have to outlive the value
+		uint64_t submitSingleTimeCommands(const std::function<void(const VkCommandBuffer &)> &record);
 
-		void beginRenderPassBuffer(const VkCommandBuffer &buffer, uint32_t currentImage);
+		void beginCommandBuffer(const VkCommandBuffer &buffer);
 
 		VkShaderModule createShaderModule(const std::vector<char> &);
-		VkImageView createImageView(const VkImage &image, const VkFormat &format, const VkImageAspectFlags &aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT);
+		VkImageView createImageView(const VkImage &image, const VkFormat &format, const VkImageAspectFlags &aspectFlags = VK_IMAGE_ASPECT_COLOR_BIT, uint32_t baseMipLevel = 0, uint32_t levelCount = 1);
 		void createBuffer(const VkDeviceSize &size, const VkBufferUsageFlags &usage, const VkMemoryPropertyFlags &properties, VkBuffer &outBuffer, VkDeviceMemory &outBufferMemory);
-		void createImage(uint32_t width, uint32_t height, const VkFormat &format, const VkImageTiling &tiling, const VkImageUsageFlags &usage, const VkMemoryPropertyFlags &properties, VkImage &outImage, VkDeviceMemory &outImageMemory);
+		void createImage(uint32_t width, uint32_t height, const VkFormat &format, const VkImageTiling &tiling, const VkImageUsageFlags &usage, const VkMemoryPropertyFlags &properties, VkImage &outImage, VkDeviceMemory &outImageMemory, uint32_t mipLevels = 1);
 
-		void copyBuffer(const VkBuffer &srcBuffer, const VkBuffer &dstBuffer, const VkDeviceSize &size);
-		void copyBufferToImage(const VkBuffer &buffer, const VkImage &image, uint32_t width, uint32_t height);
+		/// Return the timeline value the copy finishes at
+		uint64_t copyBuffer(const VkBuffer &srcBuffer, const VkBuffer &dstBuffer, const VkDeviceSize &size);
+		uint64_t copyBufferToImage(const VkBuffer &buffer, const VkImage &image, uint32_t width, uint32_t height);
+		/// Destroy a staging buffer once the upload reading it has finished
+		void releaseStagingBuffer(const VkBuffer &buffer, const VkDeviceMemory &memory, uint64_t value);
 
 		static bool hasStencilComponent(const VkFormat &);
 
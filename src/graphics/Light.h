@@ -0,0 +1,28 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+namespace Graphics {
+
+	/*
+		A dynamic point or spot light.
+
+		Lights only reach as far as their range, so each pixel is shaded by the few lights near it.
+		A compute pass bins them into clusters of the view frustum every frame.
+	*/
+	struct Light {
+		enum Type { POINT, SPOT };
+
+		Type type = POINT;
+		glm::vec3 position = glm::vec3(0.0f);
+		glm::vec3 color = glm::vec3(1.0f);
+		// Distance at which the light fades out completely
+		float range = 5.0f;
+
+		// Spot lights only, angles are half angles of the cone in degrees
+		glm::vec3 direction = glm::vec3(0.0f, -1.0f, 0.0f);
+		// Full intensity inside the inner cone, fading to none at the outer one
+		float innerConeAngle = 20.0f;
+		float outerConeAngle = 30.0f;
+	};
+}
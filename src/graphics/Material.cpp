@@ -0,0 +1,26 @@
+#include "Material.h"
+
+#include <tuple>
+
+using namespace Graphics;
+
+bool Material::operator==(const Material &other) const {
+	return std::tie(normalMapping, specularModel, specularPower, specularStrength, alphaTest, alphaCutoff)
+		== std::tie(other.normalMapping, other.specularModel, other.specularPower, other.specularStrength, other.alphaTest, other.alphaCutoff);
+}
+
+bool Material::operator!=(const Material &other) const {
+	return !(*this == other);
+}
+
+size_t std::hash<Material>::operator()(const Material &material) const {
+	// Flags take the low bits, the constants are mixed in on top
+	size_t seed = (material.normalMapping ? 1 : 0) | (material.alphaTest ? 2 : 0) | (static_cast<size_t>(material.specularModel) << 2);
+	for (float value : { material.specularPower, material.specularStrength, material.alphaCutoff }) {
+		// -0 equals 0 but hashes differently
+		if (value == 0.0f)
+			value = 0.0f;
+		seed ^= hash<float>()(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	}
+	return seed;
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace Graphics {
+
+	/*
+		Shading features of an object.
+
+		Every field becomes a specialization constant of the fragment shader, so each distinct material
+		is its own pipeline and the driver removes the branches it doesn't take.
+		Keep the number of distinct materials small, each one compiles a pipeline the first time it's drawn.
+	*/
+	struct Material {
+		enum SpecularModel : uint32_t { SPECULAR_NONE, SPECULAR_PHONG, SPECULAR_BLINN_PHONG };
+
+		// Without a normal map the surface normal is used as is and the map is never sampled
+		bool normalMapping = true;
+		SpecularModel specularModel = SPECULAR_BLINN_PHONG;
+		float specularPower = 64.0f;
+		float specularStrength = 0.4f;
+		// Discard fragments with a diffuse alpha below the cutoff
+		bool alphaTest = false;
+		float alphaCutoff = 0.5f;
+
+		bool operator==(const Material &) const;
+		bool operator!=(const Material &) const;
+	};
+}
+
+namespace std {
+	template<> struct hash<Graphics::Material> {
+		size_t operator()(const Graphics::Material &) const;
+	};
+}
@@ -1,10 +1,58 @@
 #include "Mesh.h"
 
 #include "Context.h"
+#include "MeshOptimizer.h"
+#include "Simplifier.h"
+
+#include <algorithm>
+#include <limits>
 
 using namespace Graphics;
 
-Graphics::Mesh::Mesh(Context & context, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) : context(context), indexCount(indices.size()) {
+// A level of detail has to drop at least this share of the previous level's triangles
+const float LOD_MIN_REDUCTION = 0.2f;
+
+Graphics::Mesh::Mesh(Context & context, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices) : context(context), indexCount(indices.size()), indices(indices) {
+	computeBounds(vertices.empty() ? nullptr : &vertices[0].pos, vertices.size(), sizeof(Vertex), bounds, boundingSphere);
+
+	positions.reserve(vertices.size());
+	for (const auto &vertex : vertices)
+		positions.push_back(vertex.pos);
+
+	//	===========================================================
+	//	===				Generate levels of detail				===
+	//	===========================================================
+	// Every level halves the triangles of the one before and indexes the same vertices
+	std::vector<uint32_t> lodIndices = indices;
+	lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+	float radius = std::max(boundingSphere.radius, std::numeric_limits<float>::min());
+
+	while (lods.size() < MAX_LOD_COUNT) {
+		size_t targetIndexCount = (indices.size() >> lods.size()) / 3 * 3;
+		float error;
+		// Always simplified from the full mesh, so errors don't accumulate
+		std::vector<uint32_t> simplified = Simplifier::simplify(positions, indices, targetIndexCount, radius, error);
+		if (simplified.empty() || simplified.size() > lods.back().indexCount * (1.0f - LOD_MIN_REDUCTION))
+			break;
+
+		// Collapses leave the triangles in the order of the full mesh with holes in it
+		std::vector<uint32_t> clusters;
+		MeshOptimizer::optimizeVertexCache(simplified, vertices.size(), clusters);
+		MeshOptimizer::optimizeOverdraw(simplified, positions, clusters);
+
+		lods.push_back({ static_cast<uint32_t>(lodIndices.size()), static_cast<uint32_t>(simplified.size()), error / radius });
+		lodIndices.insert(lodIndices.end(), simplified.begin(), simplified.end());
+	}
+
+	//	===========================================================
+	//	===				Split levels into meshlets				===
+	//	===========================================================
+	for (auto &lod : lods) {
+		lod.firstMeshlet = static_cast<uint32_t>(meshlets.size());
+		MeshletBuilder::build(positions, lodIndices, lod.firstIndex, lod.indexCount, meshlets);
+		lod.meshletCount = static_cast<uint32_t>(meshlets.size()) - lod.firstMeshlet;
+	}
+
 	//	===========================================================
 	//	===					Create vertex buffer				===
 	//	===========================================================
@@ -20,34 +68,112 @@ Graphics::Mesh::Mesh(Context & context, const std::vector<Vertex>& vertices, con
 	vkUnmapMemory(context.device, stagingBufferMemory);
 
 	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-	context.copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
+	context.releaseStagingBuffer(stagingBuffer, stagingBufferMemory, context.copyBuffer(stagingBuffer, vertexBuffer, bufferSize));
+
+	//	===========================================================
+	//	===					Create position buffer				===
+	//	===========================================================
+	// The depth pre-pass only reads positions, tightly packed they take a fraction of the bandwidth
+	bufferSize = sizeof(glm::vec3) * positions.size();
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	vkMapMemory(context.device, stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, positions.data(), (size_t)bufferSize);
+	vkUnmapMemory(context.device, stagingBufferMemory);
 
-	vkDestroyBuffer(context.device, stagingBuffer, nullptr);
-	vkFreeMemory(context.device, stagingBufferMemory, nullptr);
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, positionBuffer, positionBufferMemory);
+	context.releaseStagingBuffer(stagingBuffer, stagingBufferMemory, context.copyBuffer(stagingBuffer, positionBuffer, bufferSize));
 
 	//	===========================================================
 	//	===					Create index buffer					===
 	//	===========================================================
-	bufferSize = sizeof(uint32_t) * indices.size();
-	context.createBuffer(indices.size() * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+	bufferSize = sizeof(uint32_t) * lodIndices.size();
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+
+	vkMapMemory(context.device, stagingBufferMemory, 0, bufferSize, 0, &data);
+	memcpy(data, lodIndices.data(), (size_t)bufferSize);
+	vkUnmapMemory(context.device, stagingBufferMemory);
+
+	// Meshlet culling copies the indices of visible meshlets out of it
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+	context.releaseStagingBuffer(stagingBuffer, stagingBufferMemory, context.copyBuffer(stagingBuffer, indexBuffer, bufferSize));
+
+	//	===========================================================
+	//	===					Create meshlet buffer				===
+	//	===========================================================
+	// Meshlet culling runs with the Hi-Z culling resources
+	if (!context.hiZSupported || meshlets.empty())
+		return;
+
+	bufferSize = sizeof(Meshlet) * meshlets.size();
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
 
 	vkMapMemory(context.device, stagingBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t)bufferSize);
+	memcpy(data, meshlets.data(), (size_t)bufferSize);
 	vkUnmapMemory(context.device, stagingBufferMemory);
 
-	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
-	context.copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+	context.createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory);
+	context.releaseStagingBuffer(stagingBuffer, stagingBufferMemory, context.copyBuffer(stagingBuffer, meshletBuffer, bufferSize));
 
-	vkDestroyBuffer(context.device, stagingBuffer, nullptr);
-	vkFreeMemory(context.device, stagingBufferMemory, nullptr);
+	meshletSet = context.allocateMeshletSet(*this);
 }
 
 Graphics::Mesh::~Mesh() {
-	vkDeviceWaitIdle(context.device);
+	// Recorded command buffers might still reference the buffers
+	context.invalidateCommandBuffers();
+
+	// Frames in flight may still be drawing the mesh, so the buffers outlive it slightly
+	VkDevice device = context.device;
+	VkBuffer vertexBuffer = this->vertexBuffer, positionBuffer = this->positionBuffer, indexBuffer = this->indexBuffer;
+	VkDeviceMemory vertexBufferMemory = this->vertexBufferMemory, positionBufferMemory = this->positionBufferMemory, indexBufferMemory = this->indexBufferMemory;
+
+	context.deferDestruction([=]() {
+		vkDestroyBuffer(device, vertexBuffer, nullptr);
+		vkFreeMemory(device, vertexBufferMemory, nullptr);
+
+		vkDestroyBuffer(device, positionBuffer, nullptr);
+		vkFreeMemory(device, positionBufferMemory, nullptr);
+
+		vkDestroyBuffer(device, indexBuffer, nullptr);
+		vkFreeMemory(device, indexBufferMemory, nullptr);
+	});
+
+	if (meshletSet != VK_NULL_HANDLE) {
+		VkBuffer meshletBuffer = this->meshletBuffer;
+		VkDeviceMemory meshletBufferMemory = this->meshletBufferMemory;
+
+		context.deferDestruction([=]() {
+			vkDestroyBuffer(device, meshletBuffer, nullptr);
+			vkFreeMemory(device, meshletBufferMemory, nullptr);
+		});
+		context.releaseMeshletSet(meshletSet);
+	}
+}
+
+const AABB &Graphics::Mesh::getBounds() const {
+	return bounds;
+}
+
+const BoundingSphere &Graphics::Mesh::getBoundingSphere() const {
+	return boundingSphere;
+}
+
+const std::vector<glm::vec3> &Graphics::Mesh::getPositions() const {
+	return positions;
+}
+
+const std::vector<uint32_t> &Graphics::Mesh::getIndices() const {
+	return indices;
+}
 
-	vkDestroyBuffer(context.device, vertexBuffer, nullptr);
-	vkFreeMemory(context.device, vertexBufferMemory, nullptr);
+size_t Graphics::Mesh::getLodCount() const {
+	return lods.size();
+}
+
+const Mesh::Lod &Graphics::Mesh::getLod(size_t lod) const {
+	return lods[lod];
+}
 
-	vkDestroyBuffer(context.device, indexBuffer, nullptr);
-	vkFreeMemory(context.device, indexBufferMemory, nullptr);
+const std::vector<Meshlet> &Graphics::Mesh::getMeshlets() const {
+	return meshlets;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "Bounds.h"
+#include "MeshletBuilder.h"
 #include "Vertex.h"
 
 #include <vector>
@@ -12,15 +14,54 @@ namespace Graphics {
 		friend Context;
 		friend Object;
 	public:
+		/// A range of the index buffer, coarser levels of detail follow the full mesh
+		struct Lod {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			// Simplification error relative to the bounding sphere radius
+			float error;
+			// Meshlets covering the same range
+			uint32_t firstMeshlet;
+			uint32_t meshletCount;
+		};
+
+		// Including the full mesh
+		static const uint32_t MAX_LOD_COUNT = 5;
+
+		/// Simplified levels of detail and their meshlets are generated on creation
 		Mesh(Context &context, const std::vector<Vertex> &vertices, const std::vector<uint32_t> &indices);
 		~Mesh();
 
+		/// Model-space bounds, computed from the vertices on creation
+		const AABB &getBounds() const;
+		const BoundingSphere &getBoundingSphere() const;
+
+		/// CPU copy of the geometry, used to rasterize occluders
+		const std::vector<glm::vec3> &getPositions() const;
+		const std::vector<uint32_t> &getIndices() const;
+
+		size_t getLodCount() const;
+		const Lod &getLod(size_t) const;
+
+		const std::vector<Meshlet> &getMeshlets() const;
+
 	private:
 		Context &context;
 
 		const int indexCount;
 
-		VkBuffer		vertexBuffer, indexBuffer;
-		VkDeviceMemory	vertexBufferMemory, indexBufferMemory;
+		AABB bounds;
+		BoundingSphere boundingSphere;
+
+		std::vector<glm::vec3> positions;
+		std::vector<uint32_t> indices;
+		std::vector<Lod> lods;
+		std::vector<Meshlet> meshlets;
+
+		// Positions are also kept on their own, for the depth pre-pass
+		VkBuffer		vertexBuffer, positionBuffer, indexBuffer, meshletBuffer;
+		VkDeviceMemory	vertexBufferMemory, positionBufferMemory, indexBufferMemory, meshletBufferMemory;
+		// Meshlets and indices for the meshlet culling pass, null if the context can't cull meshlets
+		VkDescriptorSet	meshletSet = VK_NULL_HANDLE;
 	};
 }
\ No newline at end of file
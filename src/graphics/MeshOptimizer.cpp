@@ -0,0 +1,247 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+
+using namespace Graphics;
+
+namespace {
+	// FIFO cache simulated with timestamps: a vertex is cached while fewer than cacheSize vertices were transformed after it
+	struct VertexCache {
+		std::vector<uint32_t> cacheTime;
+		uint32_t cacheSize;
+		uint32_t timestamp;
+
+		VertexCache(size_t vertexCount, uint32_t cacheSize) : cacheTime(vertexCount, 0), cacheSize(cacheSize), timestamp(cacheSize + 1) {}
+
+		/// Returns true on a cache miss
+		bool use(uint32_t vertex) {
+			if (timestamp - cacheTime[vertex] <= cacheSize)
+				return false;
+			cacheTime[vertex] = timestamp++;
+			return true;
+		}
+
+		/// Number of vertices transformed since this one entered the cache
+		uint32_t age(uint32_t vertex) const {
+			return timestamp - cacheTime[vertex];
+		}
+
+		void flush() {
+			timestamp += cacheSize + 1;
+		}
+	};
+}
+
+MeshOptimizer::CacheStatistics MeshOptimizer::analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize) {
+	VertexCache cache(vertexCount, cacheSize);
+	std::vector<bool> used(vertexCount, false);
+	size_t misses = 0, usedCount = 0;
+
+	for (auto index : indices) {
+		if (cache.use(index))
+			++misses;
+		if (!used[index]) {
+			used[index] = true;
+			++usedCount;
+		}
+	}
+
+	CacheStatistics statistics;
+	statistics.acmr = indices.empty() ? 0.0f : float(misses) / (indices.size() / 3);
+	statistics.atvr = usedCount == 0 ? 0.0f : float(misses) / usedCount;
+	return statistics;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> &outClusters) {
+	outClusters.clear();
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	// ========================================================================
+	// ===						Vertex to triangle adjacency					===
+	// ========================================================================
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1, 0), adjacency(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		++adjacencyStart[indices[i] + 1];
+	for (size_t i = 0; i < vertexCount; ++i)
+		adjacencyStart[i + 1] += adjacencyStart[i];
+	std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; ++i)
+		adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+
+	// Triangles of every vertex still waiting to be emitted
+	std::vector<uint32_t> live(vertexCount);
+	for (size_t i = 0; i < vertexCount; ++i)
+		live[i] = adjacencyStart[i + 1] - adjacencyStart[i];
+
+	// ========================================================================
+	// ===							Fan around vertices							===
+	// ========================================================================
+	VertexCache cache(vertexCount, CACHE_SIZE);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> result, candidates, deadEnd;
+	result.reserve(triangleCount * 3);
+	uint32_t cursor = 0;
+
+	// Start a new cluster from the first vertex with triangles left
+	auto nextLiveVertex = [&]() {
+		while (cursor < vertexCount && live[cursor] == 0)
+			++cursor;
+		if (cursor == vertexCount)
+			return UINT32_MAX;
+		outClusters.push_back(uint32_t(result.size()));
+		return cursor;
+	};
+
+	uint32_t fanning = nextLiveVertex();
+	while (fanning != UINT32_MAX) {
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t t = adjacencyStart[fanning]; t < adjacencyStart[fanning + 1]; ++t) {
+			uint32_t triangle = adjacency[t];
+			if (emitted[triangle])
+				continue;
+			emitted[triangle] = true;
+
+			for (int j = 0; j < 3; ++j) {
+				uint32_t vertex = indices[triangle * 3 + j];
+				result.push_back(vertex);
+				deadEnd.push_back(vertex);
+				candidates.push_back(vertex);
+				--live[vertex];
+				cache.use(vertex);
+			}
+		}
+
+		// Prefer the oldest vertex that will still be cached after its own triangles are emitted
+		uint32_t next = UINT32_MAX;
+		int bestPriority = -1;
+		for (auto vertex : candidates) {
+			if (live[vertex] == 0)
+				continue;
+			int priority = 0;
+			if (cache.age(vertex) + 2 * live[vertex] <= CACHE_SIZE)
+				priority = int(cache.age(vertex));
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				next = vertex;
+			}
+		}
+
+		// Dead end: go back to a recently used vertex, or start over from a cold cache
+		if (next == UINT32_MAX) {
+			while (!deadEnd.empty() && next == UINT32_MAX) {
+				uint32_t vertex = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[vertex] > 0) {
+					next = vertex;
+					outClusters.push_back(uint32_t(result.size()));
+				}
+			}
+			if (next == UINT32_MAX)
+				next = nextLiveVertex();
+		}
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &clusters, float threshold) {
+	if (indices.empty() || clusters.empty())
+		return;
+
+	// ========================================================================
+	// ===							Soft boundaries								===
+	// ========================================================================
+	// Splitting where the cache already did well loses little, and gives the sort more freedom
+	VertexCache cache(positions.size(), CACHE_SIZE);
+	std::vector<uint32_t> splits;
+	for (size_t c = 0; c < clusters.size(); ++c) {
+		size_t start = clusters[c], end = c + 1 < clusters.size() ? clusters[c + 1] : indices.size();
+
+		cache.flush();
+		size_t clusterMisses = 0;
+		for (size_t i = start; i < end; ++i)
+			clusterMisses += cache.use(indices[i]);
+		float clusterAcmr = float(clusterMisses) / ((end - start) / 3);
+
+		cache.flush();
+		splits.push_back(uint32_t(start));
+		size_t misses = 0, triangles = 0;
+		for (size_t i = start; i < end; i += 3) {
+			for (int j = 0; j < 3; ++j)
+				misses += cache.use(indices[i + j]);
+			++triangles;
+
+			if (i + 3 < end && misses <= threshold * clusterAcmr * triangles) {
+				splits.push_back(uint32_t(i + 3));
+				cache.flush();
+				misses = triangles = 0;
+			}
+		}
+	}
+	splits.push_back(uint32_t(indices.size()));
+
+	// ========================================================================
+	// ===							Sort the clusters							===
+	// ========================================================================
+	// View independent: clusters far out along their own normal tend to cover the rest of the mesh
+	size_t clusterCount = splits.size() - 1;
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f)), normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+
+	for (size_t cluster = 0; cluster < clusterCount; ++cluster) {
+		for (size_t i = splits[cluster]; i < splits[cluster + 1]; i += 3) {
+			const glm::vec3 &a = positions[indices[i]], &b = positions[indices[i + 1]], &c = positions[indices[i + 2]];
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float area = glm::length(normal);
+
+			centroids[cluster] += (a + b + c) * (area / 3.0f);
+			normals[cluster] += normal;
+			areas[cluster] += area;
+		}
+		meshCentroid += centroids[cluster];
+		meshArea += areas[cluster];
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	std::vector<float> keys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		float length = glm::length(normals[c]);
+		if (areas[c] > 0.0f && length > 0.0f)
+			keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / length);
+	}
+
+	std::vector<uint32_t> order(clusterCount);
+	for (uint32_t i = 0; i < clusterCount; ++i)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+		return keys[a] > keys[b];
+	});
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (auto c : order)
+		result.insert(result.end(), indices.begin() + splits[c], indices.begin() + splits[c + 1]);
+	indices.swap(result);
+}
+
+std::vector<uint32_t> MeshOptimizer::optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount) {
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	std::vector<uint32_t> order;
+	order.reserve(vertexCount);
+
+	for (auto &index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = uint32_t(order.size());
+			order.push_back(index);
+		}
+		index = remap[index];
+	}
+	return order;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		Reorders triangles and vertices of indexed triangle lists for faster drawing.
+
+		optimizeVertexCache is Tipsify (Sander, Nehab & Barczak, "Fast Triangle Reordering for
+		Vertex Locality and Reduced Overdraw"), which also reports the clusters optimizeOverdraw sorts.
+		Run them in the order cache, overdraw, fetch: each step keeps the gains of the one before.
+	*/
+	namespace MeshOptimizer {
+
+		/// Post-transform cache size the reordering is tuned for
+		const uint32_t CACHE_SIZE = 16;
+
+		struct CacheStatistics {
+			// Average cache miss ratio: transformed vertices per triangle, 0.5 at best on large meshes
+			float acmr;
+			// Average transform to vertex ratio: transformed vertices per referenced vertex, 1.0 at best
+			float atvr;
+		};
+
+		/// Simulate a FIFO post-transform cache of cacheSize entries
+		CacheStatistics analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount, uint32_t cacheSize = CACHE_SIZE);
+
+		/// Reorder triangles so vertices get reused while still in the cache
+		/// outClusters receives the first index of every run of triangles that starts from a cold cache
+		void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount, std::vector<uint32_t> &outClusters);
+
+		/// Split the clusters further where it barely costs cache efficiency, then draw the ones facing outwards first
+		/// threshold is how much worse than the cluster's own ACMR a split may make it
+		void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &clusters, float threshold = 1.05f);
+
+		/// Renumber vertices in order of first use so the vertex buffer is read front to back
+		/// Returns the old index of every new vertex, vertices no triangle uses are dropped
+		std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount);
+	}
+}
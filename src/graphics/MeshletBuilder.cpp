@@ -0,0 +1,91 @@
+#include "MeshletBuilder.h"
+
+#include "Bounds.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Graphics;
+
+namespace {
+	void finishMeshlet(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, const std::vector<uint32_t> &vertices, Meshlet &meshlet) {
+		std::vector<glm::vec3> points;
+		points.reserve(vertices.size());
+		for (auto vertex : vertices)
+			points.push_back(positions[vertex]);
+
+		AABB box;
+		BoundingSphere sphere;
+		computeBounds(points.data(), points.size(), sizeof(glm::vec3), box, sphere);
+		meshlet.sphere = glm::vec4(sphere.center, sphere.radius);
+
+		std::vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (uint32_t i = meshlet.firstIndex; i < meshlet.firstIndex + meshlet.indexCount; i += 3) {
+			const glm::vec3 &a = positions[indices[i]], &b = positions[indices[i + 1]], &c = positions[indices[i + 2]];
+			glm::vec3 normal = glm::cross(b - a, c - a);
+			float length = glm::length(normal);
+			// Degenerate triangles are never drawn, they can face any way
+			if (length == 0.0f)
+				continue;
+			normals.push_back(normal / length);
+			axis += normals.back();
+		}
+
+		float axisLength = glm::length(axis);
+		if (axisLength == 0.0f) {
+			meshlet.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+			return;
+		}
+		axis /= axisLength;
+
+		float minCosine = 1.0f;
+		for (const auto &normal : normals)
+			minCosine = std::min(minCosine, glm::dot(axis, normal));
+
+		// Triangles facing more than 90 degrees apart can't all be back-facing at once
+		float sine = minCosine <= 0.0f ? 1.0f : std::sqrt(1.0f - minCosine * minCosine);
+		meshlet.cone = glm::vec4(axis, sine);
+	}
+}
+
+void MeshletBuilder::build(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t firstIndex, size_t indexCount, std::vector<Meshlet> &outMeshlets) {
+	// Which meshlet each vertex was last added to
+	std::vector<uint32_t> vertexMeshlet(positions.size(), UINT32_MAX);
+	std::vector<uint32_t> vertices;
+	vertices.reserve(MAX_VERTICES);
+
+	Meshlet meshlet = {};
+	meshlet.firstIndex = static_cast<uint32_t>(firstIndex);
+	uint32_t meshletId = 0;
+
+	for (size_t i = firstIndex; i < firstIndex + indexCount; i += 3) {
+		uint32_t newVertices = 0;
+		for (int j = 0; j < 3; ++j)
+			newVertices += vertexMeshlet[indices[i + j]] != meshletId;
+
+		if (vertices.size() + newVertices > MAX_VERTICES || meshlet.indexCount / 3 == MAX_TRIANGLES) {
+			finishMeshlet(positions, indices, vertices, meshlet);
+			outMeshlets.push_back(meshlet);
+
+			meshlet = {};
+			meshlet.firstIndex = static_cast<uint32_t>(i);
+			vertices.clear();
+			++meshletId;
+		}
+
+		for (int j = 0; j < 3; ++j) {
+			uint32_t vertex = indices[i + j];
+			if (vertexMeshlet[vertex] != meshletId) {
+				vertexMeshlet[vertex] = meshletId;
+				vertices.push_back(vertex);
+			}
+		}
+		meshlet.indexCount += 3;
+	}
+
+	if (meshlet.indexCount > 0) {
+		finishMeshlet(positions, indices, vertices, meshlet);
+		outMeshlets.push_back(meshlet);
+	}
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/// A small cluster of neighboring triangles, culled on its own on the GPU
+	/// Laid out the way std430 pads it
+	struct Meshlet {
+		// Model-space bounding sphere, radius in w
+		glm::vec4 sphere;
+		// Average triangle normal in xyz, sine of the angle to the farthest normal in w
+		// The cone is never culled when w is 1
+		glm::vec4 cone;
+		uint32_t firstIndex;
+		uint32_t indexCount;
+		uint32_t padding[2];
+	};
+
+	/*
+		Splits index lists into meshlets without reordering them.
+
+		Triangles are taken in order until the vertex or triangle limit is hit, so the index list
+		should already be sorted for locality (MeshOptimizer::optimizeVertexCache does that).
+		The limits are the usual mesh shader sizes, but meshlets here only ever address ranges of the index buffer.
+	*/
+	namespace MeshletBuilder {
+
+		const uint32_t MAX_VERTICES = 64;
+		const uint32_t MAX_TRIANGLES = 124;
+
+		/// Append the meshlets of indices [firstIndex, firstIndex + indexCount) to outMeshlets
+		void build(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t firstIndex, size_t indexCount, std::vector<Meshlet> &outMeshlets);
+	}
+}
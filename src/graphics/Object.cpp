@@ -1,34 +1,90 @@
 #include "Object.h"
 
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/gtx/euler_angles.hpp>
+#include "Scene.h"
+
+#include <algorithm>
 
 using namespace Graphics;
 
-Object::Object(Mesh &mesh, Texture &diffuseTexture, Texture &normalMap) : mesh(mesh), diffuseTexture(diffuseTexture), normalMap(normalMap) {}
+Object::Object(Scene &scene, Mesh &mesh, Texture &diffuseTexture, Texture &normalMap) : scene(scene), mesh(mesh), diffuseTexture(diffuseTexture), normalMap(normalMap) {
+	transform = scene.transforms.create();
+	scene.transforms.setBounds(transform, mesh.getBoundingSphere());
+	scene.objects.push_back(this);
+
+	// Picks and queries from other threads map BVH items back to objects
+	std::lock_guard<std::mutex> lock(scene.bvhMutex);
+	if (scene.transformObjects.size() <= transform)
+		scene.transformObjects.resize(transform + 1, nullptr);
+	scene.transformObjects[transform] = this;
+}
+
+Object::~Object() {
+	auto it = std::find(scene.objects.begin(), scene.objects.end(), this);
+	if (it != scene.objects.end()) {
+		*it = scene.objects.back();
+		scene.objects.pop_back();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(scene.materialsMutex);
+		auto &pending = scene.pendingMaterialObjects;
+		pending.erase(std::remove(pending.begin(), pending.end(), this), pending.end());
+	}
+
+	// Picks and queries from other threads read the tree and map its items back to objects
+	std::lock_guard<std::mutex> lock(scene.bvhMutex);
+	if (bvhLeaf != BVH::INVALID_NODE)
+		scene.bvh.remove(bvhLeaf);
+
+	scene.transformObjects[transform] = nullptr;
+	scene.transforms.destroy(transform);
+}
 
 void Object::setScale(const glm::vec3 &s) {
-	scale = s;
-	transformationMatrixIsCorrect = false;
+	scene.transforms.setScale(transform, s);
 }
 
 void Object::setPosition(const glm::vec3 &p) {
-	position = p;
-	transformationMatrixIsCorrect = false;
+	scene.transforms.setPosition(transform, p);
 }
 
 void Object::setRotation(const glm::vec3 &r) {
-	rotation = r;
-	transformationMatrixIsCorrect = false;
+	setRotation(
+		glm::angleAxis(r.x, glm::vec3(1.0f, 0.0f, 0.0f))
+		* glm::angleAxis(r.y, glm::vec3(0.0f, 1.0f, 0.0f))
+		* glm::angleAxis(r.z, glm::vec3(0.0f, 0.0f, 1.0f)));
 }
 
-glm::mat4 Object::getTransformationMatrix() {
-	if (!transformationMatrixIsCorrect) {
-		transformationMatrix = glm::mat4(1.0f);
-		transformationMatrix = glm::scale(transformationMatrix, scale);
-		transformationMatrix = glm::eulerAngleXYZ(rotation.x, rotation.y, rotation.z) * transformationMatrix;
-		transformationMatrix = glm::translate(transformationMatrix, position);
-		transformationMatrixIsCorrect = true;
+void Object::setRotation(const glm::quat &r) {
+	scene.transforms.setRotation(transform, r);
+}
+
+void Object::setParent(Object &parent) {
+	scene.transforms.setParent(transform, parent.transform);
+}
+
+void Object::clearParent() {
+	scene.transforms.setParent(transform, TransformStore::INVALID_HANDLE);
+}
+
+void Object::setOccluder(bool o) {
+	occluder = o;
+}
+
+void Object::setMaterial(const Material &m) {
+	std::lock_guard<std::mutex> lock(scene.materialsMutex);
+	pendingMaterial = m;
+	if (!materialPending) {
+		materialPending = true;
+		scene.pendingMaterialObjects.push_back(this);
 	}
-	return transformationMatrix;
+}
+
+Material Object::getMaterial() const {
+	std::lock_guard<std::mutex> lock(scene.materialsMutex);
+	return materialPending ? pendingMaterial : material;
+}
+
+glm::mat4 Object::getTransformationMatrix() {
+	return scene.transforms.getWorldMatrix(transform);
 }
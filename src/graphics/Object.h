@@ -1,34 +1,75 @@
 #pragma once
 
+#include "BVH.h"
+#include "Material.h"
 #include "Mesh.h"
 #include "Texture.h"
+#include "TransformStore.h"
+
+#include <atomic>
 
 namespace Graphics {
+	struct Scene;
+
 	/*
 		A renderable object
 	*/
 	class Object {
 		friend Context;
+		friend Scene;
 	public:
-		Object(Mesh &mesh, Texture &diffuseTexture, Texture &normalMap);
-		~Object() = default;
+		/// Create an object as part of a scene, the scene keeps its transform
+		Object(Scene &scene, Mesh &mesh, Texture &diffuseTexture, Texture &normalMap);
+		~Object();
 
 		/// Set object's scaling factor
 		void setScale(const glm::vec3 &);
 		/// Set object's position in cartesian coordinates
 		void setPosition(const glm::vec3 &);
-		/// Set object's euler rotation angles
+		/// Set object's euler rotation angles (applied as X * Y * Z)
 		void setRotation(const glm::vec3 &);
+		/// Set object's rotation
+		void setRotation(const glm::quat &);
+
+		/// Attach the object to a parent, its transformations become relative to the parent
+		/// <throws> invalid_argument if the parent is attached to this object </throws>
+		void setParent(Object &parent);
+		/// Detach the object from its parent, transformations become relative to the world
+		void clearParent();
+
+		/// Occluders are rasterized on the CPU and hide other objects behind them
+		/// Best for large, simple meshes like walls and terrain
+		void setOccluder(bool);
 
+		/// Shading features, objects with equal materials share a pipeline
+		/// Safe from any thread, the material takes effect at the next scene update
+		void setMaterial(const Material &);
+		/// The material last set, even if it hasn't taken effect yet
+		Material getMaterial() const;
+
+		/// World matrix as of the last scene update
 		glm::mat4 getTransformationMatrix();
 	private:
+		Scene & scene;
 		Texture & diffuseTexture, &normalMap;
 		Mesh & mesh;
 
-		bool transformationMatrixIsCorrect = false;;
-		glm::vec3 position = glm::vec3(0.0f);
-		glm::vec3 rotation = glm::vec3(0.0f);
-		glm::vec3 scale = glm::vec3(1.0f);
-		glm::mat4 transformationMatrix;
+		TransformStore::Handle transform;
+
+		// Set from the console, read while culling on the render thread
+		std::atomic<bool> occluder{ false };
+		// Drawn with, only the render thread touches it outside the scene's materials mutex
+		Material material;
+		// Set from other threads, guarded by the scene's materials mutex
+		Material pendingMaterial;
+		bool materialPending = false;
+
+		// Leaf in the scene's BVH, inserted on the first scene update
+		BVH::NodeId bvhLeaf = BVH::INVALID_NODE;
+		// Transform revision the leaf bounds were taken at
+		uint32_t boundsRevision = 0;
+
+		// Level of detail drawn last, kept until the screen size changes enough to avoid flicker
+		uint32_t lod = 0;
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,196 @@
+#include "OcclusionCuller.h"
+
+#include "../Jobs.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <xmmintrin.h>
+
+using namespace Graphics;
+
+namespace {
+	// Vertices closer than this to the eye plane are not projected
+	const float MIN_W = 1e-4f;
+
+	glm::vec3 toScreen(const glm::vec4 &clip) {
+		float inverseW = 1.0f / clip.w;
+		return glm::vec3(
+			(clip.x * inverseW * 0.5f + 0.5f) * OcclusionCuller::WIDTH,
+			(clip.y * inverseW * 0.5f + 0.5f) * OcclusionCuller::HEIGHT,
+			clip.z * inverseW);
+	}
+}
+
+OcclusionCuller::OcclusionCuller() : depth(WIDTH * HEIGHT, 1.0f) {}
+
+void OcclusionCuller::begin(const glm::mat4 &pv) {
+	projectionView = pv;
+	std::fill(depth.begin(), depth.end(), 1.0f);
+
+	triangles.clear();
+	for (auto &bin : bins)
+		bin.clear();
+}
+
+void OcclusionCuller::addOccluder(const glm::mat4 &model, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices) {
+	glm::mat4 matrix = projectionView * model;
+
+	std::vector<glm::vec4> clip(positions.size());
+	for (size_t i = 0; i < positions.size(); ++i)
+		clip[i] = matrix * glm::vec4(positions[i], 1.0f);
+
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		const glm::vec4 &c0 = clip[indices[i]], &c1 = clip[indices[i + 1]], &c2 = clip[indices[i + 2]];
+
+		// Dropping a triangle only makes culling less aggressive, so near plane crossings are skipped instead of clipped
+		if (c0.w < MIN_W || c1.w < MIN_W || c2.w < MIN_W)
+			continue;
+
+		glm::vec3 v[3] = { toScreen(c0), toScreen(c1), toScreen(c2) };
+
+		ScreenTriangle triangle;
+		for (int edge = 0; edge < 3; ++edge) {
+			// Edge opposite of vertex "edge"
+			const glm::vec3 &a = v[(edge + 1) % 3], &b = v[(edge + 2) % 3];
+			triangle.edgeA[edge] = a.y - b.y;
+			triangle.edgeB[edge] = b.x - a.x;
+			triangle.edgeC[edge] = a.x * b.y - a.y * b.x;
+		}
+
+		float area = triangle.edgeA[0] * v[0].x + triangle.edgeB[0] * v[0].y + triangle.edgeC[0];
+		if (std::fabs(area) < 1e-8f)
+			continue;
+
+		// Either winding is fine, occluders are rasterized from both sides
+		if (area < 0.0f) {
+			for (int edge = 0; edge < 3; ++edge) {
+				triangle.edgeA[edge] = -triangle.edgeA[edge];
+				triangle.edgeB[edge] = -triangle.edgeB[edge];
+				triangle.edgeC[edge] = -triangle.edgeC[edge];
+			}
+			area = -area;
+		}
+
+		// Edge functions are barycentric weights scaled by the area
+		triangle.depthA = (triangle.edgeA[0] * v[0].z + triangle.edgeA[1] * v[1].z + triangle.edgeA[2] * v[2].z) / area;
+		triangle.depthB = (triangle.edgeB[0] * v[0].z + triangle.edgeB[1] * v[1].z + triangle.edgeB[2] * v[2].z) / area;
+		triangle.depthC = (triangle.edgeC[0] * v[0].z + triangle.edgeC[1] * v[1].z + triangle.edgeC[2] * v[2].z) / area;
+
+		triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({ v[0].x, v[1].x, v[2].x }))));
+		triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({ v[0].y, v[1].y, v[2].y }))));
+		triangle.maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(std::max({ v[0].x, v[1].x, v[2].x }))));
+		triangle.maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(std::max({ v[0].y, v[1].y, v[2].y }))));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			continue;
+
+		uint32_t index = static_cast<uint32_t>(triangles.size());
+		triangles.push_back(triangle);
+
+		for (int tileY = triangle.minY / TILE_HEIGHT; tileY <= triangle.maxY / TILE_HEIGHT; ++tileY)
+			for (int tileX = triangle.minX / TILE_WIDTH; tileX <= triangle.maxX / TILE_WIDTH; ++tileX)
+				bins[tileY * TILES_X + tileX].push_back(index);
+	}
+}
+
+void OcclusionCuller::rasterize() {
+	if (triangles.empty())
+		return;
+
+	// Tiles don't share pixels, so they can be filled at the same time
+	Jobs::parallelFor(TILES_X * TILES_Y, 1, [this](size_t begin, size_t end) {
+		for (size_t tile = begin; tile < end; ++tile)
+			rasterizeTile(static_cast<int>(tile));
+	});
+}
+
+bool OcclusionCuller::isVisible(const AABB &box) const {
+	glm::vec2 screenMin(static_cast<float>(WIDTH), static_cast<float>(HEIGHT)), screenMax(0.0f);
+	float nearestDepth = 1.0f;
+
+	for (int corner = 0; corner < 8; ++corner) {
+		glm::vec3 point(
+			(corner & 1) ? box.max.x : box.min.x,
+			(corner & 2) ? box.max.y : box.min.y,
+			(corner & 4) ? box.max.z : box.min.z);
+
+		glm::vec4 clip = projectionView * glm::vec4(point, 1.0f);
+		// The box reaches behind the eye, its screen rectangle is unbounded
+		if (clip.w < MIN_W)
+			return true;
+
+		glm::vec3 screen = toScreen(clip);
+		screenMin = glm::min(screenMin, glm::vec2(screen));
+		screenMax = glm::max(screenMax, glm::vec2(screen));
+		nearestDepth = std::min(nearestDepth, screen.z);
+	}
+
+	// Occluders only cover the pixel centers they contain, so the rectangle grows by a pixel
+	// to keep objects peeking past an occluder's silhouette
+	int minX = std::max(0, static_cast<int>(std::floor(screenMin.x)) - 1);
+	int minY = std::max(0, static_cast<int>(std::floor(screenMin.y)) - 1);
+	int maxX = std::min(WIDTH - 1, static_cast<int>(std::ceil(screenMax.x)) + 1);
+	int maxY = std::min(HEIGHT - 1, static_cast<int>(std::ceil(screenMax.y)) + 1);
+	if (minX > maxX || minY > maxY)
+		return true;
+
+	// Visible as soon as a single pixel in the rectangle has no occluder in front of the box
+	// Groups of 4 may read a few pixels outside of the rectangle, which only makes the test more conservative
+	__m128 boxDepth = _mm_set1_ps(nearestDepth);
+	for (int y = minY; y <= maxY; ++y) {
+		const float *row = &depth[y * WIDTH];
+		for (int x = minX & ~3; x <= maxX; x += 4)
+			if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+				return true;
+	}
+	return false;
+}
+
+size_t OcclusionCuller::getTriangleCount() const {
+	return triangles.size();
+}
+
+void OcclusionCuller::rasterizeTile(int tile) {
+	int tileMinX = (tile % TILES_X) * TILE_WIDTH, tileMinY = (tile / TILES_X) * TILE_HEIGHT;
+	int tileMaxX = tileMinX + TILE_WIDTH - 1, tileMaxY = tileMinY + TILE_HEIGHT - 1;
+
+	const __m128 laneOffsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	const __m128 zero = _mm_setzero_ps();
+
+	for (auto index : bins[tile]) {
+		const ScreenTriangle &triangle = triangles[index];
+
+		int minX = std::max(triangle.minX, tileMinX) & ~3, maxX = std::min(triangle.maxX, tileMaxX);
+		int minY = std::max(triangle.minY, tileMinY), maxY = std::min(triangle.maxY, tileMaxY);
+
+		__m128 edgeA[3], depthA = _mm_set1_ps(triangle.depthA);
+		for (int edge = 0; edge < 3; ++edge)
+			edgeA[edge] = _mm_set1_ps(triangle.edgeA[edge]);
+
+		for (int y = minY; y <= maxY; ++y) {
+			float centerY = y + 0.5f;
+
+			// Everything that is constant along the row
+			__m128 edgeRow[3];
+			for (int edge = 0; edge < 3; ++edge)
+				edgeRow[edge] = _mm_set1_ps(triangle.edgeB[edge] * centerY + triangle.edgeC[edge]);
+			__m128 depthRow = _mm_set1_ps(triangle.depthB * centerY + triangle.depthC);
+
+			float *row = &depth[y * WIDTH];
+			for (int x = minX; x <= maxX; x += 4) {
+				__m128 centerX = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), laneOffsets);
+
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[0], centerX), edgeRow[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[1], centerX), edgeRow[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeA[2], centerX), edgeRow[2]), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				__m128 pixelDepth = _mm_add_ps(_mm_mul_ps(depthA, centerX), depthRow);
+				__m128 current = _mm_loadu_ps(row + x);
+				__m128 nearest = _mm_min_ps(current, pixelDepth);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, current)));
+			}
+		}
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "Bounds.h"
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		CPU occlusion culling against a low resolution depth buffer.
+
+		Designated occluder meshes are rasterized in screen tiles on all job threads,
+		then the screen rectangle of every other object is tested against the result.
+	*/
+	class OcclusionCuller {
+	public:
+		static constexpr int WIDTH = 256;
+		static constexpr int HEIGHT = 128;
+		static constexpr int TILE_WIDTH = 64;
+		static constexpr int TILE_HEIGHT = 32;
+
+		OcclusionCuller();
+
+		/// Clear the depth buffer and start a frame seen through the matrix
+		void begin(const glm::mat4 &projectionView);
+		/// Queue the triangles of an occluder for rasterization
+		void addOccluder(const glm::mat4 &model, const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices);
+		/// Rasterize all queued occluders
+		void rasterize();
+
+		/// Whether any part of the box might be in front of the occluders
+		bool isVisible(const AABB &) const;
+
+		size_t getTriangleCount() const;
+
+	private:
+		static constexpr int TILES_X = WIDTH / TILE_WIDTH;
+		static constexpr int TILES_Y = HEIGHT / TILE_HEIGHT;
+
+		// Triangle in screen space, set up for edge function rasterization
+		struct ScreenTriangle {
+			// A * x + B * y + C per edge, positive inside
+			float edgeA[3], edgeB[3], edgeC[3];
+			// Depth as a plane over the screen
+			float depthA, depthB, depthC;
+			int minX, minY, maxX, maxY;
+		};
+
+		glm::mat4 projectionView;
+		std::vector<float> depth;
+		std::vector<ScreenTriangle> triangles;
+		// Triangles overlapping every tile
+		std::vector<uint32_t> bins[TILES_X * TILES_Y];
+
+		void rasterizeTile(int tile);
+	};
+}
@@ -0,0 +1,740 @@
+#include "RenderGraph.h"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+using namespace Graphics;
+
+// Access bits that write memory, the rest only need the writes before them made visible
+const VkAccessFlags WRITE_ACCESS =
+	VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+	VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+
+// ========================================================================
+// ===							Declaration								===
+// ========================================================================
+
+RenderGraph::Pass::Pass(RenderGraph &graph, const char *name, bool graphics, RecordFunction &&record, std::function<VkExtent2D()> &&renderArea)
+	: graph(graph), name(name), graphics(graphics), record(std::move(record)), renderArea(std::move(renderArea)) {}
+
+RenderGraph::Pass &RenderGraph::Pass::color(Resource resource, VkAttachmentLoadOp loadOp, VkClearColorValue clear) {
+	if (!graphics)
+		throw std::invalid_argument("Only graphics passes have attachments!");
+
+	bool load = loadOp == VK_ATTACHMENT_LOAD_OP_LOAD;
+	access(COLOR, resource, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | (load ? VK_ACCESS_COLOR_ATTACHMENT_READ_BIT : 0),
+		VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, load, true);
+	accesses.back().loadOp = loadOp;
+	accesses.back().clear.color = clear;
+	return *this;
+}
+
+RenderGraph::Pass &RenderGraph::Pass::depth(Resource resource, VkAttachmentLoadOp loadOp, float clear) {
+	if (!graphics)
+		throw std::invalid_argument("Only graphics passes have attachments!");
+
+	// Depth tests read the attachment even when it was cleared
+	access(DEPTH, resource, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+		VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, loadOp == VK_ATTACHMENT_LOAD_OP_LOAD, true);
+	accesses.back().loadOp = loadOp;
+	accesses.back().clear.depthStencil = { clear, 0 };
+	return *this;
+}
+
+RenderGraph::Pass &RenderGraph::Pass::sample(Resource resource, VkPipelineStageFlags stages) {
+	const ResourceInfo &info = graph.resources[resource];
+	VkImageLayout layout = isDepthFormat(info.format) ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	if (info.imported && info.initialLayout == VK_IMAGE_LAYOUT_GENERAL)
+		layout = VK_IMAGE_LAYOUT_GENERAL;
+
+	return access(SAMPLED, resource, stages, VK_ACCESS_SHADER_READ_BIT, layout, true, false);
+}
+
+RenderGraph::Pass &RenderGraph::Pass::storage(Resource resource, VkPipelineStageFlags stages) {
+	return access(STORAGE, resource, stages, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true, true);
+}
+
+RenderGraph::Pass &RenderGraph::Pass::read(Resource buffer, VkPipelineStageFlags stages, VkAccessFlags accessFlags) {
+	return access(BUFFER, buffer, stages, accessFlags, VK_IMAGE_LAYOUT_UNDEFINED, true, false);
+}
+
+RenderGraph::Pass &RenderGraph::Pass::write(Resource buffer, VkPipelineStageFlags stages, VkAccessFlags accessFlags) {
+	return access(BUFFER, buffer, stages, accessFlags, VK_IMAGE_LAYOUT_UNDEFINED, (accessFlags & ~WRITE_ACCESS) != 0, true);
+}
+
+RenderGraph::Pass &RenderGraph::Pass::access(Kind kind, Resource resource, VkPipelineStageFlags stages, VkAccessFlags accessFlags, VkImageLayout layout, bool reads, bool writes) {
+	if (resource >= graph.resources.size() || graph.resources[resource].buffer != (kind == BUFFER))
+		throw std::invalid_argument("Pass accesses a resource of the wrong kind!");
+	for (const auto &other : accesses)
+		if (other.resource == resource)
+			throw std::invalid_argument("Pass accesses the same resource twice!");
+
+	Access declared = {};
+	declared.kind = kind;
+	declared.resource = resource;
+	declared.stages = stages;
+	declared.access = accessFlags;
+	declared.layout = layout;
+	declared.reads = reads;
+	declared.writes = writes;
+	declared.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	accesses.push_back(declared);
+	return *this;
+}
+
+
+RenderGraph::RenderGraph(const VkDevice &device, const VkPhysicalDevice &physicalDevice) : device(device), physicalDevice(physicalDevice) {}
+
+RenderGraph::~RenderGraph() {
+	for (auto &pass : passes) {
+		for (auto framebuffer : pass.framebuffers)
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		vkDestroyRenderPass(device, pass.renderPass, nullptr);
+	}
+
+	for (auto &info : resources) {
+		if (info.imported || info.buffer)
+			continue;
+		for (auto view : info.views)
+			vkDestroyImageView(device, view, nullptr);
+		for (auto image : info.images)
+			vkDestroyImage(device, image, nullptr);
+	}
+
+	for (auto &block : blocks)
+		vkFreeMemory(device, block.memory, nullptr);
+}
+
+RenderGraph::Resource RenderGraph::importImage(const char *name, const std::vector<VkImage> &images, const std::vector<VkImageView> &views, VkFormat format, VkExtent2D extent, VkImageLayout initialLayout, VkImageLayout finalLayout) {
+	// Shared images are used by the next frame right where this one left them
+	if (images.size() == 1 && initialLayout != finalLayout)
+		throw std::invalid_argument("Images imported for every frame have to start and end in the same layout!");
+
+	ResourceInfo info = {};
+	info.name = name;
+	info.imported = true;
+	info.images = images;
+	info.views = views;
+	info.format = format;
+	info.extent = extent;
+	info.initialLayout = initialLayout;
+	info.finalLayout = finalLayout;
+	resources.push_back(info);
+	return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createImage(const char *name, VkFormat format, VkExtent2D extent) {
+	ResourceInfo info = {};
+	info.name = name;
+	info.format = format;
+	info.extent = extent;
+	resources.push_back(info);
+	return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::createBuffer(const char *name) {
+	ResourceInfo info = {};
+	info.name = name;
+	info.buffer = true;
+	resources.push_back(info);
+	return static_cast<Resource>(resources.size() - 1);
+}
+
+RenderGraph::Pass &RenderGraph::addGraphicsPass(const char *name, RecordFunction record, std::function<VkExtent2D()> renderArea) {
+	passes.push_back(Pass(*this, name, true, std::move(record), std::move(renderArea)));
+	return passes.back();
+}
+
+RenderGraph::Pass &RenderGraph::addComputePass(const char *name, RecordFunction record) {
+	passes.push_back(Pass(*this, name, false, std::move(record), nullptr));
+	return passes.back();
+}
+
+
+// ========================================================================
+// ===							Compilation								===
+// ========================================================================
+
+void RenderGraph::compile() {
+	cullPasses();
+
+	// Lifetimes and usage only count the passes that are left
+	for (uint32_t position = 0; position < order.size(); ++position) {
+		for (const auto &access : passes[order[position]].accesses) {
+			ResourceInfo &info = resources[access.resource];
+			info.firstPass = std::min(info.firstPass, position);
+			info.lastPass = std::max(info.lastPass, position);
+
+			switch (access.kind) {
+			case Pass::COLOR: info.usage |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT; break;
+			case Pass::DEPTH: info.usage |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT; break;
+			case Pass::SAMPLED: info.usage |= VK_IMAGE_USAGE_SAMPLED_BIT; break;
+			case Pass::STORAGE: info.usage |= VK_IMAGE_USAGE_STORAGE_BIT; break;
+			default: break;
+			}
+		}
+	}
+
+	// An attachment that is neither loaded nor used after its pass never has to reach memory
+	for (Resource resource = 0; resource < resources.size(); ++resource) {
+		ResourceInfo &info = resources[resource];
+		if (info.imported || info.buffer || info.firstPass != info.lastPass)
+			continue;
+		auto accesses = getAccesses(resource);
+		info.lazy = (accesses.front()->kind == Pass::COLOR || accesses.front()->kind == Pass::DEPTH) && accesses.front()->loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+	}
+
+	allocateImages();
+	computeBarriers();
+	createRenderPasses();
+}
+
+void RenderGraph::cullPasses() {
+	// Walk back from the imported images, keeping the passes that produce what later passes read
+	std::vector<bool> needed(resources.size(), false);
+	for (size_t i = passes.size(); i-- > 0;) {
+		Pass &pass = passes[i];
+
+		pass.culled = true;
+		for (const auto &access : pass.accesses)
+			if (access.writes && (resources[access.resource].imported || needed[access.resource]))
+				pass.culled = false;
+		if (pass.culled)
+			continue;
+
+		// Whatever the pass overwrites completely doesn't need earlier writers
+		for (const auto &access : pass.accesses)
+			if (access.writes && !access.reads)
+				needed[access.resource] = false;
+		for (const auto &access : pass.accesses)
+			if (access.reads)
+				needed[access.resource] = true;
+	}
+
+	order.clear();
+	for (uint32_t i = 0; i < passes.size(); ++i)
+		if (!passes[i].culled)
+			order.push_back(i);
+}
+
+void RenderGraph::allocateImages() {
+	std::vector<Resource> transients;
+	for (Resource resource = 0; resource < resources.size(); ++resource)
+		if (!resources[resource].imported && !resources[resource].buffer && resources[resource].firstPass != UINT32_MAX)
+			transients.push_back(resource);
+	std::stable_sort(transients.begin(), transients.end(), [this](Resource a, Resource b) { return resources[a].firstPass < resources[b].firstPass; });
+
+	for (Resource resource : transients) {
+		ResourceInfo &info = resources[resource];
+
+		VkImageCreateInfo imageInfo = {};
+		imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+		imageInfo.imageType = VK_IMAGE_TYPE_2D;
+		imageInfo.extent = { info.extent.width, info.extent.height, 1 };
+		imageInfo.mipLevels = 1;
+		imageInfo.arrayLayers = 1;
+		imageInfo.format = info.format;
+		imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+		imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+		imageInfo.usage = info.usage | (info.lazy ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+		imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+		imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+		info.images.resize(1);
+		if (vkCreateImage(device, &imageInfo, nullptr, &info.images[0]) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create transient image!");
+
+		VkMemoryRequirements requirements;
+		vkGetImageMemoryRequirements(device, info.images[0], &requirements);
+
+		// Images are sorted by their first pass, so a block is free once its latest image is dead
+		for (uint32_t i = 0; i < blocks.size() && info.block == UINT32_MAX; ++i) {
+			Block &block = blocks[i];
+			if (block.lazy == info.lazy && (block.requirements.memoryTypeBits & requirements.memoryTypeBits) != 0
+				&& resources[block.images.back()].lastPass < info.firstPass)
+				info.block = i;
+		}
+		if (info.block == UINT32_MAX) {
+			Block block = {};
+			block.requirements = requirements;
+			block.lazy = info.lazy;
+			blocks.push_back(block);
+			info.block = static_cast<uint32_t>(blocks.size() - 1);
+		}
+
+		Block &block = blocks[info.block];
+		block.images.push_back(resource);
+		block.requirements.size = std::max(block.requirements.size, requirements.size);
+		block.requirements.alignment = std::max(block.requirements.alignment, requirements.alignment);
+		block.requirements.memoryTypeBits &= requirements.memoryTypeBits;
+	}
+
+	for (auto &block : blocks) {
+		uint32_t memoryType = block.lazy ? findMemoryType(block.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) : UINT32_MAX;
+		if (memoryType == UINT32_MAX)
+			memoryType = findMemoryType(block.requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+		if (memoryType == UINT32_MAX)
+			throw std::runtime_error("Failed to find a memory type for transient images!");
+
+		VkMemoryAllocateInfo allocInfo = {};
+		allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+		allocInfo.allocationSize = block.requirements.size;
+		allocInfo.memoryTypeIndex = memoryType;
+
+		if (vkAllocateMemory(device, &allocInfo, nullptr, &block.memory) != VK_SUCCESS)
+			throw std::runtime_error("Failed to allocate transient image memory!");
+
+		for (Resource resource : block.images) {
+			ResourceInfo &info = resources[resource];
+			vkBindImageMemory(device, info.images[0], block.memory, 0);
+
+			VkImageViewCreateInfo viewInfo = {};
+			viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+			viewInfo.image = info.images[0];
+			viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+			viewInfo.format = info.format;
+			viewInfo.subresourceRange.aspectMask = isDepthFormat(info.format) ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+			viewInfo.subresourceRange.levelCount = 1;
+			viewInfo.subresourceRange.layerCount = 1;
+
+			info.views.resize(1);
+			if (vkCreateImageView(device, &viewInfo, nullptr, &info.views[0]) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create transient image view!");
+		}
+	}
+}
+
+void RenderGraph::computeBarriers() {
+	// ========================================================================
+	// ===						Start of the frame							===
+	// ========================================================================
+	// The previous frame ran the same graph, so the first access waits for how it left every image
+	std::vector<State> states(resources.size());
+	for (Resource resource = 0; resource < resources.size(); ++resource) {
+		const ResourceInfo &info = resources[resource];
+		auto accesses = getAccesses(resource);
+		if (info.buffer || accesses.empty())
+			continue;
+
+		State &state = states[resource];
+		if (info.imported && info.images.size() > 1) {
+			// Like swapchain images, the semaphore the frame waits on orders them, the barrier only has to start at its stage
+			state.layout = info.initialLayout;
+			state.writeStages = accesses.front()->stages;
+		} else if (info.imported) {
+			// The final transition already waits for the last frame
+			if (accesses.back()->layout != info.finalLayout)
+				state.writeStages = accesses.front()->stages;
+			else
+				state = getTailState(resource);
+			state.layout = info.initialLayout;
+		} else {
+			// The previous image in the memory block, or the block's last one in the previous frame
+			const Block &block = blocks[info.block];
+			auto it = std::find(block.images.begin(), block.images.end(), resource);
+			state = getTailState(it == block.images.begin() ? block.images.back() : *(it - 1));
+			state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+		}
+		state.visibleStages = 0;
+	}
+
+	// ========================================================================
+	// ===							Between passes							===
+	// ========================================================================
+	for (uint32_t index : order) {
+		Pass &pass = passes[index];
+		pass.imageBarriers.clear();
+		pass.barrierResources.clear();
+		pass.memoryBarrier = {};
+		pass.memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		pass.srcStages = pass.dstStages = 0;
+
+		for (const auto &access : pass.accesses) {
+			VkPipelineStageFlags srcStages;
+			VkAccessFlags srcAccess;
+			VkImageLayout oldLayout;
+			if (!synchronize(states[access.resource], access, srcStages, srcAccess, oldLayout))
+				continue;
+
+			pass.srcStages |= srcStages;
+			pass.dstStages |= access.stages;
+
+			if (access.kind == Pass::BUFFER) {
+				pass.memoryBarrier.srcAccessMask |= srcAccess;
+				pass.memoryBarrier.dstAccessMask |= access.access;
+				continue;
+			}
+
+			VkImageMemoryBarrier barrier = {};
+			barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			barrier.srcAccessMask = srcAccess;
+			barrier.dstAccessMask = access.access;
+			barrier.oldLayout = oldLayout;
+			barrier.newLayout = access.layout;
+			barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+			barrier.subresourceRange.aspectMask = getAspect(access.resource);
+			barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+			barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+			pass.imageBarriers.push_back(barrier);
+			pass.barrierResources.push_back(access.resource);
+		}
+	}
+
+	// ========================================================================
+	// ===							End of the frame						===
+	// ========================================================================
+	finalBarriers.clear();
+	finalBarrierResources.clear();
+	finalSrcStages = finalDstStages = 0;
+	for (Resource resource = 0; resource < resources.size(); ++resource) {
+		const ResourceInfo &info = resources[resource];
+		const State &state = states[resource];
+		if (!info.imported || info.firstPass == UINT32_MAX || state.layout == info.finalLayout)
+			continue;
+
+		// Presentation waits on a semaphore, shared images are next used by the next frame's first access
+		bool perFrame = info.images.size() > 1;
+		const Pass::Access *next = getAccesses(resource).front();
+
+		VkImageMemoryBarrier barrier = {};
+		barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		barrier.srcAccessMask = state.writeAccess;
+		barrier.dstAccessMask = perFrame ? 0 : next->access;
+		barrier.oldLayout = state.layout;
+		barrier.newLayout = info.finalLayout;
+		barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		barrier.subresourceRange.aspectMask = getAspect(resource);
+		barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+		barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+		finalBarriers.push_back(barrier);
+		finalBarrierResources.push_back(resource);
+
+		finalSrcStages |= state.writeStages | state.readStages;
+		finalDstStages |= perFrame ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : next->stages;
+	}
+}
+
+bool RenderGraph::synchronize(State &state, const Pass::Access &access, VkPipelineStageFlags &srcStages, VkAccessFlags &srcAccess, VkImageLayout &oldLayout) const {
+	bool transition = access.kind != Pass::BUFFER && access.layout != state.layout;
+	// Attachments that are cleared or don't care drop the old contents, which is cheaper to transition from
+	bool discard = (access.kind == Pass::COLOR || access.kind == Pass::DEPTH) && access.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+
+	srcStages = 0;
+	srcAccess = 0;
+	if (access.writes || transition) {
+		// Writes wait for the reads before them as well
+		srcStages = state.writeStages | state.readStages;
+		srcAccess = state.writeAccess;
+	} else if ((access.stages & ~state.visibleStages) != 0) {
+		srcStages = state.writeStages;
+		srcAccess = state.writeAccess;
+	}
+	oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+
+	if (access.writes || transition) {
+		state.writeStages = access.stages;
+		state.writeAccess = access.writes ? access.access & WRITE_ACCESS : 0;
+		state.readStages = 0;
+		// A write isn't visible to later commands of its own stages either, a transition is to the stages it waited for
+		state.visibleStages = access.writes ? 0 : access.stages;
+	} else {
+		state.readStages |= access.stages;
+		state.visibleStages |= access.stages;
+	}
+	state.layout = access.layout;
+
+	// Nothing to wait for, but the layout still has to change
+	if (transition && srcStages == 0)
+		srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+	return transition || srcStages != 0;
+}
+
+void RenderGraph::createRenderPasses() {
+	for (uint32_t position = 0; position < order.size(); ++position) {
+		Pass &pass = passes[order[position]];
+		if (!pass.graphics)
+			continue;
+
+		std::vector<VkAttachmentDescription> attachments;
+		std::vector<VkAttachmentReference> colorReferences;
+		VkAttachmentReference depthReference = {};
+		bool hasDepth = false;
+		std::vector<Resource> attached;
+		pass.clearValues.clear();
+
+		for (const auto &access : pass.accesses) {
+			if (access.kind != Pass::COLOR && access.kind != Pass::DEPTH)
+				continue;
+			const ResourceInfo &info = resources[access.resource];
+
+			// Barriers change the layouts, passes keep them
+			VkAttachmentDescription attachment = {};
+			attachment.format = info.format;
+			attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+			attachment.loadOp = access.loadOp;
+			attachment.storeOp = info.imported || info.lastPass > position ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+			attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+			attachment.initialLayout = access.layout;
+			attachment.finalLayout = access.layout;
+
+			VkAttachmentReference reference = {};
+			reference.attachment = static_cast<uint32_t>(attachments.size());
+			reference.layout = access.layout;
+			if (access.kind == Pass::DEPTH) {
+				depthReference = reference;
+				hasDepth = true;
+			} else {
+				colorReferences.push_back(reference);
+			}
+
+			attachments.push_back(attachment);
+			attached.push_back(access.resource);
+			pass.clearValues.push_back(access.clear);
+		}
+		if (attachments.empty())
+			throw std::invalid_argument("Graphics pass has no attachments!");
+
+		VkSubpassDescription subpass = {};
+		subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+		subpass.colorAttachmentCount = static_cast<uint32_t>(colorReferences.size());
+		subpass.pColorAttachments = colorReferences.data();
+		subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+		VkRenderPassCreateInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+		renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		renderPassInfo.pAttachments = attachments.data();
+		renderPassInfo.subpassCount = 1;
+		renderPassInfo.pSubpasses = &subpass;
+
+		if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &pass.renderPass) != VK_SUCCESS)
+			throw std::runtime_error("Failed to create render pass!");
+
+		// A framebuffer per frame if any attachment changes between frames
+		size_t framebufferCount = 1;
+		pass.extent = resources[attached[0]].extent;
+		for (Resource resource : attached) {
+			framebufferCount = std::max(framebufferCount, resources[resource].views.size());
+			pass.extent.width = std::min(pass.extent.width, resources[resource].extent.width);
+			pass.extent.height = std::min(pass.extent.height, resources[resource].extent.height);
+		}
+
+		pass.framebuffers.resize(framebufferCount, VK_NULL_HANDLE);
+		for (size_t frame = 0; frame < framebufferCount; ++frame) {
+			std::vector<VkImageView> views;
+			for (Resource resource : attached)
+				views.push_back(resources[resource].views[frame % resources[resource].views.size()]);
+
+			VkFramebufferCreateInfo framebufferInfo = {};
+			framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+			framebufferInfo.renderPass = pass.renderPass;
+			framebufferInfo.attachmentCount = static_cast<uint32_t>(views.size());
+			framebufferInfo.pAttachments = views.data();
+			framebufferInfo.width = pass.extent.width;
+			framebufferInfo.height = pass.extent.height;
+			framebufferInfo.layers = 1;
+
+			if (vkCreateFramebuffer(device, &framebufferInfo, nullptr, &pass.framebuffers[frame]) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create framebuffer!");
+		}
+	}
+}
+
+
+// ========================================================================
+// ===							Execution								===
+// ========================================================================
+
+void RenderGraph::execute(const VkCommandBuffer &buffer, uint32_t frame) const {
+	auto recordBarriers = [&](VkPipelineStageFlags srcStages, VkPipelineStageFlags dstStages, const VkMemoryBarrier *memoryBarrier, std::vector<VkImageMemoryBarrier> imageBarriers, const std::vector<Resource> &barrierResources) {
+		for (size_t i = 0; i < imageBarriers.size(); ++i)
+			imageBarriers[i].image = getImage(barrierResources[i], frame);
+
+		bool memory = memoryBarrier != nullptr && (memoryBarrier->srcAccessMask != 0 || memoryBarrier->dstAccessMask != 0);
+		vkCmdPipelineBarrier(buffer, srcStages, dstStages, 0,
+			memory ? 1 : 0, memoryBarrier,
+			0, nullptr,
+			static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	};
+
+	for (uint32_t index : order) {
+		const Pass &pass = passes[index];
+		if (pass.srcStages != 0)
+			recordBarriers(pass.srcStages, pass.dstStages, &pass.memoryBarrier, pass.imageBarriers, pass.barrierResources);
+
+		if (!pass.graphics) {
+			pass.record(buffer, frame);
+			continue;
+		}
+
+		VkExtent2D area = pass.renderArea ? pass.renderArea() : pass.extent;
+
+		VkRenderPassBeginInfo renderPassInfo = {};
+		renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+		renderPassInfo.renderPass = pass.renderPass;
+		renderPassInfo.framebuffer = pass.framebuffers[frame % pass.framebuffers.size()];
+		renderPassInfo.renderArea.offset = { 0, 0 };
+		renderPassInfo.renderArea.extent = area;
+		renderPassInfo.clearValueCount = static_cast<uint32_t>(pass.clearValues.size());
+		renderPassInfo.pClearValues = pass.clearValues.data();
+		vkCmdBeginRenderPass(buffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+
+		// Pipelines take the viewport and scissor as dynamic state
+		VkViewport viewport = {};
+		viewport.width = static_cast<float>(area.width);
+		viewport.height = static_cast<float>(area.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(buffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.extent = area;
+		vkCmdSetScissor(buffer, 0, 1, &scissor);
+
+		pass.record(buffer, frame);
+		vkCmdEndRenderPass(buffer);
+	}
+
+	if (!finalBarriers.empty())
+		recordBarriers(finalSrcStages, finalDstStages, nullptr, finalBarriers, finalBarrierResources);
+}
+
+
+// ========================================================================
+// ===							Queries									===
+// ========================================================================
+
+VkImageView RenderGraph::getImageView(Resource resource) const {
+	return resources[resource].views.empty() ? VK_NULL_HANDLE : resources[resource].views[0];
+}
+
+uint32_t RenderGraph::getPassCount() const {
+	return static_cast<uint32_t>(passes.size());
+}
+
+uint32_t RenderGraph::getCulledPassCount() const {
+	return static_cast<uint32_t>(passes.size() - order.size());
+}
+
+VkDeviceSize RenderGraph::getTransientMemorySize() const {
+	VkDeviceSize size = 0;
+	for (const auto &block : blocks)
+		size += block.requirements.size;
+	return size;
+}
+
+VkRenderPass RenderGraph::createCompatibleRenderPass(const VkDevice &device, VkFormat colorFormat, VkFormat depthFormat) {
+	// Compatibility only compares formats and sample counts
+	std::array<VkAttachmentDescription, 2> attachments = {};
+	attachments[0].format = colorFormat;
+	attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+	attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+	attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+	attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	attachments[1] = attachments[0];
+	attachments[1].format = depthFormat;
+	attachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	VkAttachmentReference colorReference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+	VkAttachmentReference depthReference = { 1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL };
+	bool hasDepth = depthFormat != VK_FORMAT_UNDEFINED;
+
+	VkSubpassDescription subpass = {};
+	subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+	subpass.colorAttachmentCount = 1;
+	subpass.pColorAttachments = &colorReference;
+	subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+	VkRenderPassCreateInfo renderPassInfo = {};
+	renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+	renderPassInfo.attachmentCount = hasDepth ? 2 : 1;
+	renderPassInfo.pAttachments = attachments.data();
+	renderPassInfo.subpassCount = 1;
+	renderPassInfo.pSubpasses = &subpass;
+
+	VkRenderPass renderPass;
+	if (vkCreateRenderPass(device, &renderPassInfo, nullptr, &renderPass) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create render pass!");
+	return renderPass;
+}
+
+
+// ========================================================================
+// ===							Helpers									===
+// ========================================================================
+
+bool RenderGraph::isDepthFormat(VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_D16_UNORM:
+	case VK_FORMAT_X8_D24_UNORM_PACK32:
+	case VK_FORMAT_D32_SFLOAT:
+	case VK_FORMAT_D16_UNORM_S8_UINT:
+	case VK_FORMAT_D24_UNORM_S8_UINT:
+	case VK_FORMAT_D32_SFLOAT_S8_UINT:
+		return true;
+	default:
+		return false;
+	}
+}
+
+VkImageAspectFlags RenderGraph::getAspect(Resource resource) const {
+	VkFormat format = resources[resource].format;
+	if (!isDepthFormat(format))
+		return VK_IMAGE_ASPECT_COLOR_BIT;
+
+	// Layouts of combined formats change for both aspects at once
+	bool stencil = format == VK_FORMAT_D16_UNORM_S8_UINT || format == VK_FORMAT_D24_UNORM_S8_UINT || format == VK_FORMAT_D32_SFLOAT_S8_UINT;
+	return VK_IMAGE_ASPECT_DEPTH_BIT | (stencil ? VK_IMAGE_ASPECT_STENCIL_BIT : 0);
+}
+
+uint32_t RenderGraph::findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties) const {
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+
+	for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i)
+		if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
+			return i;
+	return UINT32_MAX;
+}
+
+std::vector<const RenderGraph::Pass::Access *> RenderGraph::getAccesses(Resource resource) const {
+	std::vector<const Pass::Access *> accesses;
+	for (uint32_t index : order)
+		for (const auto &access : passes[index].accesses)
+			if (access.resource == resource)
+				accesses.push_back(&access);
+	return accesses;
+}
+
+RenderGraph::State RenderGraph::getTailState(Resource resource) const {
+	auto accesses = getAccesses(resource);
+
+	// Reads after the last write have to finish too before the next frame overwrites anything
+	State state;
+	for (auto it = accesses.rbegin(); it != accesses.rend(); ++it) {
+		state.writeStages |= (*it)->stages;
+		if ((*it)->writes) {
+			state.writeAccess = (*it)->access & WRITE_ACCESS;
+			break;
+		}
+	}
+	if (!accesses.empty())
+		state.layout = accesses.back()->layout;
+	return state;
+}
+
+VkImage RenderGraph::getImage(Resource resource, uint32_t frame) const {
+	const auto &images = resources[resource].images;
+	return images[frame % images.size()];
+}
\ No newline at end of file
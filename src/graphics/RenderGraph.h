@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		A frame described as passes and the resources they read and write.
+
+		Declare the resources and passes in execution order, then compile the graph once.
+		Compiling drops passes whose results nobody uses, derives image layouts, barriers and attachment load and store operations,
+		creates the render passes and framebuffers, and allocates the transient images.
+		Transient images that are never alive at the same time share memory, attachments that never leave their pass are lazily allocated where supported.
+		Executing records the whole frame into a command buffer, the passes' own callbacks record their work.
+
+		Buffers are only used to order passes, they have no handles and get memory barriers between passes of the same frame only.
+		The caller keeps a buffer per swapchain image, like the uniform buffers.
+	*/
+	class RenderGraph {
+	public:
+		typedef uint32_t Resource;
+		// Records the pass' work, gets the frame execute was called with
+		typedef std::function<void(const VkCommandBuffer &, uint32_t frame)> RecordFunction;
+
+		class Pass {
+			friend RenderGraph;
+		public:
+			/// Render into an image, LOAD keeps (and so reads) what earlier passes left in it
+			Pass &color(Resource, VkAttachmentLoadOp, VkClearColorValue clear = { { 0.0f, 0.0f, 0.0f, 1.0f } });
+			Pass &depth(Resource, VkAttachmentLoadOp, float clear = 1.0f);
+			/// Read an image through a sampler in the given shader stages
+			Pass &sample(Resource, VkPipelineStageFlags);
+			/// Read and write an image as a storage image in the given shader stages
+			Pass &storage(Resource, VkPipelineStageFlags);
+			Pass &read(Resource buffer, VkPipelineStageFlags, VkAccessFlags);
+			Pass &write(Resource buffer, VkPipelineStageFlags, VkAccessFlags);
+
+		private:
+			enum Kind { COLOR, DEPTH, SAMPLED, STORAGE, BUFFER };
+
+			struct Access {
+				Kind kind;
+				Resource resource;
+				VkPipelineStageFlags stages;
+				VkAccessFlags access;
+				VkImageLayout layout;
+				bool reads, writes;
+				// Attachments only
+				VkAttachmentLoadOp loadOp;
+				VkClearValue clear;
+			};
+
+			Pass(RenderGraph &, const char *name, bool graphics, RecordFunction &&, std::function<VkExtent2D()> &&renderArea);
+			Pass &access(Kind, Resource, VkPipelineStageFlags, VkAccessFlags, VkImageLayout, bool reads, bool writes);
+
+			RenderGraph &graph;
+			const char *name;
+			bool graphics;
+			RecordFunction record;
+			std::function<VkExtent2D()> renderArea;
+			std::vector<Access> accesses;
+
+			// Compiled
+			bool culled = false;
+			VkRenderPass renderPass = VK_NULL_HANDLE;
+			std::vector<VkFramebuffer> framebuffers;
+			VkExtent2D extent = {};
+			std::vector<VkClearValue> clearValues;
+			std::vector<VkImageMemoryBarrier> imageBarriers;
+			// Resource of every image barrier, their images are filled in per frame
+			std::vector<Resource> barrierResources;
+			VkMemoryBarrier memoryBarrier = {};
+			VkPipelineStageFlags srcStages = 0, dstStages = 0;
+		};
+
+		RenderGraph(const VkDevice &, const VkPhysicalDevice &);
+		~RenderGraph();
+
+		RenderGraph(const RenderGraph &) = delete;
+		RenderGraph &operator=(const RenderGraph &) = delete;
+
+		/// An image owned by the caller, one per frame (like swapchain images) or one for every frame
+		/// The graph expects it in initialLayout at the start of every frame, and leaves it in finalLayout
+		/// Images imported in the general layout never leave it
+		Resource importImage(const char *name, const std::vector<VkImage> &, const std::vector<VkImageView> &, VkFormat, VkExtent2D, VkImageLayout initialLayout, VkImageLayout finalLayout);
+		/// An image that only lives during the frame, allocated by the graph
+		Resource createImage(const char *name, VkFormat, VkExtent2D);
+		Resource createBuffer(const char *name);
+
+		/// Passes execute in the order they are added
+		/// Graphics passes render to their whole attachments, or to the given area with a matching viewport and scissor
+		Pass &addGraphicsPass(const char *name, RecordFunction record, std::function<VkExtent2D()> renderArea = nullptr);
+		Pass &addComputePass(const char *name, RecordFunction record);
+
+		void compile();
+		/// Record the frame, frame picks the image of resources imported with one per frame
+		void execute(const VkCommandBuffer &, uint32_t frame) const;
+
+		/// Only valid after compiling, and not for imported images
+		VkImageView getImageView(Resource) const;
+		uint32_t getPassCount() const;
+		uint32_t getCulledPassCount() const;
+		/// Memory of all transient images, after aliasing
+		VkDeviceSize getTransientMemorySize() const;
+
+		/// A render pass for creating pipelines, compatible with the graphics passes drawing to the same formats
+		/// depthFormat may be VK_FORMAT_UNDEFINED for passes without depth
+		static VkRenderPass createCompatibleRenderPass(const VkDevice &, VkFormat colorFormat, VkFormat depthFormat);
+
+	private:
+		struct ResourceInfo {
+			const char *name;
+			bool imported;
+			bool buffer;
+			std::vector<VkImage> images;
+			std::vector<VkImageView> views;
+			VkFormat format;
+			VkExtent2D extent;
+			VkImageLayout initialLayout, finalLayout;
+
+			// Compiled, passes are positions in the executed order
+			VkImageUsageFlags usage = 0;
+			uint32_t firstPass = UINT32_MAX, lastPass = 0;
+			// Contents only matter inside of a single pass
+			bool lazy = false;
+			uint32_t block = UINT32_MAX;
+		};
+
+		// Where an image was last synchronized, to order the next access against
+		struct State {
+			VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+			// The last write (or layout transition), and the reads after it
+			VkPipelineStageFlags writeStages = 0;
+			VkAccessFlags writeAccess = 0;
+			VkPipelineStageFlags readStages = 0;
+			// Stages that already see the last write
+			VkPipelineStageFlags visibleStages = 0;
+		};
+
+		// Memory shared by transient images whose lifetimes don't overlap
+		struct Block {
+			std::vector<Resource> images;
+			VkMemoryRequirements requirements;
+			bool lazy;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		};
+
+		static bool isDepthFormat(VkFormat);
+		VkImageAspectFlags getAspect(Resource) const;
+		uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags) const;
+		/// The accesses of a resource in the executed order
+		std::vector<const Pass::Access *> getAccesses(Resource) const;
+		/// What the next frame has to wait for, the last write and every read after it
+		State getTailState(Resource) const;
+		VkImage getImage(Resource, uint32_t frame) const;
+
+		void cullPasses();
+		void allocateImages();
+		void computeBarriers();
+		void createRenderPasses();
+		/// Order an access after the state, returns false if no barrier is needed
+		bool synchronize(State &, const Pass::Access &, VkPipelineStageFlags &srcStages, VkAccessFlags &srcAccess, VkImageLayout &oldLayout) const;
+
+		VkDevice device;
+		VkPhysicalDevice physicalDevice;
+
+		std::vector<ResourceInfo> resources;
+		// A deque keeps the references handed out to callers valid
+		std::deque<Pass> passes;
+		// Indices of the passes that weren't culled
+		std::vector<uint32_t> order;
+		std::vector<Block> blocks;
+
+		// Transitions to the final layouts of imported images, after the last pass
+		std::vector<VkImageMemoryBarrier> finalBarriers;
+		std::vector<Resource> finalBarrierResources;
+		VkPipelineStageFlags finalSrcStages = 0, finalDstStages = 0;
+	};
+}
@@ -0,0 +1,96 @@
+#include "RenderQueue.h"
+
+#include "../Jobs.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace Graphics;
+
+uint64_t RenderQueue::makeKey(Pass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth) {
+	// Non-negative floats order the same as their bits, keep the top ones below the sign
+	uint32_t depthBits;
+	depth = std::max(depth, 0.0f);
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+	depthBits >>= 31 - DEPTH_BITS;
+
+	uint64_t key = pass;
+	key = (key << PIPELINE_BITS) | (pipeline & ((1u << PIPELINE_BITS) - 1));
+	key = (key << MATERIAL_BITS) | (material & ((1u << MATERIAL_BITS) - 1));
+	key = (key << MESH_BITS) | (mesh & ((1u << MESH_BITS) - 1));
+	key = (key << DEPTH_BITS) | depthBits;
+	return key;
+}
+
+uint32_t RenderQueue::makeId(uint64_t handle) {
+	// Handles are mostly aligned pointers, the multiply spreads every bit into the upper half
+	return static_cast<uint32_t>((handle * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+void RenderQueue::clear() {
+	items.clear();
+}
+
+void RenderQueue::push(uint64_t key, uint32_t index) {
+	items.push_back({ key, index });
+}
+
+void RenderQueue::sort() {
+	size_t count = items.size();
+	if (count < 2)
+		return;
+
+	sorted.resize(count);
+	size_t chunkCount = count < PARALLEL_SORT_THRESHOLD ? 1 : Jobs::getThreadCount();
+	size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	histograms.resize(chunkCount * RADIX_SIZE);
+
+	auto forEachChunk = [&](const std::function<void(size_t chunk, size_t begin, size_t end)> &function) {
+		auto range = [&](size_t first, size_t last) {
+			for (size_t chunk = first; chunk < last; ++chunk)
+				function(chunk, chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize));
+		};
+		if (chunkCount == 1)
+			range(0, 1);
+		else
+			Jobs::parallelFor(chunkCount, 1, range);
+	};
+
+	// Least significant digit first, every pass is stable
+	for (uint32_t shift = 0; shift < 64; shift += RADIX_BITS) {
+		forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+			uint32_t *histogram = &histograms[chunk * RADIX_SIZE];
+			std::fill(histogram, histogram + RADIX_SIZE, 0);
+			for (size_t i = begin; i < end; ++i)
+				++histogram[(items[i].key >> shift) & (RADIX_SIZE - 1)];
+		});
+
+		// Chunks write each digit after the same digit of the chunks before them
+		uint32_t offset = 0;
+		bool singleDigit = false;
+		for (uint32_t digit = 0; digit < RADIX_SIZE; ++digit) {
+			uint32_t digitStart = offset;
+			for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+				uint32_t &slot = histograms[chunk * RADIX_SIZE + digit];
+				uint32_t digitCount = slot;
+				slot = offset;
+				offset += digitCount;
+			}
+			singleDigit = singleDigit || offset - digitStart == count;
+		}
+		// Every key has the same digit here, so the pass wouldn't move anything
+		if (singleDigit)
+			continue;
+
+		forEachChunk([&](size_t chunk, size_t begin, size_t end) {
+			uint32_t *histogram = &histograms[chunk * RADIX_SIZE];
+			for (size_t i = begin; i < end; ++i)
+				sorted[histogram[(items[i].key >> shift) & (RADIX_SIZE - 1)]++] = items[i];
+		});
+		items.swap(sorted);
+	}
+}
+
+const std::vector<RenderQueue::Item> &RenderQueue::getItems() const {
+	return items;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		Orders draws by 64-bit sort keys.
+
+		From the most significant bits: pass, pipeline, material, mesh and depth.
+		Sorting the keys groups draws that share state, and orders each group front to back by depth bucket.
+		Keys are radix sorted, split across the job threads for larger queues.
+	*/
+	class RenderQueue {
+	public:
+		enum Pass { PASS_OPAQUE, PASS_COUNT };
+
+		struct Item {
+			uint64_t key;
+			// Position of the draw in the caller's list
+			uint32_t index;
+		};
+
+		static const uint32_t PASS_BITS = 4;
+		static const uint32_t PIPELINE_BITS = 8;
+		static const uint32_t MATERIAL_BITS = 20;
+		static const uint32_t MESH_BITS = 20;
+		// Exponent and the top 4 mantissa bits, buckets are about 6% of their distance wide
+		// Coarse buckets keep the order (and recorded command buffers) stable while the camera moves a little
+		static const uint32_t DEPTH_BITS = 12;
+		// Smaller queues aren't worth waking up the job threads for
+		static const size_t PARALLEL_SORT_THRESHOLD = 4096;
+
+		/// pipeline, material and mesh only need to be equal for equal state, depth is a non-negative view distance
+		static uint64_t makeKey(Pass pass, uint32_t pipeline, uint32_t material, uint32_t mesh, float depth);
+		/// Fold a handle or pointer into an id for makeKey, different ones may rarely share an id
+		static uint32_t makeId(uint64_t handle);
+
+		void clear();
+		void push(uint64_t key, uint32_t index);
+		/// Sort by key, draws with equal keys keep the order they were pushed in
+		void sort();
+
+		const std::vector<Item> &getItems() const;
+
+	private:
+		static const uint32_t RADIX_BITS = 8;
+		static const uint32_t RADIX_SIZE = 1 << RADIX_BITS;
+
+		std::vector<Item> items, sorted;
+		// A digit histogram per chunk, turned into scatter offsets in place
+		std::vector<uint32_t> histograms;
+	};
+}
@@ -0,0 +1,67 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace Graphics;
+
+void ResolutionController::setBounds(float _minScale, float _maxScale) {
+	minScale = std::min(std::max(_minScale, SMALLEST_SCALE), 1.0f);
+	maxScale = std::min(std::max(_maxScale, minScale), 1.0f);
+	scale = std::min(std::max(scale, minScale), maxScale);
+	framesSinceChange = 0;
+}
+
+void ResolutionController::setTargetFrameTime(float milliseconds) {
+	targetFrameTime = std::max(milliseconds, 0.1f);
+}
+
+bool ResolutionController::update(float milliseconds) {
+	++framesSinceChange;
+	if (framesSinceChange <= IGNORED_FRAMES)
+		return false;
+
+	frameTime = framesSinceChange == IGNORED_FRAMES + 1 ? milliseconds : frameTime + (milliseconds - frameTime) * SMOOTHING;
+	if (framesSinceChange < SETTLE_FRAMES)
+		return false;
+
+	// The scale that would take the target time (or the headroom share of it when growing)
+	float desired = scale;
+	if (frameTime > targetFrameTime)
+		desired = scale * std::sqrt(targetFrameTime / frameTime);
+	else if (frameTime < targetFrameTime * HEADROOM)
+		desired = std::min(scale * std::sqrt(targetFrameTime * HEADROOM / frameTime), scale + SCALE_STEP);
+
+	// Rounding down shrinks at least a step when over the target, and never grows past the desired scale
+	desired = std::floor(desired / SCALE_STEP + 1e-3f) * SCALE_STEP;
+	desired = std::min(std::max(desired, minScale), maxScale);
+
+	if (std::abs(desired - scale) < SCALE_STEP * 0.5f)
+		return false;
+
+	scale = desired;
+	framesSinceChange = 0;
+	return true;
+}
+
+void ResolutionController::reset() {
+	scale = maxScale;
+	frameTime = 0.0f;
+	framesSinceChange = 0;
+}
+
+float ResolutionController::getScale() const {
+	return scale;
+}
+
+float ResolutionController::getMinScale() const {
+	return minScale;
+}
+
+float ResolutionController::getMaxScale() const {
+	return maxScale;
+}
+
+float ResolutionController::getFrameTime() const {
+	return frameTime;
+}
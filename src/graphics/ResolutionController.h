@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+
+namespace Graphics {
+
+	/*
+		Picks the share of the window to render at from measured GPU frame times.
+
+		GPU time is taken to grow with the pixel count, so the scale moves by the square root of the time ratio.
+		It drops as soon as frames run over the target and only grows back while they stay well under it.
+		Scales are quantized, so the render size (and recorded command buffers) only change in noticeable steps.
+	*/
+	class ResolutionController {
+	public:
+		/// Bounds of the scale along each axis, clamped to (0, 1] as nothing renders above the window size
+		void setBounds(float minScale, float maxScale);
+		/// GPU time per frame to stay under, in milliseconds
+		void setTargetFrameTime(float milliseconds);
+
+		/// Add the GPU time of a finished frame, true if the scale changed
+		bool update(float milliseconds);
+		/// Go back to the largest scale and forget the measured times
+		void reset();
+
+		float getScale() const;
+		float getMinScale() const;
+		float getMaxScale() const;
+		/// Smoothed GPU time of the current scale, 0 until it is measured
+		float getFrameTime() const;
+
+		static constexpr float SCALE_STEP = 0.05f;
+		static constexpr float SMALLEST_SCALE = 0.25f;
+		// Weight of every new frame in the smoothed time
+		static constexpr float SMOOTHING = 0.1f;
+		// Only grow while frames take less than this share of the target, so the scale doesn't flip back and forth
+		static constexpr float HEADROOM = 0.85f;
+		// Frames after a change that were still in flight at the old scale
+		static const uint32_t IGNORED_FRAMES = 4;
+		// Frames after a change before the scale changes again
+		static const uint32_t SETTLE_FRAMES = 16;
+
+	private:
+		float minScale = 0.5f;
+		float maxScale = 1.0f;
+		float targetFrameTime = 1000.0f / 60.0f;
+
+		float scale = 1.0f;
+		float frameTime = 0.0f;
+		uint32_t framesSinceChange = 0;
+	};
+}
@@ -1,3 +1,86 @@
 #include "Scene.h"
 
-Graphics::Scene::Scene(Camera & camera, Object & object) : camera(camera), object(object) {}
+Graphics::Scene::Scene(Camera & camera) : camera(camera) {}
+
+void Graphics::Scene::update() {
+	{
+		std::lock_guard<std::mutex> lock(lightsMutex);
+		if (lightsPending) {
+			lights.swap(pendingLights);
+			pendingLights.clear();
+			lightsPending = false;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(materialsMutex);
+		for (auto object : pendingMaterialObjects) {
+			object->material = object->pendingMaterial;
+			object->materialPending = false;
+		}
+		pendingMaterialObjects.clear();
+	}
+
+	transforms.update();
+
+	std::lock_guard<std::mutex> lock(bvhMutex);
+	pickProjectionView = camera.getProjectionViewMatrix();
+
+	// New objects enter the tree, moved ones refit it
+	size_t changed = 0;
+	for (auto object : objects) {
+		uint32_t revision = transforms.getRevision(object->transform);
+		if (object->bvhLeaf != BVH::INVALID_NODE && revision == object->boundsRevision)
+			continue;
+
+		AABB bounds = AABB::fromSphere(transforms.getWorldBounds(object->transform));
+		if (object->bvhLeaf == BVH::INVALID_NODE)
+			object->bvhLeaf = bvh.insert(object->transform, bounds);
+		else
+			bvh.update(object->bvhLeaf, bounds);
+
+		object->boundsRevision = revision;
+		++changed;
+	}
+
+	// Refits loosen the tree, after large changes a fresh build culls better
+	if (changed * 4 > bvh.size())
+		bvh.rebuild();
+}
+
+void Graphics::Scene::setLights(std::vector<Light> &&newLights) {
+	std::lock_guard<std::mutex> lock(lightsMutex);
+	pendingLights = std::move(newLights);
+	lightsPending = true;
+}
+
+void Graphics::Scene::cull(const Frustum &frustum, std::vector<Object *> &outVisible) {
+	std::lock_guard<std::mutex> lock(bvhMutex);
+	queryItems.clear();
+	bvh.cull(frustum, queryItems);
+
+	for (auto item : queryItems)
+		outVisible.push_back(transformObjects[item]);
+}
+
+Graphics::Object *Graphics::Scene::pick(const glm::vec2 &point) {
+	std::lock_guard<std::mutex> lock(bvhMutex);
+	glm::vec3 origin, direction;
+	Camera::getRay(pickProjectionView, point, origin, direction);
+
+	// The direction spans the whole depth range, so distances along it go from 0 to 1
+	uint32_t item;
+	float distance;
+	if (!bvh.raycast(origin, direction, 1.0f, item, distance))
+		return nullptr;
+	return transformObjects[item];
+}
+
+void Graphics::Scene::query(const BoundingSphere &sphere, std::vector<Object *> &outObjects) {
+	std::lock_guard<std::mutex> lock(bvhMutex);
+	queryItems.clear();
+	bvh.query(sphere, queryItems);
+
+	for (auto item : queryItems)
+		outObjects.push_back(transformObjects[item]);
+}
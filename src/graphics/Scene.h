@@ -1,8 +1,14 @@
 #pragma once
 
 
+#include "BVH.h"
 #include "Camera.h"
+#include "Light.h"
 #include "Object.h"
+#include "TransformStore.h"
+
+#include <mutex>
+#include <vector>
 
 namespace Graphics {
 
@@ -10,12 +16,52 @@ namespace Graphics {
 	A structure that holds a graphical scene
 	*/
 	struct Scene {
-		Scene(Camera &camera, Object &object);
+		Scene(Camera &camera);
+
+		/// Bring derived data, like world matrices and the BVH, up to date
+		/// Also applies lights handed over with setLights and materials set with Object::setMaterial
+		void update();
+
+		/// Replace the local lights from any thread, they take effect at the next update
+		void setLights(std::vector<Light> &&lights);
+
+		/// Objects whose bounds intersect the frustum
+		void cull(const Frustum &, std::vector<Object *> &outVisible);
+		/// Closest object under a point in normalized device coordinates, nullptr if there is none
+		/// Safe from any thread, sees the scene and camera as of the last update
+		Object *pick(const glm::vec2 &point);
+		/// Objects whose bounds intersect the sphere, like the ones a light reaches
+		/// Safe from any thread, sees the scene as of the last update
+		void query(const BoundingSphere &, std::vector<Object *> &outObjects);
 
 		Camera & camera;
-		Object & object;
+		// Objects add themselves on creation, the scene does not own them
+		std::vector<Object *> objects;
+		// Object of every transform handle, maps BVH items back to objects
+		std::vector<Object *> transformObjects;
+		TransformStore transforms;
+		BVH bvh;
+		// Main light, reaches everything without fading
 		glm::vec3 lightPosition = glm::vec3(1.0f);
 		glm::vec3 lightColor = glm::vec3(1.0f);
 		glm::vec3 ambientColor = glm::vec3(0.1f);
+		// Local lights on top of the main one, only the first Context::MAX_LIGHTS are drawn
+		// Read by the render thread, other threads go through setLights
+		std::vector<Light> lights;
+
+	private:
+		friend Object;
+
+		// Held while the BVH changes or is searched, so other threads can pick and query
+		std::mutex bvhMutex;
+		std::vector<uint32_t> queryItems;
+		// Camera as of the last update, picks from other threads must not touch the live one
+		glm::mat4 pickProjectionView = glm::mat4(1.0f);
+		std::mutex lightsMutex;
+		std::vector<Light> pendingLights;
+		bool lightsPending = false;
+		mutable std::mutex materialsMutex;
+		// Objects with a pending material, each listed once
+		std::vector<Object *> pendingMaterialObjects;
 	};
 };
\ No newline at end of file
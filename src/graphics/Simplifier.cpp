@@ -0,0 +1,273 @@
+#include "Simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace Graphics;
+
+namespace {
+	// Collapses may turn a triangle by at most ~75 degrees
+	const float MIN_NORMAL_COSINE = 0.25f;
+
+	// Sum of squared distances to a set of planes, stored as the upper half of a symmetric 4x4 matrix
+	// Planes are weighted by triangle area, evaluate() returns the weighted mean
+	struct Quadric {
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double weight = 0;
+
+		static Quadric fromPlane(const glm::dvec3 &normal, double distance, double weight) {
+			Quadric q;
+			q.a00 = weight * normal.x * normal.x;
+			q.a01 = weight * normal.x * normal.y;
+			q.a02 = weight * normal.x * normal.z;
+			q.a03 = weight * normal.x * distance;
+			q.a11 = weight * normal.y * normal.y;
+			q.a12 = weight * normal.y * normal.z;
+			q.a13 = weight * normal.y * distance;
+			q.a22 = weight * normal.z * normal.z;
+			q.a23 = weight * normal.z * distance;
+			q.a33 = weight * distance * distance;
+			q.weight = weight;
+			return q;
+		}
+
+		Quadric &operator+=(const Quadric &other) {
+			a00 += other.a00; a01 += other.a01; a02 += other.a02; a03 += other.a03;
+			a11 += other.a11; a12 += other.a12; a13 += other.a13;
+			a22 += other.a22; a23 += other.a23;
+			a33 += other.a33;
+			weight += other.weight;
+			return *this;
+		}
+
+		double evaluate(const glm::vec3 &point) const {
+			double x = point.x, y = point.y, z = point.z;
+			double error =
+				a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+				+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+				+ a22 * z * z + 2 * a23 * z
+				+ a33;
+			// Rounding can make the sum slightly negative
+			return weight > 0 ? std::max(error / weight, 0.0) : 0.0;
+		}
+	};
+
+	struct Collapse {
+		uint32_t from, to;
+		double cost;
+
+		bool operator<(const Collapse &other) const {
+			return cost < other.cost;
+		}
+	};
+
+	uint64_t edgeKey(uint32_t a, uint32_t b) {
+		return a < b ? (uint64_t(a) << 32) | b : (uint64_t(b) << 32) | a;
+	}
+
+	// Vertices that must not move: seams share a position with other vertices, borders have edges with a single triangle
+	std::vector<bool> findLockedVertices(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices) {
+		size_t vertexCount = positions.size();
+
+		// Give vertices with the same position one canonical index
+		std::vector<uint32_t> order(vertexCount);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			order[i] = i;
+		auto lessPosition = [&](uint32_t a, uint32_t b) {
+			const glm::vec3 &pa = positions[a], &pb = positions[b];
+			return pa.x != pb.x ? pa.x < pb.x : pa.y != pb.y ? pa.y < pb.y : pa.z < pb.z;
+		};
+		std::sort(order.begin(), order.end(), lessPosition);
+
+		std::vector<bool> locked(vertexCount, false);
+		std::vector<uint32_t> canonical(vertexCount);
+		for (size_t i = 0; i < vertexCount;) {
+			size_t end = i + 1;
+			while (end < vertexCount && positions[order[end]] == positions[order[i]])
+				++end;
+			for (size_t j = i; j < end; ++j) {
+				canonical[order[j]] = order[i];
+				locked[order[j]] = end - i > 1;
+			}
+			i = end;
+		}
+
+		// Every closed-surface edge is shared by exactly two triangles
+		std::vector<uint64_t> edges;
+		edges.reserve(indices.size());
+		for (size_t i = 0; i < indices.size(); i += 3)
+			for (int e = 0; e < 3; ++e)
+				edges.push_back(edgeKey(canonical[indices[i + e]], canonical[indices[i + (e + 1) % 3]]));
+		std::sort(edges.begin(), edges.end());
+
+		std::vector<bool> lockedCanonical(vertexCount, false);
+		for (size_t i = 0; i < edges.size();) {
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end] == edges[i])
+				++end;
+			if (end - i != 2) {
+				lockedCanonical[uint32_t(edges[i] >> 32)] = true;
+				lockedCanonical[uint32_t(edges[i])] = true;
+			}
+			i = end;
+		}
+
+		for (size_t i = 0; i < vertexCount; ++i)
+			locked[i] = locked[i] || lockedCanonical[canonical[i]];
+		return locked;
+	}
+}
+
+std::vector<uint32_t> Simplifier::simplify(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t targetIndexCount, float maxError, float &outError) {
+	size_t vertexCount = positions.size();
+	std::vector<uint32_t> result = indices;
+	double maxCost = double(maxError) * maxError;
+	double worstCost = 0.0;
+
+	std::vector<bool> locked = findLockedVertices(positions, indices);
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		glm::dvec3 a = positions[indices[i]], b = positions[indices[i + 1]], c = positions[indices[i + 2]];
+		glm::dvec3 normal = glm::cross(b - a, c - a);
+		double length = glm::length(normal);
+		if (length == 0.0)
+			continue;
+		normal /= length;
+
+		Quadric plane = Quadric::fromPlane(normal, -glm::dot(normal, a), length * 0.5);
+		for (int j = 0; j < 3; ++j)
+			quadrics[indices[i + j]] += plane;
+	}
+
+	std::vector<uint32_t> adjacencyStart(vertexCount + 1), adjacency;
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<uint32_t> neighborMark(vertexCount, UINT32_MAX);
+	uint32_t markCount = 0;
+	std::vector<uint32_t> collapseTarget(vertexCount);
+
+	// Each pass collapses a set of edges that don't share any triangles, then rebuilds the index list
+	while (result.size() > targetIndexCount) {
+		// ========================================================================
+		// ===						Vertex to triangle adjacency					===
+		// ========================================================================
+		std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+		for (auto index : result)
+			++adjacencyStart[index + 1];
+		for (size_t i = 0; i < vertexCount; ++i)
+			adjacencyStart[i + 1] += adjacencyStart[i];
+		adjacency.resize(result.size());
+		std::vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (size_t i = 0; i < result.size(); ++i)
+			adjacency[fill[result[i]]++] = uint32_t(i / 3);
+
+		// ========================================================================
+		// ===							Candidate collapses						===
+		// ========================================================================
+		collapses.clear();
+		for (size_t i = 0; i < result.size(); i += 3) {
+			for (int e = 0; e < 3; ++e) {
+				uint32_t a = result[i + e], b = result[i + (e + 1) % 3];
+				Quadric sum = quadrics[a];
+				sum += quadrics[b];
+
+				if (!locked[a])
+					collapses.push_back({ a, b, sum.evaluate(positions[b]) });
+				if (!locked[b])
+					collapses.push_back({ b, a, sum.evaluate(positions[a]) });
+			}
+		}
+		std::sort(collapses.begin(), collapses.end());
+
+		// ========================================================================
+		// ===							Apply the cheapest						===
+		// ========================================================================
+		std::fill(touched.begin(), touched.end(), false);
+		for (uint32_t i = 0; i < vertexCount; ++i)
+			collapseTarget[i] = i;
+
+		// An interior collapse removes two triangles
+		size_t trianglesToRemove = (result.size() - targetIndexCount + 2) / 3;
+		size_t removed = 0;
+		size_t collapseCount = 0;
+
+		for (const auto &collapse : collapses) {
+			if (collapse.cost > maxCost || removed >= trianglesToRemove)
+				break;
+			uint32_t from = collapse.from, to = collapse.to;
+			if (touched[from] || touched[to])
+				continue;
+
+			// Edges whose ends share more than the two opposite vertices would pinch the surface
+			uint32_t mark = markCount++;
+			for (uint32_t t = adjacencyStart[from]; t < adjacencyStart[from + 1]; ++t)
+				for (int j = 0; j < 3; ++j)
+					neighborMark[result[adjacency[t] * 3 + j]] = mark;
+			int sharedNeighbors = 0;
+			for (uint32_t t = adjacencyStart[to]; t < adjacencyStart[to + 1]; ++t)
+				for (int j = 0; j < 3; ++j) {
+					uint32_t vertex = result[adjacency[t] * 3 + j];
+					if (vertex != from && vertex != to && neighborMark[vertex] == mark) {
+						++sharedNeighbors;
+						// Counted once per triangle it appears in, mark it as counted
+						neighborMark[vertex] = UINT32_MAX;
+					}
+				}
+			if (sharedNeighbors > 2)
+				continue;
+
+			// Moving the vertex must not flip (or nearly flip) any of the remaining triangles around it
+			bool flips = false;
+			for (uint32_t t = adjacencyStart[from]; t < adjacencyStart[from + 1] && !flips; ++t) {
+				const uint32_t *triangle = &result[adjacency[t] * 3];
+				if (triangle[0] == to || triangle[1] == to || triangle[2] == to)
+					continue;
+
+				glm::vec3 before[3], after[3];
+				for (int j = 0; j < 3; ++j) {
+					before[j] = positions[triangle[j]];
+					after[j] = triangle[j] == from ? positions[to] : before[j];
+				}
+				glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+				glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+				flips = glm::dot(normalBefore, normalAfter) <= MIN_NORMAL_COSINE * glm::length(normalBefore) * glm::length(normalAfter);
+			}
+			if (flips)
+				continue;
+
+			collapseTarget[from] = to;
+			quadrics[to] += quadrics[from];
+			worstCost = std::max(worstCost, collapse.cost);
+			++collapseCount;
+			removed += 2;
+
+			// Triangles around the collapsed vertex changed, so their vertices wait for the next pass
+			for (uint32_t t = adjacencyStart[from]; t < adjacencyStart[from + 1]; ++t)
+				for (int j = 0; j < 3; ++j)
+					touched[result[adjacency[t] * 3 + j]] = true;
+		}
+
+		if (collapseCount == 0)
+			break;
+
+		// Drop the triangles that collapsed into lines
+		size_t write = 0;
+		for (size_t i = 0; i < result.size(); i += 3) {
+			uint32_t a = collapseTarget[result[i]], b = collapseTarget[result[i + 1]], c = collapseTarget[result[i + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	outError = float(std::sqrt(worstCost));
+	return result;
+}
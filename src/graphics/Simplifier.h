@@ -0,0 +1,23 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		Mesh simplification with quadric error metrics (Garland & Heckbert).
+
+		Vertices only ever collapse onto one of their neighbors, so simplified index lists
+		keep referencing the original vertex buffer. Vertices on open borders and on seams
+		(several vertices sharing a position) never move, which keeps the outline and texturing intact.
+	*/
+	namespace Simplifier {
+
+		/// Collapse edges until at most targetIndexCount indices remain, or the next collapse would exceed maxError
+		/// outError receives the largest error of the collapses done, as a distance in model units
+		std::vector<uint32_t> simplify(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &indices, size_t targetIndexCount, float maxError, float &outError);
+	}
+}
@@ -29,11 +29,10 @@ Texture::Texture(Context &context, int width, int height, void *pixels) : contex
 		image, imageMemory);
 
 	context.transitionImageLayout(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-	context.copyBufferToImage(stagingBuffer, image, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
+	uint64_t copied = context.copyBufferToImage(stagingBuffer, image, static_cast<uint32_t>(width), static_cast<uint32_t>(height));
 	context.transitionImageLayout(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 
-	vkDestroyBuffer(context.device, stagingBuffer, nullptr);
-	vkFreeMemory(context.device, stagingBufferMemory, nullptr);
+	context.releaseStagingBuffer(stagingBuffer, stagingBufferMemory, copied);
 
 	//	=======================================================================
 	//	===					Create texture image view						===
@@ -67,13 +66,29 @@ Texture::Texture(Context &context, int width, int height, void *pixels) : contex
 
 	if (vkCreateSampler(context.device, &samplerInfo, nullptr, &sampler) != VK_SUCCESS)
 		throw std::runtime_error("Failed to create texture sampler!");
+
+	if (context.bindlessEnabled)
+		bindlessIndex = context.registerBindlessTexture(*this);
 }
 
 Texture::~Texture() {
-	vkDeviceWaitIdle(context.device);
-
-	vkDestroySampler(context.device, sampler, nullptr);
-	vkDestroyImageView(context.device, imageView, nullptr);
-	vkDestroyImage(context.device, image, nullptr);
-	vkFreeMemory(context.device, imageMemory, nullptr);
+	if (bindlessIndex != UINT32_MAX)
+		context.releaseBindlessTexture(bindlessIndex);
+	else
+		context.forgetDescriptorSets(*this);
+	context.invalidateCommandBuffers();
+
+	// Frames in flight may still be sampling the texture, so the image outlives it slightly
+	VkDevice device = context.device;
+	VkSampler sampler = this->sampler;
+	VkImageView imageView = this->imageView;
+	VkImage image = this->image;
+	VkDeviceMemory imageMemory = this->imageMemory;
+
+	context.deferDestruction([=]() {
+		vkDestroySampler(device, sampler, nullptr);
+		vkDestroyImageView(device, imageView, nullptr);
+		vkDestroyImage(device, image, nullptr);
+		vkFreeMemory(device, imageMemory, nullptr);
+	});
 }
@@ -2,6 +2,8 @@
 
 #include <vulkan/vulkan.h>
 
+#include <cstdint>
+
 namespace Graphics {
 	class Context;
 	class Object;
@@ -23,5 +25,8 @@ namespace Graphics {
 		VkImageView		imageView;
 		VkDeviceMemory	imageMemory;
 		VkSampler		sampler;
+
+		// Slot in the context's bindless texture array, if bindless mode is in use
+		uint32_t		bindlessIndex = UINT32_MAX;
 	};
 }
\ No newline at end of file
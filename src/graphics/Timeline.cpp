@@ -0,0 +1,185 @@
+#include "Timeline.h"
+
+#include <limits>
+#include <stdexcept>
+
+using namespace Graphics;
+
+Timeline::Timeline(const VkDevice &device, bool timelineSemaphore) : device(device) {
+	if (!timelineSemaphore)
+		return;
+
+	getSemaphoreCounterValue = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR"));
+	waitSemaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR"));
+	if (getSemaphoreCounterValue == nullptr || waitSemaphores == nullptr)
+		throw std::runtime_error("Failed to load timeline semaphore functions!");
+
+	VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+	typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+	typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+	typeInfo.initialValue = 0;
+
+	VkSemaphoreCreateInfo semaphoreInfo = {};
+	semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+	semaphoreInfo.pNext = &typeInfo;
+
+	if (vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS)
+		throw std::runtime_error("Failed to create timeline semaphore!");
+}
+
+Timeline::~Timeline() {
+	wait(submittedValue);
+
+	if (semaphore != VK_NULL_HANDLE)
+		vkDestroySemaphore(device, semaphore, nullptr);
+	for (auto fence : freeFences)
+		vkDestroyFence(device, fence, nullptr);
+}
+
+uint64_t Timeline::submit(const VkQueue &queue, const VkSubmitInfo &info, uint64_t waitValue, VkPipelineStageFlags waitStages) {
+	// Fences can't be waited on by the GPU, so the CPU waits first, without holding up other threads
+	if (semaphore == VK_NULL_HANDLE)
+		wait(waitValue);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	uint64_t value = submittedValue + 1;
+	VkSubmitInfo submitInfo = info;
+	VkFence fence = VK_NULL_HANDLE;
+
+	std::vector<VkSemaphore> waitSemaphoreList(info.pWaitSemaphores, info.pWaitSemaphores + info.waitSemaphoreCount);
+	std::vector<VkPipelineStageFlags> waitStageList(info.pWaitDstStageMask, info.pWaitDstStageMask + info.waitSemaphoreCount);
+	std::vector<VkSemaphore> signalSemaphoreList(info.pSignalSemaphores, info.pSignalSemaphores + info.signalSemaphoreCount);
+	// Values of binary semaphores are ignored
+	std::vector<uint64_t> waitValues(info.waitSemaphoreCount, 0);
+	std::vector<uint64_t> signalValues(info.signalSemaphoreCount, 0);
+	VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+
+	if (semaphore != VK_NULL_HANDLE) {
+		if (waitValue > 0) {
+			waitSemaphoreList.push_back(semaphore);
+			waitStageList.push_back(waitStages);
+			waitValues.push_back(waitValue);
+		}
+		signalSemaphoreList.push_back(semaphore);
+		signalValues.push_back(value);
+
+		timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+		timelineInfo.pNext = info.pNext;
+		timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+		timelineInfo.pWaitSemaphoreValues = waitValues.data();
+		timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+		timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
+		submitInfo.pNext = &timelineInfo;
+		submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphoreList.size());
+		submitInfo.pWaitSemaphores = waitSemaphoreList.data();
+		submitInfo.pWaitDstStageMask = waitStageList.data();
+		submitInfo.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphoreList.size());
+		submitInfo.pSignalSemaphores = signalSemaphoreList.data();
+	} else {
+		retireFences();
+
+		// A thread may still be waiting on a retired fence, which a reset would send back to unsignaled
+		if (freeFences.empty() || waitingThreads > 0) {
+			VkFenceCreateInfo fenceInfo = {};
+			fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+			if (vkCreateFence(device, &fenceInfo, nullptr, &fence) != VK_SUCCESS)
+				throw std::runtime_error("Failed to create timeline fence!");
+		} else {
+			fence = freeFences.back();
+			freeFences.pop_back();
+			vkResetFences(device, 1, &fence);
+		}
+	}
+
+	if (vkQueueSubmit(queue, 1, &submitInfo, fence) != VK_SUCCESS) {
+		if (fence != VK_NULL_HANDLE)
+			freeFences.push_back(fence);
+		throw std::runtime_error("Failed to submit to the timeline!");
+	}
+
+	if (fence != VK_NULL_HANDLE)
+		pendingFences.push_back({ value, fence });
+	submittedValue = value;
+	return value;
+}
+
+VkResult Timeline::present(const VkQueue &queue, const VkPresentInfoKHR &info) {
+	std::lock_guard<std::mutex> lock(mutex);
+	return vkQueuePresentKHR(queue, &info);
+}
+
+void Timeline::wait(uint64_t value) {
+	if (semaphore != VK_NULL_HANDLE) {
+		if (value == 0)
+			return;
+
+		VkSemaphoreWaitInfoKHR waitInfo = {};
+		waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+		waitInfo.semaphoreCount = 1;
+		waitInfo.pSemaphores = &semaphore;
+		waitInfo.pValues = &value;
+		// Doesn't need the lock, so other threads keep submitting meanwhile
+		waitSemaphores(device, &waitInfo, std::numeric_limits<uint64_t>::max());
+		return;
+	}
+
+	VkFence fence = VK_NULL_HANDLE;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (value <= completedValue)
+			return;
+
+		// A signaled fence means every earlier submission has finished too, so only the value's own fence is waited for
+		for (const auto &pending : pendingFences) {
+			if (pending.first >= value) {
+				fence = pending.second;
+				break;
+			}
+		}
+		if (fence == VK_NULL_HANDLE)
+			return;
+		++waitingThreads;
+	}
+
+	// Other threads keep submitting and presenting meanwhile
+	vkWaitForFences(device, 1, &fence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+
+	std::lock_guard<std::mutex> lock(mutex);
+	--waitingThreads;
+	retireFences();
+}
+
+bool Timeline::isComplete(uint64_t value) {
+	return value <= getCompletedValue();
+}
+
+uint64_t Timeline::getCompletedValue() {
+	if (semaphore != VK_NULL_HANDLE) {
+		uint64_t value;
+		getSemaphoreCounterValue(device, semaphore, &value);
+		return value;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	retireFences();
+	return completedValue;
+}
+
+uint64_t Timeline::getSubmittedValue() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return submittedValue;
+}
+
+bool Timeline::usesSemaphore() const {
+	return semaphore != VK_NULL_HANDLE;
+}
+
+void Timeline::retireFences() {
+	while (!pendingFences.empty() && vkGetFenceStatus(device, pendingFences.front().second) == VK_SUCCESS) {
+		completedValue = pendingFences.front().first;
+		freeFences.push_back(pendingFences.front().second);
+		pendingFences.pop_front();
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		The GPU's progress through the submissions of a queue, as a counter.
+
+		Every submission signals the next value, so reaching a value means everything submitted up to it has finished.
+		Uses a timeline semaphore where VK_KHR_timeline_semaphore is enabled, and a fence per submission elsewhere.
+		Only the semaphore can be waited on by later submissions, with fences the CPU waits before submitting instead.
+		Submitting through the timeline locks the queue, so any thread may submit, poll and wait.
+	*/
+	class Timeline {
+	public:
+		Timeline(const VkDevice &, bool timelineSemaphore);
+		~Timeline();
+
+		Timeline(const Timeline &) = delete;
+		Timeline &operator=(const Timeline &) = delete;
+
+		/// Submit a batch that signals the next value, returns that value
+		/// The batch's own waits and signals are kept, it additionally waits for waitValue in the given stages
+		uint64_t submit(const VkQueue &, const VkSubmitInfo &, uint64_t waitValue = 0, VkPipelineStageFlags waitStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+		/// Present with the queue locked like submissions are
+		VkResult present(const VkQueue &, const VkPresentInfoKHR &);
+
+		/// Block until every submission up to value has finished, value has to be submitted already
+		void wait(uint64_t value);
+		/// Whether every submission up to value has finished, never blocks
+		bool isComplete(uint64_t value);
+		uint64_t getCompletedValue();
+		uint64_t getSubmittedValue();
+
+		/// Whether later submissions wait on the GPU, rather than the CPU waiting before submitting them
+		bool usesSemaphore() const;
+
+	private:
+		// Fallback only, recycles the fences of finished submissions, expects the mutex to be locked
+		void retireFences();
+
+		VkDevice device;
+		std::mutex mutex;
+		uint64_t submittedValue = 0;
+
+		VkSemaphore semaphore = VK_NULL_HANDLE;
+		PFN_vkGetSemaphoreCounterValueKHR getSemaphoreCounterValue = nullptr;
+		PFN_vkWaitSemaphoresKHR waitSemaphores = nullptr;
+
+		// Fence of every submission that isn't known to have finished, oldest first
+		std::deque<std::pair<uint64_t, VkFence>> pendingFences;
+		std::vector<VkFence> freeFences;
+		uint64_t completedValue = 0;
+		// Threads blocked on a fence without the mutex, fences aren't reused while there are any
+		uint32_t waitingThreads = 0;
+	};
+}
@@ -0,0 +1,506 @@
+#include "TransformStore.h"
+
+#include "../Jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include <xmmintrin.h>
+
+using namespace Graphics;
+
+namespace {
+	// Reorder values so that values[i] = old values[newToOld[i]], or the filler for new slots
+	template<typename Type> void permute(std::vector<Type> &values, const std::vector<uint32_t> &newToOld, const Type &filler) {
+		std::vector<Type> result(newToOld.size(), filler);
+		for (size_t i = 0; i < newToOld.size(); ++i)
+			if (newToOld[i] != UINT32_MAX)
+				result[i] = values[newToOld[i]];
+		values.swap(result);
+	}
+}
+
+TransformStore::TransformStore() {}
+
+TransformStore::Handle TransformStore::create(Handle parent) {
+	Handle handle;
+	if (!freeHandles.empty()) {
+		handle = freeHandles.back();
+		freeHandles.pop_back();
+	} else {
+		handle = static_cast<Handle>(handleToDense.size());
+		handleToDense.push_back(0);
+		parentHandle.push_back(INVALID_HANDLE);
+		firstChildHandle.push_back(INVALID_HANDLE);
+		nextSiblingHandle.push_back(INVALID_HANDLE);
+		previousSiblingHandle.push_back(INVALID_HANDLE);
+	}
+
+	// New transforms go to the end for now, the next update moves them into their level
+	size_t index = slotCount;
+	resizeSlots(slotCount + 1);
+
+	handleToDense[handle] = static_cast<uint32_t>(index);
+	denseToHandle[index] = handle;
+	parentHandle[handle] = parent;
+	link(handle);
+	++count;
+
+	reparented.push_back(handle);
+	hierarchyChanged = true;
+	return handle;
+}
+
+void TransformStore::destroy(Handle handle) {
+	unlink(handle);
+
+	// Only the direct children move, their own subtrees come along
+	for (Handle child = firstChildHandle[handle]; child != INVALID_HANDLE;) {
+		Handle next = nextSiblingHandle[child];
+		parentHandle[child] = parentHandle[handle];
+		link(child);
+		reparented.push_back(child);
+		child = next;
+	}
+	firstChildHandle[handle] = INVALID_HANDLE;
+
+	size_t index = handleToDense[handle];
+	resetSlot(index);
+	denseToHandle[index] = INVALID_HANDLE;
+	dirty[index / WORD_BITS] &= ~(uint64_t(1) << (index % WORD_BITS));
+
+	parentHandle[handle] = INVALID_HANDLE;
+	freeHandles.push_back(handle);
+	--count;
+
+	hierarchyChanged = true;
+}
+
+void TransformStore::setParent(Handle handle, Handle parent) {
+	for (Handle ancestor = parent; ancestor != INVALID_HANDLE; ancestor = parentHandle[ancestor])
+		if (ancestor == handle)
+			throw std::invalid_argument("Transform can't be parented to its own descendant!");
+
+	unlink(handle);
+	parentHandle[handle] = parent;
+	link(handle);
+	reparented.push_back(handle);
+	hierarchyChanged = true;
+}
+
+TransformStore::Handle TransformStore::getParent(Handle handle) const {
+	return parentHandle[handle];
+}
+
+void TransformStore::setPosition(Handle handle, const glm::vec3 &position) {
+	size_t index = handleToDense[handle];
+	positionX[index] = position.x;
+	positionY[index] = position.y;
+	positionZ[index] = position.z;
+	markDirty(index);
+}
+
+void TransformStore::setRotation(Handle handle, const glm::quat &rotation) {
+	size_t index = handleToDense[handle];
+	rotationX[index] = rotation.x;
+	rotationY[index] = rotation.y;
+	rotationZ[index] = rotation.z;
+	rotationW[index] = rotation.w;
+	markDirty(index);
+}
+
+void TransformStore::setScale(Handle handle, const glm::vec3 &scale) {
+	size_t index = handleToDense[handle];
+	scaleX[index] = scale.x;
+	scaleY[index] = scale.y;
+	scaleZ[index] = scale.z;
+	markDirty(index);
+}
+
+void TransformStore::setBounds(Handle handle, const BoundingSphere &bounds) {
+	size_t index = handleToDense[handle];
+	boundsX[index] = bounds.center.x;
+	boundsY[index] = bounds.center.y;
+	boundsZ[index] = bounds.center.z;
+	boundsRadius[index] = bounds.radius;
+	markDirty(index);
+}
+
+const glm::mat4 &TransformStore::getWorldMatrix(Handle handle) const {
+	return worldMatrices[handleToDense[handle]];
+}
+
+const glm::mat3x4 &TransformStore::getNormalMatrix(Handle handle) const {
+	return normalMatrices[handleToDense[handle]];
+}
+
+uint32_t TransformStore::getRevision(Handle handle) const {
+	return revisions[handleToDense[handle]];
+}
+
+BoundingSphere TransformStore::getWorldBounds(Handle handle) const {
+	size_t index = handleToDense[handle];
+	BoundingSphere bounds;
+	bounds.center = glm::vec3(worldBoundsX[index], worldBoundsY[index], worldBoundsZ[index]);
+	bounds.radius = worldBoundsRadius[index];
+	return bounds;
+}
+
+void TransformStore::update() {
+	if (hierarchyChanged)
+		rebuildHierarchy();
+
+	// Parents have to be final before their children, so levels go one after another
+	for (size_t level = 0; level + 1 < levelStart.size(); ++level)
+		updateLevel(level);
+}
+
+void TransformStore::cull(const Frustum &frustum) {
+	size_t padded = worldBoundsX.size();
+	visible.resize(padded);
+
+	Jobs::parallelFor(padded / 4, CULL_GROUPS_PER_JOB, [&](size_t begin, size_t end) {
+		size_t first = begin * 4;
+		frustum.intersects(&worldBoundsX[first], &worldBoundsY[first], &worldBoundsZ[first], &worldBoundsRadius[first], (end - begin) * 4, &visible[first]);
+	});
+}
+
+bool TransformStore::isVisible(Handle handle) const {
+	size_t index = handleToDense[handle];
+	return index < visible.size() && visible[index] != 0;
+}
+
+size_t TransformStore::size() const {
+	return count;
+}
+
+void TransformStore::resizeSlots(size_t newSlotCount) {
+	size_t oldPadded = positionX.size();
+	size_t padded = (newSlotCount + 3) & ~size_t(3);
+
+	if (padded != oldPadded) {
+		positionX.resize(padded); positionY.resize(padded); positionZ.resize(padded);
+		rotationX.resize(padded); rotationY.resize(padded); rotationZ.resize(padded); rotationW.resize(padded);
+		scaleX.resize(padded); scaleY.resize(padded); scaleZ.resize(padded);
+		worldMatrices.resize(padded);
+		normalMatrices.resize(padded);
+		revisions.resize(padded, 0);
+		boundsX.resize(padded); boundsY.resize(padded); boundsZ.resize(padded); boundsRadius.resize(padded);
+		worldBoundsX.resize(padded); worldBoundsY.resize(padded); worldBoundsZ.resize(padded); worldBoundsRadius.resize(padded);
+		denseToHandle.resize(padded, INVALID_HANDLE);
+		parentIndex.resize(padded, NO_INDEX);
+		firstChild.resize(padded, 0);
+		childCount.resize(padded, 0);
+		dirty.resize((padded + WORD_BITS - 1) / WORD_BITS);
+
+		// Padding is kept as identity, so 4-wide batches never read garbage
+		for (size_t i = oldPadded; i < padded; ++i)
+			resetSlot(i);
+	}
+
+	slotCount = newSlotCount;
+}
+
+void TransformStore::resetSlot(size_t index) {
+	positionX[index] = positionY[index] = positionZ[index] = 0.0f;
+	rotationX[index] = rotationY[index] = rotationZ[index] = 0.0f;
+	rotationW[index] = 1.0f;
+	scaleX[index] = scaleY[index] = scaleZ[index] = 1.0f;
+	worldMatrices[index] = glm::mat4(1.0f);
+	normalMatrices[index] = glm::mat3x4(1.0f);
+	boundsX[index] = boundsY[index] = boundsZ[index] = boundsRadius[index] = 0.0f;
+	worldBoundsX[index] = worldBoundsY[index] = worldBoundsZ[index] = worldBoundsRadius[index] = 0.0f;
+}
+
+void TransformStore::markDirty(size_t index) {
+	dirty[index / WORD_BITS] |= uint64_t(1) << (index % WORD_BITS);
+}
+
+void TransformStore::link(Handle handle) {
+	Handle parent = parentHandle[handle];
+	previousSiblingHandle[handle] = INVALID_HANDLE;
+	nextSiblingHandle[handle] = INVALID_HANDLE;
+	if (parent == INVALID_HANDLE)
+		return;
+
+	Handle next = firstChildHandle[parent];
+	nextSiblingHandle[handle] = next;
+	if (next != INVALID_HANDLE)
+		previousSiblingHandle[next] = handle;
+	firstChildHandle[parent] = handle;
+}
+
+void TransformStore::unlink(Handle handle) {
+	Handle previous = previousSiblingHandle[handle], next = nextSiblingHandle[handle];
+	if (previous != INVALID_HANDLE)
+		nextSiblingHandle[previous] = next;
+	else if (parentHandle[handle] != INVALID_HANDLE)
+		firstChildHandle[parentHandle[handle]] = next;
+	if (next != INVALID_HANDLE)
+		previousSiblingHandle[next] = previous;
+
+	previousSiblingHandle[handle] = INVALID_HANDLE;
+	nextSiblingHandle[handle] = INVALID_HANDLE;
+}
+
+void TransformStore::rebuildHierarchy() {
+	// Live handles in their current order, so the new order is stable
+	std::vector<Handle> live;
+	live.reserve(count);
+	for (size_t i = 0; i < slotCount; ++i)
+		if (denseToHandle[i] != INVALID_HANDLE)
+			live.push_back(denseToHandle[i]);
+
+	// Dirty bits are per slot, so they are carried over by handle
+	std::vector<Handle> changed;
+	changed.swap(reparented);
+	for (size_t i = 0; i < slotCount; ++i)
+		if (denseToHandle[i] != INVALID_HANDLE && (dirty[i / WORD_BITS] >> (i % WORD_BITS)) & 1)
+			changed.push_back(denseToHandle[i]);
+
+	// Children of every handle, packed into one array
+	std::vector<uint32_t> childrenStart(handleToDense.size() + 1, 0);
+	for (auto handle : live)
+		if (parentHandle[handle] != INVALID_HANDLE)
+			++childrenStart[parentHandle[handle] + 1];
+	for (size_t i = 1; i < childrenStart.size(); ++i)
+		childrenStart[i] += childrenStart[i - 1];
+
+	std::vector<Handle> children(childrenStart.back());
+	std::vector<uint32_t> childrenFill(childrenStart.begin(), childrenStart.end() - 1);
+	for (auto handle : live)
+		if (parentHandle[handle] != INVALID_HANDLE)
+			children[childrenFill[parentHandle[handle]]++] = handle;
+
+	// Breadth-first placement, siblings end up next to each other and every level is 4-aligned
+	std::vector<uint32_t> newToOld;
+	std::vector<Handle> newDenseToHandle;
+	std::vector<uint32_t> newParentIndex, newFirstChild, newChildCount;
+	newToOld.reserve(count + 4);
+	levelStart.clear();
+
+	std::vector<Handle> levelHandles;
+	for (auto handle : live)
+		if (parentHandle[handle] == INVALID_HANDLE)
+			levelHandles.push_back(handle);
+
+	std::vector<uint32_t> levelParents(levelHandles.size(), NO_INDEX);
+	std::vector<Handle> nextHandles;
+	std::vector<uint32_t> nextParents;
+
+	while (!levelHandles.empty()) {
+		levelStart.push_back(newToOld.size());
+
+		for (size_t i = 0; i < levelHandles.size(); ++i) {
+			Handle handle = levelHandles[i];
+			uint32_t index = static_cast<uint32_t>(newToOld.size());
+
+			newToOld.push_back(handleToDense[handle]);
+			newDenseToHandle.push_back(handle);
+			newParentIndex.push_back(levelParents[i]);
+			newChildCount.push_back(childrenStart[handle + 1] - childrenStart[handle]);
+			newFirstChild.push_back(0);
+
+			for (auto child = childrenStart[handle]; child < childrenStart[handle + 1]; ++child) {
+				nextHandles.push_back(children[child]);
+				nextParents.push_back(index);
+			}
+		}
+
+		while (newToOld.size() % 4 != 0) {
+			newToOld.push_back(NO_INDEX);
+			newDenseToHandle.push_back(INVALID_HANDLE);
+			newParentIndex.push_back(NO_INDEX);
+			newChildCount.push_back(0);
+			newFirstChild.push_back(0);
+		}
+
+		// Children of a parent were queued together, so they form one contiguous run in the next level
+		size_t nextLevelStart = newToOld.size();
+		for (size_t i = 0; i < nextParents.size(); ++i)
+			if (i == 0 || nextParents[i] != nextParents[i - 1])
+				newFirstChild[nextParents[i]] = static_cast<uint32_t>(nextLevelStart + i);
+
+		levelHandles.swap(nextHandles);
+		levelParents.swap(nextParents);
+		nextHandles.clear();
+		nextParents.clear();
+	}
+	levelStart.push_back(newToOld.size());
+
+	permute(positionX, newToOld, 0.0f); permute(positionY, newToOld, 0.0f); permute(positionZ, newToOld, 0.0f);
+	permute(rotationX, newToOld, 0.0f); permute(rotationY, newToOld, 0.0f); permute(rotationZ, newToOld, 0.0f); permute(rotationW, newToOld, 1.0f);
+	permute(scaleX, newToOld, 1.0f); permute(scaleY, newToOld, 1.0f); permute(scaleZ, newToOld, 1.0f);
+	permute(worldMatrices, newToOld, glm::mat4(1.0f));
+	permute(normalMatrices, newToOld, glm::mat3x4(1.0f));
+	permute(revisions, newToOld, uint32_t(0));
+	permute(boundsX, newToOld, 0.0f); permute(boundsY, newToOld, 0.0f); permute(boundsZ, newToOld, 0.0f); permute(boundsRadius, newToOld, 0.0f);
+	permute(worldBoundsX, newToOld, 0.0f); permute(worldBoundsY, newToOld, 0.0f); permute(worldBoundsZ, newToOld, 0.0f); permute(worldBoundsRadius, newToOld, 0.0f);
+
+	denseToHandle.swap(newDenseToHandle);
+	parentIndex.swap(newParentIndex);
+	firstChild.swap(newFirstChild);
+	childCount.swap(newChildCount);
+	slotCount = newToOld.size();
+
+	for (size_t i = 0; i < slotCount; ++i)
+		if (denseToHandle[i] != INVALID_HANDLE)
+			handleToDense[denseToHandle[i]] = static_cast<uint32_t>(i);
+
+	// Only transforms with a new parent or pending changes, updating a level dirties the subtrees below them
+	dirty.assign((slotCount + WORD_BITS - 1) / WORD_BITS, 0);
+	for (auto handle : changed) {
+		// Handles of destroyed transforms may be listed, or reused by a new one which is listed anyway
+		size_t index = handleToDense[handle];
+		if (index < slotCount && denseToHandle[index] == handle)
+			markDirty(index);
+	}
+
+	hierarchyChanged = false;
+}
+
+void TransformStore::updateLevel(size_t level) {
+	size_t begin = levelStart[level], end = levelStart[level + 1];
+	size_t firstWord = begin / WORD_BITS, endWord = (end + WORD_BITS - 1) / WORD_BITS;
+	bool hasParents = level > 0;
+
+	// Bits of a word that belong to this level, neighbouring levels may share the word
+	auto levelMask = [begin, end](size_t word) {
+		uint64_t mask = ~uint64_t(0);
+		if (word * WORD_BITS < begin)
+			mask &= ~uint64_t(0) << (begin - word * WORD_BITS);
+		if ((word + 1) * WORD_BITS > end)
+			mask &= ~uint64_t(0) >> ((word + 1) * WORD_BITS - end);
+		return mask;
+	};
+
+	Jobs::parallelFor(endWord - firstWord, WORDS_PER_JOB, [&](size_t jobBegin, size_t jobEnd) {
+		for (size_t word = firstWord + jobBegin; word < firstWord + jobEnd; ++word) {
+			uint64_t bits = dirty[word] & levelMask(word);
+			if (bits == 0) continue;
+
+			// Recompute every group of 4 that has at least one changed transform
+			for (size_t group = 0; group < WORD_BITS / 4; ++group) {
+				uint32_t lanes = static_cast<uint32_t>((bits >> (group * 4)) & 0xF);
+				if (lanes != 0)
+					computeMatrices(word * WORD_BITS + group * 4, hasParents, lanes);
+			}
+		}
+	});
+
+	// Pass the change down to the children, which only costs as much as the changed subtrees
+	bool hasNextLevel = level + 2 < levelStart.size();
+	for (size_t word = firstWord; word < endWord; ++word) {
+		uint64_t mask = levelMask(word);
+		uint64_t bits = dirty[word] & mask;
+		dirty[word] &= ~mask;
+
+		for (size_t bit = 0; hasNextLevel && bits != 0; ++bit, bits >>= 1) {
+			if ((bits & 1) == 0) continue;
+
+			size_t index = word * WORD_BITS + bit;
+			for (uint32_t child = 0; child < childCount[index]; ++child)
+				markDirty(firstChild[index] + child);
+		}
+	}
+}
+
+void TransformStore::computeMatrices(size_t first, bool hasParents, uint32_t lanes) {
+	// Local = Translation * Rotation * Scale, computed for 4 transforms at once
+	__m128 qx = _mm_loadu_ps(&rotationX[first]);
+	__m128 qy = _mm_loadu_ps(&rotationY[first]);
+	__m128 qz = _mm_loadu_ps(&rotationZ[first]);
+	__m128 qw = _mm_loadu_ps(&rotationW[first]);
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 two = _mm_set1_ps(2.0f);
+	const __m128 zero = _mm_setzero_ps();
+
+	__m128 xx = _mm_mul_ps(qx, qx), yy = _mm_mul_ps(qy, qy), zz = _mm_mul_ps(qz, qz);
+	__m128 xy = _mm_mul_ps(qx, qy), xz = _mm_mul_ps(qx, qz), yz = _mm_mul_ps(qy, qz);
+	__m128 wx = _mm_mul_ps(qw, qx), wy = _mm_mul_ps(qw, qy), wz = _mm_mul_ps(qw, qz);
+
+	// Rotation matrix columns, same layout as glm::mat3_cast
+	__m128 r0x = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+	__m128 r0y = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+	__m128 r0z = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+
+	__m128 r1x = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+	__m128 r1y = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+	__m128 r1z = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+
+	__m128 r2x = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+	__m128 r2y = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+	__m128 r2z = _mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+
+	__m128 sx = _mm_loadu_ps(&scaleX[first]);
+	__m128 sy = _mm_loadu_ps(&scaleY[first]);
+	__m128 sz = _mm_loadu_ps(&scaleZ[first]);
+
+	// Matrix columns: scaled rotation columns and the translation
+	__m128 c0x = _mm_mul_ps(r0x, sx), c0y = _mm_mul_ps(r0y, sx), c0z = _mm_mul_ps(r0z, sx), c0w = zero;
+	__m128 c1x = _mm_mul_ps(r1x, sy), c1y = _mm_mul_ps(r1y, sy), c1z = _mm_mul_ps(r1z, sy), c1w = zero;
+	__m128 c2x = _mm_mul_ps(r2x, sz), c2y = _mm_mul_ps(r2y, sz), c2z = _mm_mul_ps(r2z, sz), c2w = zero;
+	__m128 c3x = _mm_loadu_ps(&positionX[first]), c3y = _mm_loadu_ps(&positionY[first]), c3z = _mm_loadu_ps(&positionZ[first]), c3w = one;
+
+	// Normal matrix is R * S^-1, the inverse-transpose of R * S
+	__m128 isx = _mm_div_ps(one, sx), isy = _mm_div_ps(one, sy), isz = _mm_div_ps(one, sz);
+	__m128 n0x = _mm_mul_ps(r0x, isx), n0y = _mm_mul_ps(r0y, isx), n0z = _mm_mul_ps(r0z, isx), n0w = zero;
+	__m128 n1x = _mm_mul_ps(r1x, isy), n1y = _mm_mul_ps(r1y, isy), n1z = _mm_mul_ps(r1z, isy), n1w = zero;
+	__m128 n2x = _mm_mul_ps(r2x, isz), n2y = _mm_mul_ps(r2y, isz), n2z = _mm_mul_ps(r2z, isz), n2w = zero;
+
+	// Go from "component of 4 transforms" to "column of one transform"
+	_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+	_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+	_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+	_MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+	_MM_TRANSPOSE4_PS(n0x, n0y, n0z, n0w);
+	_MM_TRANSPOSE4_PS(n1x, n1y, n1z, n1w);
+	_MM_TRANSPOSE4_PS(n2x, n2y, n2z, n2w);
+
+	const __m128 local[4][4] = {
+		{ c0x, c1x, c2x, c3x },
+		{ c0y, c1y, c2y, c3y },
+		{ c0z, c1z, c2z, c3z },
+		{ c0w, c1w, c2w, c3w }
+	};
+	const __m128 normal[4][3] = {
+		{ n0x, n1x, n2x },
+		{ n0y, n1y, n2y },
+		{ n0z, n1z, n2z },
+		{ n0w, n1w, n2w }
+	};
+
+	// Unchanged neighbours are computed for free, but keep their results and revisions
+	for (size_t i = 0; i < 4; ++i) {
+		if ((lanes & (1u << i)) == 0)
+			continue;
+
+		size_t index = first + i;
+		float *worldColumns = &worldMatrices[index][0][0];
+		float *normalColumns = &normalMatrices[index][0][0];
+		for (size_t column = 0; column < 4; ++column)
+			_mm_storeu_ps(worldColumns + column * 4, local[i][column]);
+		for (size_t column = 0; column < 3; ++column)
+			_mm_storeu_ps(normalColumns + column * 4, normal[i][column]);
+		++revisions[index];
+
+		// Parents live in an earlier level, which is already up to date
+		if (hasParents && parentIndex[index] != NO_INDEX) {
+			uint32_t parent = parentIndex[index];
+			worldMatrices[index] = worldMatrices[parent] * worldMatrices[index];
+			normalMatrices[index] = glm::mat3x4(glm::mat3(normalMatrices[parent]) * glm::mat3(normalMatrices[index]));
+		}
+
+		// Bounds follow the final matrix, the radius grows with the largest axis scale
+		const glm::mat4 &world = worldMatrices[index];
+		glm::vec4 center = world * glm::vec4(boundsX[index], boundsY[index], boundsZ[index], 1.0f);
+		float scaleSquared = std::max(glm::dot(glm::vec3(world[0]), glm::vec3(world[0])),
+			std::max(glm::dot(glm::vec3(world[1]), glm::vec3(world[1])), glm::dot(glm::vec3(world[2]), glm::vec3(world[2]))));
+		worldBoundsX[index] = center.x;
+		worldBoundsY[index] = center.y;
+		worldBoundsZ[index] = center.z;
+		worldBoundsRadius[index] = boundsRadius[index] * std::sqrt(scaleSquared);
+	}
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Bounds.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics {
+
+	/*
+		Data-oriented storage of object transforms.
+
+		Positions, rotations and scales are kept in separate tightly packed arrays (structure of arrays)
+		and world matrices are only recomputed for changed transforms, 4 at a time with SSE, across all job threads.
+
+		Transforms form a hierarchy that is stored breadth-first, one level after another.
+		Levels are updated in order, each in parallel, and a change only dirties the subtree below it.
+	*/
+	class TransformStore {
+	public:
+		typedef uint32_t Handle;
+		static constexpr Handle INVALID_HANDLE = UINT32_MAX;
+
+		TransformStore();
+
+		/// Add an identity transform, optionally as a child of another one
+		Handle create(Handle parent = INVALID_HANDLE);
+		/// Remove a transform, its children are passed on to its parent
+		/// The handle may be reused afterwards
+		void destroy(Handle);
+
+		/// Attach a transform to a parent, or make it a root with INVALID_HANDLE
+		/// The local transform is kept, so the world transform follows the new parent
+		/// <throws> invalid_argument if the parent is a descendant of the transform </throws>
+		void setParent(Handle, Handle parent);
+		Handle getParent(Handle) const;
+
+		/// Local transformation, relative to the parent
+		void setPosition(Handle, const glm::vec3 &);
+		void setRotation(Handle, const glm::quat &);
+		void setScale(Handle, const glm::vec3 &);
+
+		/// Local bounding sphere, moved into world space together with the matrix
+		void setBounds(Handle, const BoundingSphere &);
+
+		/// World matrix as of the last update()
+		const glm::mat4 &getWorldMatrix(Handle) const;
+		/// Inverse-transpose of the world matrix' upper 3x3, with columns padded to vec4
+		const glm::mat3x4 &getNormalMatrix(Handle) const;
+		/// Bumped every time the world matrix is recomputed, including when only a parent changed
+		uint32_t getRevision(Handle) const;
+
+		/// World bounding sphere as of the last update()
+		BoundingSphere getWorldBounds(Handle) const;
+
+		/// Recompute matrices of every transform changed since the last update, and of their descendants
+		void update();
+
+		/// Test all world bounds against the frustum, results are read with isVisible()
+		void cull(const Frustum &);
+		/// Whether the transform's bounds intersected the frustum in the last cull()
+		bool isVisible(Handle) const;
+
+		size_t size() const;
+
+	private:
+		// Transforms per dirty bitset word
+		static constexpr size_t WORD_BITS = 64;
+		// Dirty words processed per job, 64 words cover 4096 transforms
+		static constexpr size_t WORDS_PER_JOB = 64;
+		// Groups of 4 bounding spheres tested per culling job
+		static constexpr size_t CULL_GROUPS_PER_JOB = 1024;
+		static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+		// Live transforms
+		size_t count = 0;
+		// Used slots, including level padding and holes left by destroyed transforms
+		size_t slotCount = 0;
+		// Transforms were added, removed or re-parented since the order was last built
+		bool hierarchyChanged = false;
+		// Transforms whose parent changed since then, only their subtrees are recomputed after the rebuild
+		std::vector<Handle> reparented;
+
+		// Dense arrays, padded to a multiple of 4 with identity transforms
+		std::vector<float> positionX, positionY, positionZ;
+		std::vector<float> rotationX, rotationY, rotationZ, rotationW;
+		std::vector<float> scaleX, scaleY, scaleZ;
+
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<glm::mat3x4> normalMatrices;
+		std::vector<uint32_t> revisions;
+
+		std::vector<float> boundsX, boundsY, boundsZ, boundsRadius;
+		std::vector<float> worldBoundsX, worldBoundsY, worldBoundsZ, worldBoundsRadius;
+		std::vector<uint8_t> visible;
+
+		std::vector<uint64_t> dirty;
+
+		// Breadth-first hierarchy, every level starts at a multiple of 4 so SIMD groups never span levels
+		std::vector<uint32_t> parentIndex;
+		std::vector<uint32_t> firstChild, childCount;
+		std::vector<size_t> levelStart;
+
+		// Handles stay stable while dense indices move when the hierarchy changes
+		std::vector<uint32_t> handleToDense;
+		std::vector<Handle> parentHandle;
+		// Children of every handle as a linked list, kept up to date between rebuilds unlike the dense arrays
+		std::vector<Handle> firstChildHandle, nextSiblingHandle, previousSiblingHandle;
+		std::vector<Handle> denseToHandle;
+		std::vector<Handle> freeHandles;
+
+		void resizeSlots(size_t newSlotCount);
+		void resetSlot(size_t index);
+		void markDirty(size_t index);
+		// Add to or remove from the parent's child list, parentHandle has to name the parent
+		void link(Handle);
+		void unlink(Handle);
+
+		void rebuildHierarchy();
+		void updateLevel(size_t level);
+		// Lanes is a 4-bit mask of the transforms in the group that changed, only those are written
+		void computeMatrices(size_t first, bool hasParents, uint32_t lanes);
+	};
+}
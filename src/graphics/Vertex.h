@@ -15,12 +15,12 @@ namespace Graphics {
 		glm::vec3 normal;
 		glm::vec2 texCoord;
 
-		glm::vec3 tangent;
-		glm::vec3 bitangent;
+		// Bitangent handedness in w, shaders rebuild the bitangent as cross(normal, tangent) * w
+		glm::vec4 tangent;
 
 		static VkVertexInputBindingDescription getBindingDescription();
 
-		static std::array<VkVertexInputAttributeDescription, 5> getAttributeDescriptions();
+		static std::array<VkVertexInputAttributeDescription, 4> getAttributeDescriptions();
 
 		bool operator==(const Vertex &) const;
 	};